@@ -14,10 +14,14 @@ namespace cchell::ansi
         cursor_move, /* absolute */
         clear_screen,
         clear_line,
+        clear_to_end, /* of the line */
+        clear_below,  /* the rest of the screen, from the cursor */
         save_cursor,
         restore_cursor,
         hide_cursor,
-        show_cursor
+        show_cursor,
+        bracketed_paste,     /* a is whether it's on */
+        synchronized_output, /* a is whether it's on */
     };
 
 
@@ -77,6 +81,20 @@ namespace cchell::ansi
         }
 
 
+        static constexpr auto
+        clear_to_end() noexcept -> command
+        {
+            return { .kind = command_kind::clear_to_end };
+        }
+
+
+        static constexpr auto
+        clear_below() noexcept -> command
+        {
+            return { .kind = command_kind::clear_below };
+        }
+
+
         static constexpr auto
         save_cursor() noexcept -> command
         {
@@ -103,6 +121,23 @@ namespace cchell::ansi
         {
             return { .kind = command_kind::show_cursor };
         }
+
+
+        /* pastes come between ESC[200~ and ESC[201~ while it's on */
+        static constexpr auto
+        bracketed_paste(bool on) noexcept -> command
+        {
+            return { .kind = command_kind::bracketed_paste, .a = on };
+        }
+
+
+        /* the terminal holds back what comes while it's on, and shows it
+           all at once when it's turned off */
+        static constexpr auto
+        synchronized_output(bool on) noexcept -> command
+        {
+            return { .kind = command_kind::synchronized_output, .a = on };
+        }
     };
 }
 
@@ -133,10 +168,16 @@ template <> struct std::formatter<cchell::ansi::command>
             return std::format_to(out, "\x1b[{};{}H", cmd.a, cmd.b);
         case clear_screen:   return std::format_to(out, "\x1b[2J");
         case clear_line:     return std::format_to(out, "\x1b[2K");
+        case clear_to_end:   return std::format_to(out, "\x1b[K");
+        case clear_below:    return std::format_to(out, "\x1b[J");
         case save_cursor:    return std::format_to(out, "\x1b[s");
         case restore_cursor: return std::format_to(out, "\x1b[u");
         case hide_cursor:    return std::format_to(out, "\x1b[?25l");
         case show_cursor:    return std::format_to(out, "\x1b[?25h");
+        case bracketed_paste:
+            return std::format_to(out, "\x1b[?2004{}", cmd.a != 0 ? 'h' : 'l');
+        case synchronized_output:
+            return std::format_to(out, "\x1b[?2026{}", cmd.a != 0 ? 'h' : 'l');
         }
     }
 };
@@ -83,6 +83,9 @@ namespace cchell::diagnostics
         source_location source;
         std::size_t     length { 1 };
 
+        /* the input ended too early, so more of it could still fix this */
+        bool incomplete { false };
+
 
         [[nodiscard]]
         auto render(std::string_view raw_string,
@@ -135,6 +138,7 @@ namespace cchell::diagnostics
         auto domain(std::string_view domain) -> diagnostic_builder &&;
         auto source(source_location source) -> diagnostic_builder &&;
         auto length(std::size_t length) -> diagnostic_builder &&;
+        auto incomplete() -> diagnostic_builder &&;
 
         [[nodiscard]] auto build() && -> diagnostic;
 
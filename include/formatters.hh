@@ -4,6 +4,7 @@
 #include <iomanip>
 #include <sstream>
 
+#include "interpreter.hh"
 #include "parser.hh"
 
 
@@ -29,12 +30,14 @@ namespace std
 
             switch (type)
             {
-            case token_type::word:    name = "token_type::word"; break;
-            case token_type::bracket: name = "token_type::bracket"; break;
-            case token_type::quote:   name = "token_type::quote"; break;
-            case token_type::pipe:    name = "token_type::pipe"; break;
-            case token_type::dollar:  name = "token_type::dollar"; break;
-            case token_type::none:    name = "token_type::none"; break;
+            case token_type::word:      name = "token_type::word"; break;
+            case token_type::bracket:   name = "token_type::bracket"; break;
+            case token_type::quote:     name = "token_type::quote"; break;
+            case token_type::pipe:      name = "token_type::pipe"; break;
+            case token_type::dollar:    name = "token_type::dollar"; break;
+            case token_type::separator: name = "token_type::separator"; break;
+            case token_type::logical:   name = "token_type::logical"; break;
+            case token_type::none:      name = "token_type::none"; break;
             }
 
             return format_to(ctx.out(), "{}", name);
@@ -87,14 +90,28 @@ R"({{
             string_view name;
             switch (type)
             {
-            case statement:  name = "statement"; break;
-            case command:    name = "command"; break;
-            case option:     name = "option"; break;
-            case parameter:  name = "parameter"; break;
-            case assignment: name = "assignment"; break;
-            case identifier: name = "identifier"; break;
-            case literal:    name = "literal"; break;
-            default:         name = "<unknown>"; break;
+            case statement:      name = "statement"; break;
+            case command:        name = "command"; break;
+            case option:         name = "option"; break;
+            case parameter:      name = "parameter"; break;
+            case assignment:     name = "assignment"; break;
+            case identifier:     name = "identifier"; break;
+            case literal:        name = "literal"; break;
+            case simple_command: name = "simple_command"; break;
+            case pipeline:       name = "pipeline"; break;
+            case and_if:         name = "and_if"; break;
+            case or_if:          name = "or_if"; break;
+            case group:          name = "group"; break;
+            case subshell:       name = "subshell"; break;
+            case list:           name = "list"; break;
+            case if_clause:      name = "if_clause"; break;
+            case while_clause:   name = "while_clause"; break;
+            case until_clause:   name = "until_clause"; break;
+            case for_clause:     name = "for_clause"; break;
+            case case_clause:    name = "case_clause"; break;
+            case case_item:      name = "case_item"; break;
+            case function_def:   name = "function_def"; break;
+            default:             name = "<unknown>"; break;
             }
 
             return format_to(ctx.out(), "{}", name);
@@ -102,7 +119,7 @@ R"({{
     };
 
 
-    template <> struct formatter<cchell::parser::ast_node>
+    template <> struct formatter<cchell::parser::ast>
     {
         static constexpr auto
         parse(format_parse_context &ctx)
@@ -113,9 +130,12 @@ R"({{
 
         template <typename T_FormatContext>
         auto
-        format(const cchell::parser::ast_node &node, T_FormatContext &ctx) const
+        format(const cchell::parser::ast &tree, T_FormatContext &ctx) const
         {
-            mf_format_node(ctx, node, "", true, cchell::parser::ast_type::none);
+            if (tree.empty()) return ctx.out();
+
+            mf_format_node(ctx, tree, tree.root(), "", true,
+                           cchell::parser::ast_type::none);
             return ctx.out();
         }
 
@@ -123,13 +143,15 @@ R"({{
     private:
         template <typename T_FormatContext>
         static void
-        mf_format_node(T_FormatContext                &ctx,
-                       const cchell::parser::ast_node &node,
-                       const string                   &prefix,
-                       bool                            is_last,
-                       cchell::parser::ast_type        prev_type)
+        mf_format_node(T_FormatContext           &ctx,
+                       const cchell::parser::ast &tree,
+                       cchell::parser::node_index index,
+                       const string              &prefix,
+                       bool                       is_last,
+                       cchell::parser::ast_type   prev_type)
         {
-            auto out { ctx.out() };
+            const auto &node { tree[index] };
+            auto        out { ctx.out() };
 
             if (prev_type == cchell::parser::ast_type::statement
                 || !prefix.empty())
@@ -146,13 +168,179 @@ R"({{
                 || !prefix.empty())
                 child_prefix += (is_last ? "    " : "│   ");
 
-            auto end { node.child.end() };
+            for (auto child : tree.children(index))
+            {
+                bool last { tree[child].next_sibling
+                            == cchell::parser::null_node };
+                mf_format_node(ctx, tree, child, child_prefix, last,
+                               node.type);
+            }
+        }
+    };
+
+    template <> struct formatter<cchell::interpreter::opcode>
+    {
+        static constexpr auto
+        parse(format_parse_context &ctx)
+        {
+            return ctx.begin();
+        }
+
+
+        template <typename T_FormatContext>
+        auto
+        format(cchell::interpreter::opcode op, T_FormatContext &ctx) const
+        {
+            using enum cchell::interpreter::opcode;
+
+            string_view name;
+            switch (op)
+            {
+            case literal:         name = "literal"; break;
+            case expand:          name = "expand"; break;
+            case push_arg:        name = "push_arg"; break;
+            case glob:            name = "glob"; break;
+            case arg:             name = "arg"; break;
+            case assign:          name = "assign"; break;
+            case set:             name = "set"; break;
+            case param:           name = "param"; break;
+            case special:         name = "special"; break;
+            case push_params:     name = "push_params"; break;
+            case braces:          name = "braces"; break;
+            case arith:           name = "arith"; break;
+            case defer:           name = "defer"; break;
+            case begin:           name = "begin"; break;
+            case modify:          name = "modify"; break;
+            case spawn:           name = "spawn"; break;
+            case exec:            name = "exec"; break;
+            case define:          name = "define"; break;
+            case pipe:            name = "pipe"; break;
+            case fork:            name = "fork"; break;
+            case wait:            name = "wait"; break;
+            case exit:            name = "exit"; break;
+            case status:          name = "status"; break;
+            case jump:            name = "jump"; break;
+            case jump_if_success: name = "jump_if_success"; break;
+            case jump_if_failure: name = "jump_if_failure"; break;
+            case save:            name = "save"; break;
+            case restore:         name = "restore"; break;
+            case collect:         name = "collect"; break;
+            case next:            name = "next"; break;
+            case subject:         name = "subject"; break;
+            case match:           name = "match"; break;
+            default:              name = "<unknown>"; break;
+            }
+
+            return format_to(ctx.out(), "{}", name);
+        }
+    };
+
 
-            for (auto it { node.child.begin() }; it != end; it++)
+    template <> struct formatter<cchell::interpreter::chunk>
+    {
+        static constexpr auto
+        parse(format_parse_context &ctx)
+        {
+            return ctx.begin();
+        }
+
+
+        template <typename T_FormatContext>
+        auto
+        format(const cchell::interpreter::chunk &code,
+               T_FormatContext                  &ctx) const
+        {
+            using enum cchell::interpreter::opcode;
+            using cchell::interpreter::POSITIONAL;
+            using cchell::interpreter::SPLIT_FIELDS;
+
+            auto out { ctx.out() };
+
+            for (std::size_t i { 0 }; i < code.code.size(); i++)
             {
-                bool last { next(it) == end };
-                mf_format_node(ctx, *it, child_prefix, last, node.type);
+                const auto [op, reg, operand] { code.code[i] };
+
+                out = format_to(out, "{:04} {}", i, op);
+
+                switch (op)
+                {
+                case save:    [[fallthrough]];
+                case restore: [[fallthrough]];
+                case collect: [[fallthrough]];
+                case subject: out = format_to(out, " #{}", reg); break;
+
+                case defer: out = format_to(out, " #{}", reg); [[fallthrough]];
+                case braces:
+                    out = format_to(out, " {} words",
+                                    code.braces[operand].size());
+                    break;
+
+                case arith:
+                    out = format_to(out, " {} steps",
+                                    code.arithmetics[operand].steps.size());
+                    break;
+
+                case next:  [[fallthrough]];
+                case match:
+                    out = format_to(out, " #{} -> {:04}", reg, operand);
+                    break;
+
+                case param:  [[fallthrough]];
+                case define: [[fallthrough]];
+                case status: out = format_to(out, " {}", operand); break;
+
+                case special:
+                    out = format_to(out, " ${}", static_cast<char>(operand));
+                    break;
+
+                case spawn: [[fallthrough]];
+                case exec:
+                    if (operand != 0)
+                        out = format_to(out, " {}",
+                                        code.bindings[operand - 1].name);
+                    break;
+
+                case literal: [[fallthrough]];
+                case arg:
+                {
+                    string data {
+                        (ostringstream {} << quoted(code.strings[operand]))
+                            .str()
+                    };
+                    out = format_to(out, " {}", data);
+                    break;
+                }
+
+                case assign: [[fallthrough]];
+                case set:    out = format_to(out, " ${}", operand); break;
+
+                case expand:
+                    out = format_to(out, " ${}{}", operand,
+                                    (reg & SPLIT_FIELDS) != 0 ? " split" : "");
+                    break;
+
+                case modify:
+                    out = format_to(
+                        out, " {}{} op {}{}",
+                        (operand & POSITIONAL) != 0 ? "param " : "$",
+                        operand & ~POSITIONAL, reg & 0xff,
+                        (reg & SPLIT_FIELDS) != 0 ? " split" : "");
+                    break;
+
+                case fork:            [[fallthrough]];
+                case jump:            [[fallthrough]];
+                case jump_if_success: [[fallthrough]];
+                case jump_if_failure:
+                    out = format_to(out, " -> {:04}", operand);
+                    break;
+
+                default: break;
+                }
+
+                out = format_to(out, "\n");
             }
+
+            return out;
         }
     };
 }
@@ -0,0 +1,124 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace cchell::glob
+{
+    /**
+     * matches a single path component against *, ?, [...] and \-escapes.
+     * the literal prefix and the literal tail after the last * are checked
+     * first, so most names are turned down without running the elements.
+     *
+     * unless @param path, it matches any text instead, a leading . or a /
+     * being nothing special, as in ${var#pattern}.
+     */
+    class matcher
+    {
+    public:
+        explicit matcher(std::string_view pattern, bool path = true);
+
+
+        [[nodiscard]]
+        auto matches(std::string_view name) const -> bool;
+
+
+        /* how long the longest start of @param text it matches is */
+        [[nodiscard]]
+        auto longest_match(std::string_view text) const
+            -> std::optional<std::size_t>;
+
+
+        /* whether the pattern has no wildcards, so needs no listing */
+        [[nodiscard]]
+        auto
+        is_literal() const -> bool
+        {
+            return m_elements.empty();
+        }
+
+
+        /* the literal start of the pattern without its escapes, which is
+           all of it when it is literal */
+        [[nodiscard]]
+        auto
+        prefix() const -> const std::string &
+        {
+            return m_prefix;
+        }
+
+    private:
+        struct element
+        {
+            enum class kind : std::uint8_t
+            {
+                literal, /* m_text[offset, offset + length) */
+                any,     /* ? */
+                star,    /* * */
+                set,     /* m_sets[offset] */
+            };
+
+            kind          type;
+            std::uint32_t offset { 0 };
+            std::uint32_t length { 0 };
+        };
+
+        std::string                   m_prefix;
+        std::string                   m_suffix;
+        std::vector<element>          m_elements; /* what follows m_prefix */
+        std::string                   m_text;
+        std::vector<std::bitset<256>> m_sets;
+        bool                          m_dotted; /* may match a leading . */
+        bool                          m_starred { false };
+
+        /* how long a match is, when there is no * to make it vary */
+        std::size_t m_length { 0 };
+
+
+        auto mf_match(std::string_view name) const -> bool;
+    };
+
+
+    /* a whole pattern, compiled to one matcher per path component */
+    class pattern
+    {
+    public:
+        explicit pattern(std::string_view source);
+
+
+        /* appends every path matching, sorted, to @param out */
+        void expand(std::vector<std::string> &out) const;
+
+    private:
+        struct component
+        {
+            matcher match;
+            bool    recursive; /* ** */
+        };
+
+        std::vector<component> m_components;
+        bool                   m_absolute { false };
+        bool                   m_directories { false }; /* ends with / */
+    };
+
+
+    /* whether @param word has an unescaped *, ? or [ */
+    [[nodiscard]]
+    auto has_magic(std::string_view word) -> bool;
+
+
+    /* appends @param word without its backslash escapes to @param out */
+    void unescape(std::string_view word, std::string &out);
+
+
+    /**
+     * appends the paths @param source matches to @param out, the pattern
+     * only compiled the first time the session sees it. returns whether
+     * anything matched.
+     */
+    auto expand(std::string_view source, std::vector<std::string> &out) -> bool;
+}
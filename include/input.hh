@@ -1,9 +1,17 @@
 #pragma once
 #include <atomic>
+#include <compare>
+#include <cstddef>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <termios.h>
 
+#include "lexer.hh"
+#include "terminal.hh"
+
 
 namespace cchell::input
 {
@@ -29,15 +37,282 @@ namespace cchell::input
     };
 
 
+    /**
+     * a script read from @param fd, which is mapped whole when it is a
+     * regular file and otherwise read through a buffer a line at a time,
+     * so a pipe can be acted on before its writer is done.
+     *
+     * when @param shared, what the script runs reads from the same fd, so
+     * it is read a byte at a time to never take input past a line, as sh
+     * does. a mapped one is read on from wherever the fd was left.
+     */
     class stream_input : public input_source
     {
+    public:
+        explicit stream_input(int fd, bool shared = false);
+        ~stream_input() override;
+
+        /* reads the next line of @param text, its newline included */
+        auto read(std::string &text) noexcept -> int override;
+
+        /* all of a regular file, left where the kernel mapped it */
+        [[nodiscard]] auto mapped() const noexcept
+            -> std::optional<std::string_view>;
+
+    private:
+        int              m_fd;
+        bool             m_shared;
+        std::string_view m_mapping;
+        std::string      m_buffer;
+        std::size_t      m_begin { 0 };
+        bool             m_eof { false };
+    };
+
+
+    /**
+     * text with a gap at the cursor, so inserting and erasing there only
+     * moves an edge of the gap. moving the cursor moves just the text it
+     * passes over to the other side of the gap.
+     */
+    class gap_buffer
+    {
+    public:
+        void insert(std::string_view text);
+
+        /* erases @param count bytes right before or after the cursor */
+        void erase_before(std::size_t count) noexcept;
+        void erase_after(std::size_t count) noexcept;
+
+        void move_to(std::size_t position) noexcept;
+        void clear() noexcept;
+
+
+        [[nodiscard]]
+        auto
+        cursor() const noexcept -> std::size_t
+        {
+            return m_gap_begin;
+        }
+
+
+        [[nodiscard]]
+        auto
+        size() const noexcept -> std::size_t
+        {
+            return m_data.size() - (m_gap_end - m_gap_begin);
+        }
+
+
+        [[nodiscard]]
+        auto
+        operator[](std::size_t index) const noexcept -> char
+        {
+            return m_data[index < m_gap_begin ? index
+                                              : index + (m_gap_end
+                                                         - m_gap_begin)];
+        }
+
+
+        /* the text on either side of the cursor */
+        [[nodiscard]] auto before() const noexcept -> std::string_view;
+        [[nodiscard]] auto after() const noexcept -> std::string_view;
+
+        /* appends the text from @param first up to @param last to @param out */
+        void copy(std::size_t  first,
+                  std::size_t  last,
+                  std::string &out) const;
+
+    private:
+        std::string m_data;
+        std::size_t m_gap_begin { 0 };
+        std::size_t m_gap_end { 0 };
+    };
+
+
+    /**
+     * the line being typed, edited a whole UTF-8 character at a time. a
+     * word is a run of anything but blanks. the edits return where the
+     * text changed from, if it did, the motions only move the cursor.
+     *
+     * the line is kept lexed as it is edited, only the tokens around an
+     * edit being lexed again, so a keystroke costs the same however long
+     * the command has grown.
+     */
+    class line_editor
+    {
+    public:
+        using change = std::optional<std::size_t>;
+
+        auto insert(std::string_view text) -> change;
+        auto backspace() -> change;
+        auto del() -> change;
+
+        auto kill_to_start() -> change;
+        auto kill_to_end() -> change;
+        auto kill_word_before() -> change;
+        auto yank() -> change;
+
+        void left() noexcept;
+        void right() noexcept;
+        void word_left() noexcept;
+        void word_right() noexcept;
+        void home() noexcept;
+        void end() noexcept;
+
+        /* empties the line, what was killed stays to be yanked */
+        void clear() noexcept;
+
+
+        [[nodiscard]]
+        auto
+        buffer() const noexcept -> const gap_buffer &
+        {
+            return m_buffer;
+        }
+
+
+        /* the tokens of the line, unchecked */
+        [[nodiscard]]
+        auto
+        tokens() const noexcept -> const std::vector<lexer::token> &
+        {
+            return m_tokens;
+        }
+
+    private:
+        gap_buffer  m_buffer;
+        std::string m_killed;
+
+        /* the line in one piece, which the tokens point into */
+        std::string               m_text;
+        std::vector<lexer::token> m_tokens;
+
+
+        [[nodiscard]] auto mf_previous(std::size_t position) const noexcept
+            -> std::size_t;
+        [[nodiscard]] auto mf_next(std::size_t position) const noexcept
+            -> std::size_t;
+
+        /* cuts out the text from @param first up to the cursor, or from
+           the cursor up to @param first */
+        auto mf_kill(std::size_t first) -> change;
+
+        /* relexes the line after @param removed bytes at @param offset
+           were replaced with @param inserted */
+        auto mf_changed(std::size_t      offset,
+                        std::size_t      removed,
+                        std::string_view inserted) -> change;
+    };
+
+
+    /**
+     * draws the line being edited after the prompt, wrapped over as many
+     * rows as it takes. what is on the screen is kept a cell at a time, a
+     * cell being a character with whatever joins it, so drawing again only
+     * writes the cells that changed and moves the cursor over the rest.
+     *
+     * a line longer than the screen has room for is shown through a
+     * window on one row instead, around the cursor, with < and > at the
+     * edges where the line goes on. only what is in the window is laid
+     * out, so a keystroke costs as much as the terminal is wide.
+     */
+    class line_renderer
+    {
+    public:
+        /* draws @param prompt, the line starting empty right after it */
+        void start(std::string_view prompt);
+
+        /* lays @param line out again from byte @param from on, draws what
+           changed, and puts the cursor where the line has it */
+        void draw(const gap_buffer &line, std::size_t from);
+
+        /* puts the cursor on the cell holding the cursor of @param line,
+           moving the window first when it isn't in it */
+        void place(const gap_buffer &line);
+
+        /* draws @param line again whole, after the terminal's width changed */
+        void resize(const gap_buffer &line);
+
+        /* leaves the cursor at the start of the row after the line */
+        void finish();
+
+    private:
+        /* a row, and a column that is the width of the terminal when the
+           cursor waits to wrap after the last one */
+        struct point
+        {
+            std::size_t row { 0 };
+            std::size_t col { 0 };
+
+            auto operator<=>(const point &) const = default;
+        };
+
+        struct cell
+        {
+            std::size_t offset; /* of its bytes in the line */
+            std::size_t length;
+            std::size_t glyph; /* what is drawn for it, in m_glyphs */
+            std::size_t glyph_length;
+            point       at;
+            std::size_t width;
+
+
+            [[nodiscard]]
+            auto
+            end() const noexcept -> point
+            {
+                return { at.row, at.col + width };
+            }
+        };
+
+        std::size_t       m_columns { 80 };
+        std::size_t       m_rows { 24 };
+        std::size_t       m_prompt_width { 0 };
+        std::size_t       m_origin { 0 }; /* the column after the prompt */
+        std::vector<cell> m_cells;
+        std::string       m_glyphs;
+        point             m_cursor; /* where the terminal has it */
+        point             m_end;
+
+        /* the bytes of the line shown, all of them unless it's windowed */
+        bool        m_windowed { false };
+        std::size_t m_window { 0 };
+        std::size_t m_window_end { 0 };
+
+        /* the cells laid out for a draw, before they replace the tail */
+        std::vector<cell> m_next;
+        std::string       m_next_glyphs;
+        std::size_t       m_next_end { 0 };
+
+
+        /* lays out the cells of @param line from cell @param first on, as
+           far as the window goes */
+        void mf_layout(const gap_buffer &line, std::size_t first);
+        void mf_draw(const gap_buffer &line, std::size_t first);
+        void mf_move(point to);
+
+        /* where the window starts for the cursor to be halfway into it */
+        [[nodiscard]] auto mf_anchor(const gap_buffer &line) const
+            -> std::size_t;
+
+        /* whether the cursor of @param line is in what ends at @param end */
+        [[nodiscard]] auto mf_shows(const gap_buffer &line,
+                                    std::size_t       end) const noexcept
+            -> bool;
+
+        /* where the first @param count cells end */
+        [[nodiscard]] auto mf_end(std::size_t count) const noexcept -> point;
+
+        /* @param at, or the start of the next row when it waits to wrap */
+        [[nodiscard]] auto mf_wrapped(point at) const noexcept -> point;
     };
 
 
     class interactive_input : public input_source
     {
     public:
-        interactive_input();
+        explicit interactive_input(std::string prompt = "$ ");
+        ~interactive_input() override;
 
         auto read(std::string &text) noexcept -> int override;
 
@@ -45,14 +320,28 @@ namespace cchell::input
 
     private:
         termios                   m_old_term;
+        terminal::decoder         m_decoder;
+        line_editor               m_editor;
+        line_renderer             m_renderer;
+        std::string               m_prompt;
         static interactive_input *m_instance;
         std::atomic_bool          m_sigint_triggered;
 
 
         void set_sigint_flag(bool value);
 
+        /* reads a line with bracketed paste on, see read() */
+        auto mf_read(std::string &text) noexcept -> int;
+
+        /* the editing keys, and the control characters readline has */
+        void mf_key(const terminal::key_event &event);
+        void mf_control(char ch);
+
+        void mf_redraw(line_editor::change from);
+
 
         static void install_sigint_action();
         static void sigint_handler(int sig);
+        static void sigwinch_handler(int sig);
     };
 }
@@ -1,32 +1,772 @@
 #pragma once
+#include <cstdint>
+#include <deque>
 #include <expected>
+#include <list>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <sys/types.h>
 
-namespace cchell::parser { struct ast_node; }
+#include "shared.hh"
+
+
+namespace cchell::parser { class ast; }
 namespace cchell::diagnostics { struct diagnostic; }
 
 
 namespace cchell::interpreter
 {
+    struct chunk;
+
+
+    /**
+     * the shell's variables, addressed by slots that stay valid for the
+     * lifetime of the environment, so compiled code never looks up a name.
+     */
+    class environment
+    {
+    public:
+        using slot = std::uint32_t;
+
+
+        explicit environment(char **envp);
+
+
+        /* returns the slot of @param name, creating an unset one if needed */
+        auto resolve(std::string_view name) -> slot;
+
+
+        [[nodiscard]]
+        auto name(slot index) const -> const std::string &;
+
+
+        /* returns nullptr when the variable is unset */
+        [[nodiscard]]
+        auto get(slot index) const -> const std::string *;
+
+
+        void set(slot index, std::string_view value);
+        void unset(slot index);
+        void mark_exported(slot index);
+
+
+        /* what unquoted expansions are split on, $IFS or its default */
+        [[nodiscard]]
+        auto field_separators() const -> std::string_view;
+
+
+        void define(std::string_view name, std::shared_ptr<const chunk> body);
+
+        /* returns nullptr when there is no function called @param name */
+        [[nodiscard]]
+        auto function(std::string_view name) const
+            -> std::shared_ptr<const chunk>;
+
+
+        /**
+         * changes whenever a command name might start referring to something
+         * else, which is when $PATH is set or a function is defined.
+         */
+        [[nodiscard]]
+        auto generation() const -> std::uint64_t;
+
+        /* indexes $PATH into shared::executables again, if it changed since
+           it last was. setting $PATH only marks it, so a PATH=... prefix
+           or a loop editing it pays for one scan at the next lookup */
+        void refresh_executables() const;
+
+
+        /* asks the shell to stop once the running statement returns */
+        void request_exit(int status);
+
+        [[nodiscard]]
+        auto exit_requested() const -> std::optional<int>;
+
+
+        /**
+         * returns a null-terminated envp for execve, built from the exported
+         * variables and rebuilt only after one of them has changed.
+         */
+        auto envp() -> char **;
+
+    private:
+        struct variable
+        {
+            std::string name;
+            std::string value;
+            bool        set;
+            bool        exported;
+        };
+
+        std::vector<variable> m_variables;
+        std::unordered_map<std::string,
+                           slot,
+                           shared::string_hash,
+                           shared::string_equal>
+            m_slots;
+
+        std::vector<std::string> m_entries;
+        std::vector<char *>      m_envp;
+        bool                     m_dirty { true };
+
+        std::unordered_map<std::string,
+                           std::shared_ptr<const chunk>,
+                           shared::string_hash,
+                           shared::string_equal>
+                      m_functions;
+        std::uint64_t m_generation { 1 };
+        slot          m_path { static_cast<slot>(-1) };
+        slot          m_ifs { static_cast<slot>(-1) };
+        mutable bool  m_path_changed { false };
+
+        std::optional<int> m_exit;
+    };
+
+
+    enum class opcode : std::uint8_t
+    {
+        literal,      /* appends string[operand] to the current word */
+        expand,       /* appends the value of slot[operand] to the word */
+        push_arg,     /* ends the current word, unless nothing made it up */
+        glob,         /* ends the current word, as the paths it matches */
+        arg,          /* literal + push_arg */
+        assign,       /* moves the current word into an assignment */
+        set,          /* moves the current word into slot[operand] */
+        param,        /* appends positional parameter operand to the word */
+        special,      /* appends $operand, one of ?, #, @, * and $ */
+        push_params,  /* pushes every positional parameter as an argument */
+        braces,       /* pushes every word braces[operand] makes, expanded */
+        arith,        /* appends the value of arithmetic[operand] */
+        begin,        /* starts a word for modify to use instead */
+        modify,       /* appends parameter operand, changed by modifier reg */
+        spawn,        /* runs the arguments, see binding, then waits */
+        exec,         /* replaces the current (forked) process */
+        define,       /* defines function[operand] */
+        pipe,         /* connects the next fork's stdout to the one after */
+        fork,         /* the parent jumps to operand, the child falls through */
+        wait,         /* waits for every fork since the last wait */
+        exit,         /* exits the current (forked) process */
+        status,       /* sets the status to operand */
+        jump,         /* jumps to operand */
+        jump_if_success,
+        jump_if_failure,
+
+        /* the ones below work on the loop frame reg */
+        save,    /* remembers the status */
+        restore, /* brings the remembered status back */
+        collect, /* moves the arguments into the frame's items */
+        defer,   /* braces, but each word is only made when next gets to it */
+        next,    /* moves the next item into the word, or jumps to operand */
+        subject, /* moves the current word into the frame's subject */
+        match,   /* jumps to operand if the word, as a pattern, matches it */
+
+        /* the ones below take a number out of the current word, naming the
+           builtin in string[operand] when it isn't one */
+        word_status, /* sets the status to it, or to 2, for return */
+        loop_levels, /* skips that many - 1 of the reg jumps after it */
+    };
+
+
+    /**
+     * expand, param, special and modify split their value into fields on
+     * $IFS when reg has this, which they get outside of double quotes.
+     */
+    inline constexpr std::uint16_t SPLIT_FIELDS { 1U << 15 };
+
+    /* in a pattern, the value is quoted so its glob characters are escaped */
+    inline constexpr std::uint16_t ESCAPE_GLOB { 1U << 13 };
+
+    /* for modify, when the parameter being empty counts as it being unset */
+    inline constexpr std::uint16_t EMPTY_IS_UNSET { 1U << 14 };
+
+    /* modify's operand is a slot, or a positional parameter with this */
+    inline constexpr std::uint32_t POSITIONAL { 1U << 31 };
+
+
+    /**
+     * what ${parameter<op>word} does, the ones taking words use the ones
+     * begin started, in order.
+     */
+    enum class modifier : std::uint8_t
+    {
+        length,          /* ${#p} */
+        use_default,     /* ${p-word} */
+        assign_default,  /* ${p=word} */
+        use_alternative, /* ${p+word} */
+        error_if_unset,  /* ${p?word} */
+        remove_prefix,   /* ${p#pattern} */
+        remove_longest_prefix,
+        remove_suffix,   /* ${p%pattern} */
+        remove_longest_suffix,
+        replace,         /* ${p/pattern/word} */
+        replace_all,
+    };
+
+
+    struct instruction
+    {
+        opcode        op;
+        std::uint16_t reg { 0 };
+        std::uint32_t operand { 0 };
+    };
+
+
+    /**
+     * what a command name refers to, resolved once and kept until the
+     * environment's generation moves on. spawn and exec take the index of
+     * theirs plus one, or 0 to resolve the first argument every time.
+     */
+    struct binding
+    {
+        enum class kind : std::uint8_t
+        {
+            missing,
+            builtin,
+            function,
+            program,
+        };
+
+        std::string   name;
+        std::uint64_t generation { 0 };
+
+        kind                       type { kind::missing };
+        std::uint32_t              builtin { 0 };
+        std::weak_ptr<const chunk> function; /* weak, functions can recurse */
+        std::string                path;
+    };
+
+
+    /**
+     * a word with braces, like a{b,c}{1..3}, as the parts its words are made
+     * of. a word is only ever made when asked for, so {1..1000000} costs
+     * nothing up front.
+     */
+    class brace_word
+    {
+    public:
+        /* {first..last..step}, of numbers or of characters */
+        struct sequence
+        {
+            std::int64_t  first;
+            std::int64_t  step;
+            std::uint64_t count;
+            std::uint8_t  width;      /* zero-padded to, for {01..10} */
+            bool          characters;
+        };
+
+        /* literal text is a part with a single alternative */
+        struct part
+        {
+            std::vector<std::string> alternatives;
+            std::optional<sequence>  range;
+        };
+
+
+        explicit brace_word(std::vector<part> parts);
+
+
+        /* how many words there are, saturated rather than overflowing */
+        [[nodiscard]]
+        auto
+        size() const -> std::uint64_t
+        {
+            return m_size;
+        }
+
+
+        /* appends word @param index to @param out, the first part varying
+           the slowest */
+        void generate(std::uint64_t index, std::string &out) const;
+
+
+        [[nodiscard]]
+        auto
+        parts() const -> std::span<const part>
+        {
+            return m_parts;
+        }
+
+    private:
+        std::vector<part>          m_parts;
+        std::vector<std::uint64_t> m_strides; /* words per step of a part */
+        std::uint64_t              m_size { 1 };
+    };
+
+
+    /**
+     * a compiled $(( )), for a small stack machine of its own. whatever
+     * is constant was already folded, variables are slots.
+     */
+    struct arithmetic
+    {
+        enum class op : std::uint8_t
+        {
+            constant, /* pushes value */
+            load,     /* pushes the variable in slot value */
+            store,    /* sets the variable in slot value to the top */
+            param,    /* pushes positional parameter value */
+            count,    /* pushes $# */
+            status,   /* pushes $? */
+            pop,
+
+            negate,
+            complement,
+            logical_not,
+
+            add,
+            subtract,
+            multiply,
+            divide,
+            modulo,
+            power,
+            shift_left,
+            shift_right,
+            less,
+            less_equal,
+            greater,
+            greater_equal,
+            equal,
+            not_equal,
+            bit_and,
+            bit_xor,
+            bit_or,
+
+            jump,         /* jumps to step value */
+            jump_if_zero, /* pops, and jumps to step value if it was 0 */
+            jump_if_set,  /* pops, and jumps to step value if it wasn't */
+        };
+
+        struct step
+        {
+            op           code;
+            std::int64_t value { 0 };
+        };
+
+        std::vector<step> steps;
+        std::string       error; /* a syntax error, reported when it runs */
+
+
+        /* the value, when folding left nothing to run */
+        [[nodiscard]]
+        auto constant() const -> std::optional<std::int64_t>;
+    };
+
+
+    /* a compiled statement, it owns every string its instructions use */
+    struct chunk
+    {
+        struct definition
+        {
+            std::string                  name;
+            std::shared_ptr<const chunk> body;
+        };
+
+        std::vector<instruction> code;
+        std::vector<std::string> strings;
+        std::vector<definition>  functions;
+        std::vector<brace_word>  braces;
+        std::vector<arithmetic>  arithmetics;
+        std::uint16_t            frames { 0 }; /* the deepest reg used + 1 */
+
+        /* resolved lazily while running, see binding */
+        mutable std::vector<binding> bindings;
+
+
+        auto intern(std::string string) -> std::uint32_t;
+    };
+
+
     namespace impl
     {
-        struct process
+        /**
+         * the arguments of the command being built, kept back to back in one
+         * buffer that is reused from one command to the next, so building
+         * them stops allocating once it has grown. each one stays
+         * null-terminated, ready for execve.
+         */
+        class arguments
         {
-            std::vector<std::string> envp;
+        public:
+            /* appending anything, even nothing, makes the current word count */
+            void
+            append(std::string_view text)
+            {
+                m_buffer += text;
+                m_pending = true;
+            }
+
+
+            /* appends @param text split into fields on @param separators */
+            void split(std::string_view text, std::string_view separators);
+
+            /* ends the current field, if anything made it up */
+            void finish();
+
+            /* ends the current word, which splitting may have made into
+               several fields */
+            void
+            end_word()
+            {
+                finish();
+                m_first = m_starts.size();
+            }
+
+
+            /* how many fields the last word ended up as */
+            [[nodiscard]]
+            auto
+            fields() const -> std::size_t
+            {
+                return m_starts.size() - m_first;
+            }
+
+
+            /* drops the fields past the first @param count */
+            void truncate(std::size_t count);
+
+
+            void
+            push(std::string_view text)
+            {
+                append(text);
+                end_word();
+            }
+
+
+            /* the word being built, null-terminated for as long as it lasts */
+            [[nodiscard]]
+            auto word() const -> std::string_view;
+
+            void drop_word();
+
+
+            [[nodiscard]]
+            auto
+            size() const -> std::size_t
+            {
+                return m_starts.size();
+            }
+
+
+            [[nodiscard]]
+            auto
+            empty() const -> bool
+            {
+                return m_starts.empty();
+            }
+
+
+            [[nodiscard]]
+            auto operator[](std::size_t index) const -> std::string_view;
+
+            [[nodiscard]]
+            auto
+            front() const -> std::string_view
+            {
+                return (*this)[0];
+            }
 
-            std::string              path;
-            std::vector<std::string> argv;
 
+            void clear();
 
-            auto exec() -> bool;
+            /* fills @param out with every argument, then a nullptr */
+            void pointers(std::vector<char *> &out);
+
+            void views(std::vector<std::string_view> &out) const;
+
+        private:
+            std::string                m_buffer;
+            std::vector<std::uint32_t> m_starts;
+            std::size_t                m_word { 0 }; /* where the word starts */
+            std::size_t                m_first { 0 }; /* its first field */
+            bool                       m_pending { false };
         };
+
+
+        /**
+         * appends @param value without the part @param pattern matches at its
+         * start or end, as @param type says.
+         */
+        void remove_affix(std::string_view value,
+                          std::string_view pattern,
+                          modifier         type,
+                          std::string     &out);
+
+        /* appends @param value with the longest matches of @param pattern
+           replaced by @param replacement, the first or all of them */
+        void replace(std::string_view value,
+                     std::string_view pattern,
+                     std::string_view replacement,
+                     bool             all,
+                     std::string     &out);
+
+
+        /**
+         * the braces of the raw @param word, or nothing when it has none
+         * that expand. quoted and escaped braces, and ${, don't count.
+         */
+        [[nodiscard]]
+        auto parse_braces(std::string_view word) -> std::optional<brace_word>;
+
+        /* whether @param word has nothing to expand, glob or unquote */
+        [[nodiscard]]
+        auto is_plain(std::string_view word) -> bool;
+
+        /* compiles @param word as a single argument, for the words of the
+           braces that are too many to be compiled ahead of running */
+        [[nodiscard]]
+        auto compile_word(std::string_view word, environment &env) -> chunk;
+
+
+        /* compiles the expression of a $(( )), resolving its variables */
+        [[nodiscard]]
+        auto compile_arithmetic(std::string_view source, environment &env)
+            -> arithmetic;
+
+        /* runs @param expression with $1... being @param params and $? being
+           @param status */
+        [[nodiscard]]
+        auto evaluate(const arithmetic                 &expression,
+                      environment                      &env,
+                      std::span<const std::string_view> params,
+                      int status) -> std::expected<std::int64_t, std::string>;
+
+
+        /* every argument is null-terminated, see arguments */
+        using builtin
+            = auto (*)(std::span<const std::string_view> args, environment &env)
+            -> int;
+
+        /* returns the index run_builtin takes, if @param name is one */
+        [[nodiscard]]
+        auto find_builtin(std::string_view name) -> std::optional<std::uint32_t>;
+
+        auto run_builtin(std::uint32_t                     index,
+                         std::span<const std::string_view> args,
+                         environment                      &env) -> int;
+
+        /* whether the assignments before the builtin at @param index stay
+           once it ran, as they do for export and the like */
+        [[nodiscard]]
+        auto is_special_builtin(std::uint32_t index) -> bool;
+
+
+        /* resolves @param target, unless it is still up to date */
+        void bind(binding &target, const environment &env);
+
+
+        /* waits for @param pid, returning its status the way $? has it */
+        auto wait_for(pid_t pid) -> int;
+
+        /**
+         * splits @param items into the fewest runs that each fit into one
+         * execve, next to @param fixed and @param envp, returning where
+         * each run ends.
+         */
+        [[nodiscard]]
+        auto plan_batches(std::span<const std::string_view> fixed,
+                          std::span<const std::string_view> items,
+                          char *const                      *envp)
+            -> std::expected<std::vector<std::size_t>, std::string>;
+
+        /**
+         * runs forked jobs, at most so many at a time. a job's stdout and
+         * stderr go through pipes and are held back until every job started
+         * before it is done, so the output reads as if they ran one by one;
+         * only the oldest job writes straight through. exits are noticed on
+         * pidfds, polled along with the pipes. one job at a time has no
+         * order to keep, so it gets the shell's own stdout and stderr.
+         */
+        class scheduler
+        {
+        public:
+            explicit scheduler(std::size_t jobs);
+            ~scheduler();
+
+            scheduler(const scheduler &)                     = delete;
+            auto operator=(const scheduler &) -> scheduler & = delete;
+
+
+            /**
+             * forks the next job once there is room for it, returning 0 in
+             * the child, which is to exit rather than return.
+             */
+            auto fork() -> std::expected<pid_t, std::string>;
+
+
+            /* waits for every job, returning the first failure, or 0 */
+            auto wait() -> int;
+
+        private:
+            struct job
+            {
+                pid_t       pid;
+                int         pidfd;
+                int         out; /* -1 once it reached its end */
+                int         err;
+                std::string held_out;
+                std::string held_err;
+                bool        exited { false };
+                int         status { 0 };
+            };
+
+            std::size_t     m_jobs;
+            std::deque<job> m_running;
+            int             m_status { 0 };
+
+
+            void mf_poll();
+            void mf_output(std::size_t      index,
+                           bool             error,
+                           std::string_view data);
+            void mf_retire();
+        };
+
+
+        /**
+         * runs the program at @param path once per batch @param ends plans,
+         * with @param fixed and that batch of @param items as its arguments
+         * and at most @param jobs of them at a time. returns the status of
+         * the first batch that failed, or 0.
+         */
+        auto run_batches(const std::string                &path,
+                         std::span<const std::string_view> fixed,
+                         std::span<const std::string_view> items,
+                         std::span<const std::size_t>      ends,
+                         std::size_t                       jobs,
+                         char *const                      *envp) -> int;
     }
 
 
+    /* whether @param name runs inside the shell rather than as a program */
+    [[nodiscard]]
+    auto is_builtin(std::string_view name) -> bool;
+
+
+    /* lowers @param tree to a chunk, resolving variables to @param env */
+    [[nodiscard]]
+    auto compile(const parser::ast &tree, environment &env) -> chunk;
+
+
+    /**
+     * keeps the chunks of the @param capacity most recently used sources,
+     * so reran lines skip lexing, parsing and compiling altogether.
+     */
+    class cache
+    {
+    public:
+        explicit cache(std::size_t capacity = 64);
+
+
+        [[nodiscard]]
+        auto find(std::string_view source) -> const chunk *;
+
+
+        auto insert(std::string_view source, chunk code) -> const chunk &;
+
+    private:
+        using entry = std::pair<std::string, chunk>;
+
+        std::size_t      m_capacity;
+        std::list<entry> m_entries;
+        std::unordered_map<std::string_view, std::list<entry>::iterator>
+            m_index;
+    };
+
+
+    /**
+     * the chunks of a script's lines, stored in the cache directory so an
+     * unchanged script skips lexing, parsing, verifying and compiling the
+     * next time it runs. an entry is keyed by a hash of the script, the
+     * shell's version and a generation of $PATH, made of its value and of
+     * when each of its directories last changed, and is never used once
+     * any of them moved on. the least recently used entries go once the
+     * directory outgrows its limit, and $CCHELL_NO_CACHE turns it all off.
+     */
+    class stored_script
+    {
+    public:
+        /* the entry for @param source, if a matching one is stored */
+        [[nodiscard]]
+        static auto open(std::string_view source, environment &env)
+            -> std::optional<stored_script>;
+
+        stored_script(stored_script &&other) noexcept;
+        auto operator=(stored_script &&) -> stored_script & = delete;
+        ~stored_script();
+
+
+        /* the chunk of the next line, std::nullopt after the last one */
+        [[nodiscard]]
+        auto next(const environment &env) -> std::optional<chunk>;
+
+
+        /* where the line of the chunk next() last returned ends */
+        [[nodiscard]]
+        auto
+        end() const noexcept -> std::size_t
+        {
+            return m_end;
+        }
+
+    private:
+        std::string_view               m_mapping;
+        std::size_t                    m_offset { 0 };
+        std::size_t                    m_end { 0 }; /* in the source */
+        std::uint32_t                  m_lines { 0 };
+        std::vector<environment::slot> m_slots; /* by stored index */
+
+
+        stored_script() = default;
+    };
+
+
+    /**
+     * collects the chunks of a script's lines as they run, bindings
+     * resolved along the way included, so they can become its
+     * stored_script.
+     */
+    class script_recorder
+    {
+    public:
+        script_recorder(std::string_view source, environment &env);
+
+
+        /* @param end being where the line @param code is from ends */
+        void add(const chunk &code, const environment &env, std::size_t end);
+
+        /* writes the entry, failing quietly, the cache only ever saves work */
+        void store();
+
+    private:
+        std::string                m_path;
+        std::string                m_header;
+        std::string                m_payload;
+        std::uint32_t              m_lines { 0 };
+        std::vector<std::string>   m_names;
+        std::vector<std::uint32_t> m_indices; /* by slot, of the names */
+
+
+        void mf_chunk(const chunk &code, const environment &env);
+        auto mf_slot(environment::slot slot, const environment &env)
+            -> std::uint32_t;
+    };
+
+
+    /**
+     * runs @param code to completion, returning its exit status. a function
+     * body gets its arguments as @param params.
+     */
     [[nodiscard]]
-    auto execute(const std::unique_ptr<parser::ast_node> &tree)
-        -> std::expected<pid_t, std::string>;
+    auto execute(const chunk                      &code,
+                 environment                      &env,
+                 std::span<const std::string_view> params = {})
+        -> std::expected<int, std::string>;
 }
@@ -1,4 +1,7 @@
 #pragma once
+#include <cstddef>
+#include <expected>
+#include <memory>
 #include <optional>
 #include <string_view>
 #include <vector>
@@ -15,6 +18,8 @@ namespace cchell::lexer
         quote,
         pipe,
         dollar,
+        separator, /* ;, ;; and newlines */
+        logical,   /* && and || */
         none
     };
 
@@ -58,8 +63,92 @@ namespace cchell::lexer
     };
 
 
+    /* a single change to the lexed buffer, in byte offsets */
+    struct edit
+    {
+        std::size_t offset { 0 };
+        std::size_t removed { 0 };
+        std::size_t inserted { 0 };
+    };
+
+
+    /**
+     * lexes @param string, checking bracket and quote balance
+     * in the same pass.
+     */
     [[nodiscard]]
-    auto lex(std::string_view string) -> std::vector<token>;
+    auto lex(std::string_view string)
+        -> std::expected<std::vector<token>, diagnostics::diagnostic>;
+
+
+    /**
+     * lexes a source a line at a time, resuming where the last line
+     * ended. a line only ends outside of any bracket or quote, so the
+     * statements on it are complete unless a keyword, like if, holds
+     * them open.
+     */
+    class line_lexer
+    {
+    public:
+        explicit line_lexer(std::string_view source);
+
+        /* resumes at @param offset of @param source, where a token starts
+           that is at @param location */
+        line_lexer(std::string_view source,
+                   std::size_t      offset,
+                   source_location  location);
+
+        line_lexer(line_lexer &&) noexcept;
+        auto operator=(line_lexer &&) noexcept -> line_lexer &;
+        ~line_lexer();
+
+
+        /**
+         * appends the tokens of the next line to @param tokens, checking
+         * their balance. returns false once there is nothing left.
+         */
+        [[nodiscard]]
+        auto next(std::vector<token> &tokens)
+            -> std::expected<bool, diagnostics::diagnostic>;
+
+
+        /**
+         * appends the tokens up to the next place lexing can resume at to
+         * @param tokens, without checking anything. returns false once
+         * there is nothing left, or a quote is never closed.
+         */
+        auto step(std::vector<token> &tokens) -> bool;
+
+
+        /* whether the whole source was lexed */
+        [[nodiscard]]
+        auto done() const noexcept -> bool;
+
+        /* where the next token starts, blanks skipped */
+        [[nodiscard]] auto offset() const noexcept -> std::size_t;
+        [[nodiscard]] auto location() const noexcept -> source_location;
+
+    private:
+        struct state;
+
+        std::string_view       m_source;
+        std::unique_ptr<state> m_state;
+    };
+
+
+    /**
+     * updates @param tokens, lexed from @param previous, to match
+     * @param string after @param change was applied to it.
+     *
+     * only the region around the edit is lexed again, from the nearest
+     * token boundary before it up until the new tokens line up with the
+     * old ones; @param previous is only used to recover token offsets and
+     * is never read.
+     */
+    void relex(std::string_view    string,
+               std::vector<token> &tokens,
+               const char         *previous,
+               edit                change);
 
 
     namespace impl
@@ -75,5 +164,7 @@ namespace cchell::lexer
     }
 
 
+    /* checks the balance of tokens lexed unchecked, as relex leaves
+       them, with the very check lex runs while lexing */
     inline constexpr impl::verifier verify;
 }
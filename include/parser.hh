@@ -1,7 +1,10 @@
 #pragma once
 #include <cstdint>
-#include <list>
-#include <memory>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -9,6 +12,7 @@
 #include "lexer.hh"
 
 namespace cchell::lexer { class token; }
+namespace cchell::interpreter { class environment; }
 
 
 namespace cchell::parser
@@ -22,15 +26,38 @@ namespace cchell::parser
         assignment,
         identifier,
         literal,
+        simple_command,
+        pipeline,
+        and_if,
+        or_if,
+        group,        /* { list; } */
+        subshell,     /* ( list ) */
+        list,         /* the condition or body of a compound command */
+        if_clause,    /* ( list list )+ list?, the last one being the else */
+        while_clause, /* list list */
+        until_clause, /* list list */
+        for_clause,   /* literal* list, with the variable as its data */
+        case_clause,  /* case_item*, with the subject as its data */
+        case_item,    /* literal+ list */
+        function_def, /* the body, with the name as its data */
         none,
     };
 
 
+    using node_index = std::uint32_t;
+
+    inline constexpr node_index null_node {
+        std::numeric_limits<node_index>::max()
+    };
+
+
     struct ast_node
     {
-        ast_type            type;
-        ast_node           *parent;
-        std::list<ast_node> child;
+        ast_type   type { ast_type::none };
+        node_index parent { null_node };
+        node_index first_child { null_node };
+        node_index last_child { null_node };
+        node_index next_sibling { null_node };
 
         std::string_view data;
         source_location  source;
@@ -38,34 +65,253 @@ namespace cchell::parser
 
         auto set_type(ast_type type) noexcept -> ast_node &;
         auto set_source(source_location source) noexcept -> ast_node &;
-        auto set_parent(ast_node *parent) noexcept -> ast_node &;
         auto set_data(std::string_view data) noexcept -> ast_node &;
     };
 
 
+    /**
+     * a statement's nodes, stored contiguously and linked by index.
+     *
+     * clearing the tree keeps its storage around, so a tree reused
+     * across statements stops allocating once it has grown enough.
+     */
+    class ast
+    {
+    public:
+        class child_iterator
+        {
+        public:
+            using value_type      = node_index;
+            using difference_type = std::ptrdiff_t;
+
+
+            child_iterator() = default;
+            child_iterator(const ast *tree, node_index index)
+                : m_tree { tree }, m_index { index }
+            {
+            }
+
+
+            auto
+            operator*() const -> node_index
+            {
+                return m_index;
+            }
+
+
+            auto
+            operator++() -> child_iterator &
+            {
+                m_index = (*m_tree)[m_index].next_sibling;
+                return *this;
+            }
+
+
+            auto
+            operator++(int) -> child_iterator
+            {
+                auto copy { *this };
+                ++*this;
+                return copy;
+            }
+
+
+            auto
+            operator==(const child_iterator &other) const -> bool
+            {
+                return m_index == other.m_index;
+            }
+
+        private:
+            const ast *m_tree { nullptr };
+            node_index m_index { null_node };
+        };
+
+
+        struct child_range
+        {
+            child_iterator first;
+            child_iterator last;
+
+            [[nodiscard]] auto
+            begin() const -> child_iterator
+            {
+                return first;
+            }
+
+            [[nodiscard]] auto
+            end() const -> child_iterator
+            {
+                return last;
+            }
+        };
+
+
+        /* appends @param node as the last child of @param parent */
+        auto add(ast_node node, node_index parent = null_node) -> node_index;
+
+        /**
+         * puts @param node in the place of @param index, which becomes
+         * the new node's only child. returns the new node's index,
+         * which is always @param index.
+         */
+        auto wrap(node_index index, ast_node node) -> node_index;
+
+        /* copies @param data into storage owned by the tree */
+        auto intern(std::string_view data) -> std::string_view;
+
+        void clear() noexcept;
+        void reserve(std::size_t size);
+
+
+        [[nodiscard]] auto root() const noexcept -> node_index;
+        [[nodiscard]] auto size() const noexcept -> std::size_t;
+        [[nodiscard]] auto empty() const noexcept -> bool;
+
+        [[nodiscard]] auto children(node_index index) const -> child_range;
+
+
+        [[nodiscard]]
+        auto
+        operator[](node_index index) noexcept -> ast_node &
+        {
+            return m_nodes[index];
+        }
+
+
+        [[nodiscard]]
+        auto
+        operator[](node_index index) const noexcept -> const ast_node &
+        {
+            return m_nodes[index];
+        }
+
+    private:
+        std::vector<ast_node>   m_nodes;
+        std::deque<std::string> m_strings;
+    };
+
+
+    /* parses @param tokens into @param tree, replacing its content */
     [[nodiscard]]
-    auto parse(const std::vector<lexer::token> &tokens)
-        -> std::unique_ptr<ast_node>;
+    auto parse(const std::vector<lexer::token> &tokens, ast &tree)
+        -> std::optional<diagnostics::diagnostic>;
+
+    /**
+     * parses the line of @param tokens starting at @param index into
+     * @param tree, every statement up to the newline ending it. @param index
+     * is moved past that newline, to the end once no statement is left.
+     */
+    [[nodiscard]]
+    auto parse_line(std::span<const lexer::token> tokens,
+                    std::size_t                  &index,
+                    ast                          &tree)
+        -> std::optional<diagnostics::diagnostic>;
 
 
     namespace impl
     {
-        auto assignment(const lexer::token &token, ast_node &parent) -> bool;
-        auto command(const lexer::token &token, ast_node &parent) -> bool;
-        auto option(const lexer::token &token, ast_node &parent) -> bool;
-        auto string(const lexer::token &token, ast_node &parent) -> bool;
+        /**
+         * everything a single parse works on. nothing outside of it is
+         * touched, so any number of parses can run at the same time.
+         */
+        struct context
+        {
+            std::span<const lexer::token> tokens;
+            std::size_t                   index { 0 };
+            ast                          &tree;
+
+
+            [[nodiscard]] auto done() const -> bool;
+            [[nodiscard]] auto peek() const -> const lexer::token &;
+
+            [[nodiscard]]
+            auto at(lexer::token_type type, std::string_view data = {}) const
+                -> bool;
+
+            /**
+             * a token with nothing attached to it, like a group's braces
+             * or a reserved word.
+             */
+            [[nodiscard]] auto at_lone(std::string_view data) const -> bool;
+
+            /* skips ; and newlines, but never the ;; ending a case item */
+            void skip_separators();
+            void skip_newlines();
+        };
+
+
+        /**
+         * joins the adjacent tokens at the context's position into a
+         * single word token, moving the context past them.
+         */
+        auto word(context &ctx) -> lexer::token;
+
+        /* whether @param token separates words and commands */
+        auto is_operator(const lexer::token &token) -> bool;
+
+
+        /* the functions below take whole words, see impl::word */
+        auto assignment(context            &ctx,
+                        const lexer::token &word,
+                        node_index          parent) -> bool;
+        void command(context &ctx, const lexer::token &word, node_index parent);
+        void option(context &ctx, const lexer::token &word, node_index parent);
 
         using namespace diagnostics;
 
-        struct verifier : diagnostics::verifier<ast_node &>
+        struct verifier : diagnostics::verifier<ast &>
         {
+            /* whether a typo can be corrected by asking the user */
+            bool interactive;
+
+            /* the functions defined there count as commands too */
+            const interpreter::environment *env;
+
+
+            constexpr explicit verifier(
+                bool                            interactive = true,
+                const interpreter::environment *env         = nullptr)
+                : interactive(interactive), env(env)
+            {
+            }
+
+
             [[nodiscard]]
-            auto operator()(ast_node &nodes) const
+            auto operator()(ast &tree) const
                 -> std::optional<diagnostic> override;
         };
 
-        auto verify_command(ast_node &node) -> std::optional<diagnostic>;
+        /**
+         * checks all of @param commands in one go, then offers the
+         * corrections for every typo together. returns the first problem
+         * left, in the order the commands would run.
+         */
+        auto verify_commands(ast                        &tree,
+                             std::span<const node_index> commands,
+                             bool interactive) -> std::optional<diagnostic>;
     }
 
     inline constexpr impl::verifier verify;
+
+    /* verifies without ever prompting, usable from any thread */
+    inline constexpr impl::verifier check { false };
+
+
+    /* verify, knowing about the functions defined in @param env */
+    [[nodiscard]]
+    constexpr auto
+    verify_in(const interpreter::environment &env) -> impl::verifier
+    {
+        return impl::verifier { true, &env };
+    }
+
+
+    /* check, knowing about the functions defined in @param env */
+    [[nodiscard]]
+    constexpr auto
+    check_in(const interpreter::environment &env) -> impl::verifier
+    {
+        return impl::verifier { false, &env };
+    }
 }
@@ -1,52 +1,78 @@
 #pragma once
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
 
 
 namespace cchell::shared
 {
-    namespace impl
+    /* transparent hashing, so maps keyed by std::string can be searched
+       with a std::string_view */
+    struct string_hash
     {
-        class executables
+        using is_transparent = void;
+
+        auto
+        operator()(std::string_view sv) const noexcept -> std::size_t
         {
-            struct string_hash
-            {
-                using is_transparent = void;
-
-                auto
-                operator()(std::string_view sv) const noexcept -> std::size_t
-                {
-                    return std::hash<std::string_view> {}(sv);
-                }
-
-                auto
-                operator()(const std::string &s) const noexcept -> std::size_t
-                {
-                    return std::hash<std::string_view> {}(s);
-                }
-            };
+            return std::hash<std::string_view> {}(sv);
+        }
 
-            struct string_equal
-            {
-                using is_transparent = void;
-
-                auto
-                operator()(std::string_view a,
-                           std::string_view b) const noexcept -> bool
-                {
-                    return a == b;
-                }
-            };
+        auto
+        operator()(const std::string &s) const noexcept -> std::size_t
+        {
+            return std::hash<std::string_view> {}(s);
+        }
+    };
+
+    struct string_equal
+    {
+        using is_transparent = void;
+
+        auto
+        operator()(std::string_view a, std::string_view b) const noexcept
+            -> bool
+        {
+            return a == b;
+        }
+    };
 
+
+    namespace impl
+    {
+        class executables
+        {
         public:
             executables();
 
 
+            /* indexes the programs in @param PATH, dropping the old ones */
+            void load(std::string_view PATH);
+
+
             [[nodiscard]]
             auto exists(std::string_view name) const -> bool;
 
 
+            [[nodiscard]]
+            auto find(std::string_view name) const
+                -> const std::filesystem::path *;
+
+
             [[nodiscard]]
             auto closest(std::string_view name,
                          std::size_t      max_distance = 2) const
@@ -84,15 +110,232 @@ namespace cchell::shared
         private:
             std::uint8_t m_ttys;
         };
+
+
+        /**
+         * a fixed set of threads taking tasks off one queue, tasks may
+         * submit more of them. a forked child doesn't inherit the threads,
+         * so there every task runs right away on the submitting thread.
+         */
+        class thread_pool
+        {
+        public:
+            /* the task gets the index of the worker running it */
+            using task = std::function<void(std::size_t worker)>;
+
+
+            explicit thread_pool(std::size_t threads);
+
+
+            /* how many workers there are, so tasks can keep one buffer each */
+            [[nodiscard]]
+            auto size() const -> std::size_t;
+
+
+            void submit(task job);
+
+            /* blocks until every task, including the ones tasks submitted,
+               has run */
+            void wait();
+
+        private:
+            std::mutex                  m_mutex;
+            std::condition_variable_any m_ready;
+            std::condition_variable     m_idle;
+
+            std::deque<task> m_tasks;
+            std::size_t      m_busy { 0 };
+            std::size_t      m_count;
+            pid_t            m_owner;
+
+            /* last, the threads have to stop before anything else goes */
+            std::vector<std::jthread> m_threads;
+
+
+            void mf_work(const std::stop_token &stop, std::size_t index);
+        };
     }
 
 
+    /**
+     * a stack that keeps its first @tparam N elements inline,
+     * only touching the heap once it grows deeper than that.
+     */
+    template <typename T, std::size_t N> class inline_stack
+    {
+    public:
+        void
+        push(const T &value)
+        {
+            if (m_size < N)
+                m_inline[m_size] = value;
+            else
+                m_spill.emplace_back(value);
+
+            m_size++;
+        }
+
+
+        void
+        pop() noexcept
+        {
+            if (m_size > N) m_spill.pop_back();
+            m_size--;
+        }
+
+
+        [[nodiscard]]
+        auto
+        top() const noexcept -> const T &
+        {
+            return m_size > N ? m_spill.back() : m_inline[m_size - 1];
+        }
+
+
+        [[nodiscard]]
+        auto
+        empty() const noexcept -> bool
+        {
+            return m_size == 0;
+        }
+
+
+        [[nodiscard]]
+        auto
+        size() const noexcept -> std::size_t
+        {
+            return m_size;
+        }
+
+
+        void
+        clear() noexcept
+        {
+            m_spill.clear();
+            m_size = 0;
+        }
+
+    private:
+        std::array<T, N> m_inline {};
+        std::vector<T>   m_spill;
+        std::size_t      m_size { 0 };
+    };
+
+
+    /**
+     * a queue between threads holding at most @param capacity elements,
+     * so a producer running ahead blocks rather than growing it. once
+     * closed, both ends stop waiting and pushing fails.
+     */
+    template <typename T> class bounded_queue
+    {
+    public:
+        explicit bounded_queue(std::size_t capacity) : m_capacity(capacity)
+        {
+        }
+
+
+        auto
+        push(T value) -> bool
+        {
+            std::unique_lock lock { m_mutex };
+            m_not_full.wait(lock, [this]
+                            { return m_closed || m_items.size() < m_capacity; });
+
+            if (m_closed) return false;
+
+            m_items.emplace_back(std::move(value));
+            m_not_empty.notify_one();
+            return true;
+        }
+
+
+        /* std::nullopt once the queue is closed and drained */
+        auto
+        pop() -> std::optional<T>
+        {
+            std::unique_lock lock { m_mutex };
+            m_not_empty.wait(lock,
+                             [this] { return m_closed || !m_items.empty(); });
+
+            if (m_items.empty()) return std::nullopt;
+
+            return mf_take();
+        }
+
+
+        /* std::nullopt right away when the queue is empty */
+        auto
+        try_pop() -> std::optional<T>
+        {
+            std::scoped_lock lock { m_mutex };
+
+            if (m_items.empty()) return std::nullopt;
+            return mf_take();
+        }
+
+
+        void
+        close()
+        {
+            std::scoped_lock lock { m_mutex };
+            m_closed = true;
+            m_not_full.notify_all();
+            m_not_empty.notify_all();
+        }
+
+    private:
+        std::mutex              m_mutex;
+        std::condition_variable m_not_full;
+        std::condition_variable m_not_empty;
+
+        std::deque<T> m_items;
+        std::size_t   m_capacity;
+        bool          m_closed { false };
+
+
+        /* a blocked producer is only woken once half the queue is free,
+           rather than trading places with the consumer on every element */
+        auto
+        mf_take() -> T
+        {
+            T value { std::move(m_items.front()) };
+            m_items.pop_front();
+
+            if (m_items.size() <= m_capacity / 2) m_not_full.notify_one();
+            return value;
+        }
+    };
+
+
     [[nodiscard]]
     auto damerau_levenshtein_osa(std::string_view a, std::string_view b)
         -> std::size_t;
 
+    /**
+     * the same distance, but giving up with @param cutoff + 1 as soon as
+     * it can only be larger than @param cutoff. it doesn't allocate once
+     * its thread has seen a string as long.
+     */
+    [[nodiscard]]
+    auto damerau_levenshtein_osa(std::string_view a,
+                                 std::string_view b,
+                                 std::size_t      cutoff) -> std::size_t;
+
+
+    /**
+     * a fast 64-bit hash of @param data. unlike std::hash it comes out the
+     * same in every build and every run, so it can name what is stored.
+     */
+    [[nodiscard]]
+    auto stable_hash(std::string_view data, std::uint64_t seed = 0)
+        -> std::uint64_t;
+
+
+    inline impl::tty_status  tty_status;
+    inline impl::executables executables;
+
 
-    inline impl::tty_status                                       tty_status;
-    inline impl::executables                                      executables;
-    inline std::unordered_map<std::string_view, std::string_view> envp;
+    /* started on first use, with a thread for every core */
+    auto workers() -> impl::thread_pool &;
 }
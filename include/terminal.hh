@@ -1,8 +1,18 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <format>
+#include <iterator>
 #include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <utility>
 
+#include <unistd.h>
+
 
 namespace cchell::terminal
 {
@@ -42,7 +52,11 @@ namespace cchell::terminal
         f9,
         f10,
         f11,
-        f12
+        f12,
+
+        /* bracketed paste, what comes in between is the paste itself */
+        paste_begin,
+        paste_end,
     };
 
 
@@ -55,9 +69,9 @@ namespace cchell::terminal
 
 
         key_event(key  code,
+                  bool shift = false,
                   bool alt   = false,
-                  bool ctrl  = false,
-                  bool shift = false)
+                  bool ctrl  = false)
             : code { code }, shift { shift }, alt { alt }, ctrl { ctrl }
         {
         }
@@ -72,6 +86,179 @@ namespace cchell::terminal
     };
 
 
-    [[nodiscard]]
-    auto decode(char ch) noexcept -> std::pair<decode_status, std::optional<key_event>>;
+    /* what decoding the front of a span of input found */
+    struct decoded
+    {
+        decode_status            status;
+        std::optional<key_event> event;
+        std::size_t              size; /* how many bytes it took */
+
+        /* for status none, the text, which only a paste can make differ
+           from the bytes taken. empty for an escape sequence that isn't
+           a key, which is dropped */
+        std::string_view text {};
+        bool             pasted { false };
+    };
+
+
+    /**
+     * turns raw input bytes into key events, one byte at a time.
+     *
+     * escape sequences can span several calls, which is why the
+     * partial sequence is kept in the decoder.
+     */
+    class decoder
+    {
+    public:
+        [[nodiscard]]
+        auto decode(char ch) noexcept
+            -> std::pair<decode_status, std::optional<key_event>>;
+
+        /**
+         * decodes the front of @param bytes: either a whole key event, a
+         * sequence the span ended in the middle of, or a run of bytes that
+         * are plain text, status none. a control byte that isn't a key is
+         * a run of its own, an escape sequence that isn't one has no text.
+         *
+         * between paste_begin and paste_end, everything is pasted text,
+         * newlines and escapes included.
+         */
+        [[nodiscard]]
+        auto decode(std::span<const char> bytes) noexcept -> decoded;
+
+        void reset() noexcept;
+
+    private:
+        struct csi_state
+        {
+            bool active { false };
+            int  p1 { 0 };
+            int  p2 { 0 };
+            bool semi { false };
+        } m_csi;
+
+        bool m_esc_seen { false };
+
+        bool        m_pasting { false };
+        std::size_t m_paste_matched { 0 }; /* of the closing marker */
+
+
+        auto mf_decode_csi_char(char ch) noexcept
+            -> std::pair<decode_status, std::optional<key_event>>;
+
+        auto mf_decode_paste(std::span<const char> bytes) noexcept
+            -> decoded;
+    };
+
+
+    /**
+     * input read ahead of its use into a ring, every read taking all
+     * that is there, both free parts of the ring at once, rather than a
+     * byte at a time.
+     */
+    class input_buffer
+    {
+    public:
+        /**
+         * blocks until @param fd has input, then reads as much of it as
+         * fits.
+         *
+         * return:
+         *    - 0     on success
+         *    - errno on error
+         *    - EOF   on EOF
+         */
+        auto fill(int fd) noexcept -> int;
+
+
+        /* the unconsumed bytes up to where the ring wraps around */
+        [[nodiscard]]
+        auto peek() const noexcept -> std::span<const char>;
+
+        void consume(std::size_t size) noexcept;
+
+
+        [[nodiscard]]
+        auto
+        empty() const noexcept -> bool
+        {
+            return m_size == 0;
+        }
+
+    private:
+        std::array<char, 16 * 1024> m_ring;
+        std::size_t                 m_head { 0 };
+        std::size_t                 m_size { 0 };
+    };
+
+
+    /* set when the terminal changed size, a read it interrupted being
+       for the reader to start again */
+    inline std::atomic_bool resized { false };
+
+
+    /* everything that reads the terminal shares it, so none of them loses
+       what another one read ahead */
+    inline input_buffer stdin_buffer;
+
+
+    /**
+     * the columns a terminal gives @param code_point: 2 for the wide East
+     * Asian ones and emoji, 0 for the combining marks, joiners and
+     * variation selectors that go with the character before them.
+     */
+    [[nodiscard]] auto cell_width(char32_t code_point) noexcept -> int;
+
+    /* the width of the terminal on @param fd, 80 when it can't be told */
+    [[nodiscard]] auto columns(int fd) noexcept -> std::size_t;
+
+    /* the height of the terminal on @param fd, 24 when it can't be told */
+    [[nodiscard]] auto rows(int fd) noexcept -> std::size_t;
+
+
+    /**
+     * one update of the screen, built up in a buffer that is kept from one
+     * frame to the next, then written out with a single write. when it is
+     * synchronized, the terminal is told to show all of it at once, so
+     * nothing half drawn flickers by.
+     */
+    class frame
+    {
+    public:
+        frame(int fd, bool synchronized);
+
+
+        template <typename... T_Args>
+        auto
+        print(std::format_string<T_Args...> fmt, T_Args &&...args) -> frame &
+        {
+            std::format_to(std::back_inserter(m_buffer), fmt,
+                           std::forward<T_Args>(args)...);
+            return *this;
+        }
+
+
+        auto
+        write(std::string_view text) -> frame &
+        {
+            m_buffer += text;
+            return *this;
+        }
+
+
+        [[nodiscard]]
+        auto empty() const noexcept -> bool;
+
+        /* writes what the frame has, if anything, and starts the next */
+        void flush() noexcept;
+
+    private:
+        int         m_fd;
+        std::string m_begin; /* what every frame starts with */
+        std::string m_buffer;
+    };
+
+
+    /* what the shell draws on stderr, prompts and echo included */
+    inline frame screen { STDERR_FILENO, isatty(STDERR_FILENO) == 1 };
 }
@@ -125,6 +125,14 @@ diagnostic_builder::length(std::size_t length) -> diagnostic_builder &&
 }
 
 
+auto
+diagnostic_builder::incomplete() -> diagnostic_builder &&
+{
+    m_diag.incomplete = true;
+    return std::move(*this);
+}
+
+
 [[nodiscard]]
 auto
 diagnostic_builder::build() && -> diagnostic
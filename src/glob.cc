@@ -0,0 +1,719 @@
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "glob.hh"
+#include "shared.hh"
+
+using namespace cchell::glob;
+using namespace cchell;
+
+
+namespace
+{
+    /* big enough that a directory of thousands of entries is one syscall */
+    constexpr std::size_t BATCH_SIZE { 1UZ << 16 };
+
+    /* past this many, the session's compiled patterns are thrown away */
+    constexpr std::size_t MAX_CACHED { 256 };
+
+
+    /**
+     * calls @param visit with the name and d_type of every entry in the
+     * directory @param fd, but . and .., reading them in large batches.
+     * the name is only valid during the call, and visiting mustn't list
+     * another directory on the same thread.
+     */
+    template <typename T_Visit>
+    void
+    for_each_entry(int fd, T_Visit &&visit)
+    {
+        thread_local std::vector<char> buffer(BATCH_SIZE);
+
+        for (;;)
+        {
+            long read { syscall(SYS_getdents64, fd, buffer.data(),
+                                buffer.size()) };
+            if (read <= 0) break;
+
+            for (long offset { 0 }; offset < read;)
+            {
+                /* glibc's dirent64 has the layout getdents64 fills in */
+                const auto *entry { reinterpret_cast<const dirent64 *>(
+                    buffer.data() + offset) };
+                offset += entry->d_reclen;
+
+                std::string_view name { entry->d_name };
+                if (name == "." || name == "..") continue;
+
+                visit(entry->d_name, name, entry->d_type);
+            }
+        }
+    }
+
+
+    auto
+    open_directory(const std::string &path) -> int
+    {
+        return open(path.empty() ? "." : path.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+
+    /* only stats when d_type doesn't tell, symlinks followed if @param
+       follow */
+    auto
+    is_directory(int parent, const char *name, unsigned char type, bool follow)
+        -> bool
+    {
+        if (type == DT_DIR) return true;
+        if (type != DT_UNKNOWN && (type != DT_LNK || !follow)) return false;
+
+        struct stat st {};
+        return fstatat(parent, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW)
+                   == 0
+               && S_ISDIR(st.st_mode);
+    }
+
+
+    auto
+    join(std::string_view path, std::string_view name) -> std::string
+    {
+        std::string joined;
+        joined.reserve(path.length() + name.length() + 1);
+
+        joined += path;
+        if (!path.empty() && path.back() != '/') joined += '/';
+        joined += name;
+
+        return joined;
+    }
+
+
+    /* fills @param set from the [...] at the start of @param rest, returning
+       how much of it that took. a / is left out of it for a @param path */
+    auto
+    parse_set(std::string_view rest, std::bitset<256> &set, bool path)
+        -> std::optional<std::size_t>
+    {
+        struct named_class
+        {
+            std::string_view name;
+            int (*test)(int);
+        };
+
+        constexpr std::array CLASSES {
+            named_class { "alnum", std::isalnum },
+            named_class { "alpha", std::isalpha },
+            named_class { "blank", std::isblank },
+            named_class { "digit", std::isdigit },
+            named_class { "lower", std::islower },
+            named_class { "punct", std::ispunct },
+            named_class { "space", std::isspace },
+            named_class { "upper", std::isupper },
+            named_class { "xdigit", std::isxdigit },
+        };
+
+        std::size_t i { 1 };
+        bool        negate { i < rest.length()
+                      && (rest[i] == '!' || rest[i] == '^') };
+        if (negate) i++;
+
+        for (bool first { true }; i < rest.length(); first = false)
+        {
+            auto c { static_cast<unsigned char>(rest[i]) };
+
+            if (c == ']' && !first)
+            {
+                if (negate) set.flip();
+                if (path) set.reset('/');
+                return i + 1;
+            }
+
+            if (rest.substr(i).starts_with("[:"))
+            {
+                std::size_t end { rest.find(":]", i + 2) };
+                if (end == std::string_view::npos) return std::nullopt;
+
+                std::string_view name { rest.substr(i + 2, end - i - 2) };
+                const auto *it { std::ranges::find(CLASSES, name,
+                                                   &named_class::name) };
+                if (it == CLASSES.end()) return std::nullopt;
+
+                for (int ch { 0 }; ch < 256; ch++)
+                    if (it->test(ch) != 0) set.set(ch);
+
+                i = end + 2;
+                continue;
+            }
+
+            if (c == '\\' && i + 1 < rest.length())
+                c = static_cast<unsigned char>(rest[++i]);
+            i++;
+
+            if (i + 1 < rest.length() && rest[i] == '-' && rest[i + 1] != ']')
+            {
+                auto last { static_cast<unsigned char>(rest[i + 1]) };
+                for (unsigned ch { c }; ch <= last; ch++) set.set(ch);
+                i += 2;
+            }
+            else
+                set.set(c);
+        }
+
+        return std::nullopt;
+    }
+
+
+    /**
+     * walks the components from some index on, one directory at a time.
+     * only the first ** walk of a top-level walker is spread over the
+     * workers, the ones below it run on whichever worker got there.
+     */
+    class walker
+    {
+    public:
+        struct component
+        {
+            const matcher *match;
+            bool           recursive;
+        };
+
+
+        walker(std::span<const component>  components,
+               bool                        directories,
+               std::vector<std::string>   &out,
+               bool                        parallel)
+            : m_components(components), m_directories(directories),
+              m_out(out), m_parallel(parallel)
+        {
+        }
+
+
+        void
+        walk(const std::string &path, std::size_t index)
+        {
+            const auto &[match, recursive] { m_components[index] };
+            bool last { index + 1 == m_components.size() };
+
+            if (recursive && last) return mf_everything(path);
+            if (recursive)
+                return m_parallel ? mf_fan_out(path, index)
+                                  : mf_recurse(path, index);
+
+            /* nothing to list, the name is already known */
+            if (match->is_literal())
+            {
+                std::string next { join(path, match->prefix()) };
+
+                if (!last) return walk(next, index + 1);
+
+                struct stat st {};
+                bool        found { m_directories
+                                 ? stat(next.c_str(), &st) == 0
+                                       && S_ISDIR(st.st_mode)
+                                 : lstat(next.c_str(), &st) == 0 };
+
+                if (found) mf_emit(std::move(next));
+                return;
+            }
+
+            int fd { open_directory(path) };
+            if (fd < 0) return;
+
+            std::vector<std::string> matched;
+            for_each_entry(fd,
+                           [&](const char *entry, std::string_view name,
+                               unsigned char type)
+                           {
+                               if (!match->matches(name)) return;
+                               if ((last && !m_directories)
+                                   || is_directory(fd, entry, type, true))
+                                   matched.emplace_back(name);
+                           });
+            close(fd);
+
+            for (const std::string &name : matched)
+                if (last)
+                    mf_emit(join(path, name));
+                else
+                    walk(join(path, name), index + 1);
+        }
+
+    private:
+        std::span<const component> m_components;
+        bool                       m_directories;
+        std::vector<std::string>  &m_out;
+        bool                       m_parallel;
+
+
+        void
+        mf_emit(std::string path)
+        {
+            if (m_directories) path += '/';
+            m_out.emplace_back(std::move(path));
+        }
+
+
+        /* the directories ** goes into, which leaves hidden ones and
+           symlinks alone */
+        static auto
+        mf_subdirectories(int fd, const std::string &path)
+            -> std::vector<std::string>
+        {
+            std::vector<std::string> found;
+
+            for_each_entry(fd,
+                           [&](const char *entry, std::string_view name,
+                               unsigned char type)
+                           {
+                               if (!name.starts_with('.')
+                                   && is_directory(fd, entry, type, false))
+                                   found.emplace_back(join(path, name));
+                           });
+
+            return found;
+        }
+
+
+        /* a trailing ** is the directory itself and everything below it,
+           hidden files aside, as bash has it */
+        void
+        mf_everything(const std::string &path)
+        {
+            if (!path.empty()) m_out.emplace_back(join(path, ""));
+            mf_below(path);
+        }
+
+
+        void
+        mf_below(const std::string &path)
+        {
+            int fd { open_directory(path) };
+            if (fd < 0) return;
+
+            std::vector<std::string> below;
+
+            for_each_entry(fd,
+                           [&](const char *entry, std::string_view name,
+                               unsigned char type)
+                           {
+                               if (name.starts_with('.')) return;
+
+                               if (is_directory(fd, entry, type, false))
+                                   below.emplace_back(join(path, name));
+                               else if (!m_directories)
+                                   mf_emit(join(path, name));
+                           });
+            close(fd);
+
+            for (const std::string &directory : below)
+            {
+                mf_emit(directory);
+                mf_below(directory);
+            }
+        }
+
+
+        /* ** matches no directory, or any number of them */
+        void
+        mf_recurse(const std::string &path, std::size_t index)
+        {
+            walk(path, index + 1);
+
+            int fd { open_directory(path) };
+            if (fd < 0) return;
+
+            auto below { mf_subdirectories(fd, path) };
+            close(fd);
+
+            for (const std::string &directory : below)
+                mf_recurse(directory, index);
+        }
+
+
+        /* what the tasks of one fanned out ** walk share */
+        struct fan_out
+        {
+            shared::impl::thread_pool             &pool;
+            std::size_t                            index;
+            std::vector<std::vector<std::string>>  found; /* one per worker */
+            bool                                   single;
+        };
+
+
+        /**
+         * the same, with every directory listed as a task of its own. when
+         * all that follows is one pattern, like a name ending in .log after
+         * the **, each listing matches it along the way instead of reading
+         * the directory twice.
+         */
+        void
+        mf_fan_out(const std::string &path, std::size_t index)
+        {
+            auto &pool { shared::workers() };
+            auto  rest { m_components.subspan(index + 1) };
+
+            fan_out shared { pool, index,
+                             std::vector<std::vector<std::string>>(
+                                 pool.size()),
+                             rest.size() == 1 && !rest.front().recursive
+                                 && !rest.front().match->is_literal() };
+
+            pool.submit([this, &shared, path](std::size_t worker)
+                        { mf_visit(shared, path, worker); });
+            pool.wait();
+
+            for (auto &paths : shared.found)
+                std::ranges::move(paths, std::back_inserter(m_out));
+        }
+
+
+        void
+        mf_visit(fan_out &shared, const std::string &directory,
+                 std::size_t worker)
+        {
+            int fd { open_directory(directory) };
+            if (fd < 0) return;
+
+            const matcher            *next { m_components[shared.index + 1]
+                                                 .match };
+            std::vector<std::string> &out { shared.found[worker] };
+            std::vector<std::string>  below;
+
+            for_each_entry(fd,
+                           [&](const char *entry, std::string_view name,
+                               unsigned char type)
+                           {
+                               bool dir { is_directory(fd, entry, type,
+                                                       false) };
+
+                               if (dir && !name.starts_with('.'))
+                                   below.emplace_back(join(directory, name));
+
+                               if (!shared.single || !next->matches(name))
+                                   return;
+
+                               if (!m_directories)
+                                   out.emplace_back(join(directory, name));
+                               else if (dir
+                                        || is_directory(fd, entry, type, true))
+                                   out.emplace_back(join(directory, name)
+                                                    + '/');
+                           });
+            close(fd);
+
+            if (!shared.single)
+                walker { m_components, m_directories, out, false }.walk(
+                    directory, shared.index + 1);
+
+            for (std::string &path : below)
+                shared.pool.submit(
+                    [this, &shared, path { std::move(path) }](
+                        std::size_t id) { mf_visit(shared, path, id); });
+        }
+    };
+}
+
+
+matcher::matcher(std::string_view pattern, bool path)
+    : m_dotted { !path || pattern.starts_with('.')
+                 || pattern.starts_with("\\.") }
+{
+    bool wild { false }; /* past the literal prefix */
+
+    auto add_literal { [&](char c)
+                       {
+                           if (!wild)
+                           {
+                               m_prefix += c;
+                               return;
+                           }
+
+                           if (m_elements.empty()
+                               || m_elements.back().type
+                                      != element::kind::literal)
+                               m_elements.emplace_back(
+                                   element::kind::literal,
+                                   static_cast<std::uint32_t>(m_text.length()));
+
+                           m_text += c;
+                           m_elements.back().length++;
+                       } };
+
+    for (std::size_t i { 0 }; i < pattern.length(); i++)
+    {
+        char c { pattern[i] };
+
+        if (c == '\\' && i + 1 < pattern.length())
+        {
+            add_literal(pattern[++i]);
+            continue;
+        }
+
+        if (c == '[')
+        {
+            std::bitset<256> set;
+            if (auto length { parse_set(pattern.substr(i), set, path) })
+            {
+                wild = true;
+                m_elements.emplace_back(
+                    element::kind::set,
+                    static_cast<std::uint32_t>(m_sets.size()));
+                m_sets.emplace_back(set);
+
+                i += *length - 1;
+                continue;
+            }
+        }
+
+        if (c == '*' || c == '?')
+        {
+            wild = true;
+
+            /* ** within a component is the same as * */
+            if (c == '*' && !m_elements.empty()
+                && m_elements.back().type == element::kind::star)
+                continue;
+
+            m_elements.emplace_back(c == '*' ? element::kind::star
+                                             : element::kind::any);
+            continue;
+        }
+
+        add_literal(c);
+    }
+
+    if (!m_elements.empty()
+        && m_elements.back().type == element::kind::literal)
+        m_suffix = m_text.substr(m_elements.back().offset,
+                                 m_elements.back().length);
+
+    m_length = m_prefix.length();
+
+    for (const element &current : m_elements)
+    {
+        if (current.type == element::kind::star)
+            m_starred = true;
+        else
+            m_length += current.type == element::kind::literal
+                            ? current.length
+                            : 1;
+    }
+}
+
+
+auto
+matcher::matches(std::string_view name) const -> bool
+{
+    if (m_elements.empty()) return name == m_prefix;
+
+    if (name.starts_with('.') && !m_dotted) return false;
+    if (!name.starts_with(m_prefix) || !name.ends_with(m_suffix)) return false;
+
+    return mf_match(name.substr(m_prefix.length()));
+}
+
+
+auto
+matcher::longest_match(std::string_view text) const
+    -> std::optional<std::size_t>
+{
+    if (!text.starts_with(m_prefix)) return std::nullopt;
+
+    if (!m_starred)
+    {
+        if (m_length > text.length() || !matches(text.substr(0, m_length)))
+            return std::nullopt;
+        return m_length;
+    }
+
+    for (std::size_t end { text.length() }; end >= m_prefix.length(); end--)
+    {
+        /* a match can only end where the literal tail does */
+        if (!m_suffix.empty())
+        {
+            std::size_t tail { text.substr(0, end).rfind(m_suffix) };
+            if (tail == std::string_view::npos) return std::nullopt;
+            end = tail + m_suffix.length();
+        }
+
+        if (matches(text.substr(0, end))) return end;
+        if (end == 0) break;
+    }
+
+    return std::nullopt;
+}
+
+
+/* backtracks to the last *, so never more than once per position */
+auto
+matcher::mf_match(std::string_view name) const -> bool
+{
+    std::size_t e { 0 };
+    std::size_t n { 0 };
+
+    std::size_t star { m_elements.size() }; /* none yet */
+    std::size_t resume { 0 };
+
+    for (;;)
+    {
+        if (e < m_elements.size())
+        {
+            const element &current { m_elements[e] };
+            bool           ok { false };
+
+            switch (current.type)
+            {
+            case element::kind::literal:
+            {
+                std::string_view text { m_text.data() + current.offset,
+                                        current.length };
+                ok = name.substr(n).starts_with(text);
+                if (ok) n += text.length();
+                break;
+            }
+
+            case element::kind::any: ok = n++ < name.length(); break;
+
+            case element::kind::set:
+                ok = n < name.length()
+                     && m_sets[current.offset].test(
+                         static_cast<unsigned char>(name[n++]));
+                break;
+
+            case element::kind::star:
+                star   = e;
+                resume = n;
+                e++;
+                continue;
+            }
+
+            if (ok)
+            {
+                e++;
+                continue;
+            }
+        }
+        else if (n == name.length())
+            return true;
+
+        if (star == m_elements.size() || resume >= name.length())
+            return false;
+
+        e = star + 1;
+        n = ++resume;
+    }
+}
+
+
+pattern::pattern(std::string_view source)
+    : m_absolute { source.starts_with('/') },
+      m_directories { source.ends_with('/') }
+{
+    std::size_t start { 0 };
+
+    while (start < source.length())
+    {
+        std::size_t end { std::min(source.find('/', start), source.length()) };
+        std::string_view part { source.substr(start, end - start) };
+        start = end + 1;
+
+        if (part.empty()) continue;
+        m_components.emplace_back(matcher { part }, part == "**");
+    }
+}
+
+
+void
+pattern::expand(std::vector<std::string> &out) const
+{
+    if (m_components.empty()) return;
+
+    std::vector<walker::component> components;
+    components.reserve(m_components.size());
+    for (const auto &[match, recursive] : m_components)
+        components.emplace_back(&match, recursive);
+
+    auto first { out.size() };
+
+    walker { components, m_directories, out, true }.walk(
+        m_absolute ? "/" : "", 0);
+
+    std::ranges::sort(out.begin() + static_cast<std::ptrdiff_t>(first),
+                      out.end());
+}
+
+
+auto
+glob::has_magic(std::string_view word) -> bool
+{
+    for (std::size_t i { 0 }; i < word.length(); i++)
+    {
+        switch (word[i])
+        {
+        case '\\': i++; break;
+        case '*':  [[fallthrough]];
+        case '?':  return true;
+
+        /* a lone [ is just that, like the test command */
+        case '[':
+            if (word.find(']', i + 1) != std::string_view::npos) return true;
+            break;
+
+        default: break;
+        }
+    }
+
+    return false;
+}
+
+
+void
+glob::unescape(std::string_view word, std::string &out)
+{
+    for (std::size_t i { 0 }; i < word.length(); i++)
+    {
+        if (word[i] == '\\' && i + 1 < word.length()) i++;
+        out += word[i];
+    }
+}
+
+
+auto
+glob::expand(std::string_view source, std::vector<std::string> &out) -> bool
+{
+    /* only the shell's main thread expands, so this needs no lock */
+    static std::unordered_map<std::string,
+                              pattern,
+                              shared::string_hash,
+                              shared::string_equal>
+        compiled;
+
+    auto it { compiled.find(source) };
+
+    if (it == compiled.end())
+    {
+        if (compiled.size() >= MAX_CACHED) compiled.clear();
+        it = compiled.emplace(source, pattern { source }).first;
+    }
+
+    auto before { out.size() };
+    it->second.expand(out);
+
+    return out.size() > before;
+}
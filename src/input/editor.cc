@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "input.hh"
+#include "lexer.hh"
+
+using cchell::input::gap_buffer;
+using cchell::input::line_editor;
+
+
+namespace
+{
+    /* the bytes after the first of a UTF-8 character */
+    constexpr auto
+    is_continuation(char c) noexcept -> bool
+    {
+        return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    }
+
+
+    constexpr auto
+    is_blank(char c) noexcept -> bool
+    {
+        return c == ' ' || c == '\t' || c == '\n';
+    }
+}
+
+
+void
+gap_buffer::insert(std::string_view text)
+{
+    if (m_gap_end - m_gap_begin < text.size())
+    {
+        const std::size_t tail { m_data.size() - m_gap_end };
+        const std::size_t capacity { std::max(m_data.size() * 2,
+                                              size() + text.size() + 64) };
+
+        m_data.resize(capacity);
+        std::memmove(m_data.data() + capacity - tail,
+                     m_data.data() + m_gap_end, tail);
+        m_gap_end = capacity - tail;
+    }
+
+    std::memcpy(m_data.data() + m_gap_begin, text.data(), text.size());
+    m_gap_begin += text.size();
+}
+
+
+void
+gap_buffer::erase_before(std::size_t count) noexcept
+{
+    m_gap_begin -= std::min(count, m_gap_begin);
+}
+
+
+void
+gap_buffer::erase_after(std::size_t count) noexcept
+{
+    m_gap_end += std::min(count, m_data.size() - m_gap_end);
+}
+
+
+void
+gap_buffer::move_to(std::size_t position) noexcept
+{
+    position = std::min(position, size());
+
+    if (position < m_gap_begin)
+    {
+        const std::size_t count { m_gap_begin - position };
+
+        std::memmove(m_data.data() + m_gap_end - count,
+                     m_data.data() + position, count);
+        m_gap_begin -= count;
+        m_gap_end   -= count;
+    }
+    else if (position > m_gap_begin)
+    {
+        const std::size_t count { position - m_gap_begin };
+
+        std::memmove(m_data.data() + m_gap_begin, m_data.data() + m_gap_end,
+                     count);
+        m_gap_begin += count;
+        m_gap_end   += count;
+    }
+}
+
+
+void
+gap_buffer::clear() noexcept
+{
+    m_gap_begin = 0;
+    m_gap_end   = m_data.size();
+}
+
+
+auto
+gap_buffer::before() const noexcept -> std::string_view
+{
+    return { m_data.data(), m_gap_begin };
+}
+
+
+auto
+gap_buffer::after() const noexcept -> std::string_view
+{
+    return { m_data.data() + m_gap_end, m_data.size() - m_gap_end };
+}
+
+
+void
+gap_buffer::copy(std::size_t first, std::size_t last, std::string &out) const
+{
+    last = std::min(last, size());
+    if (first >= last) return;
+
+    if (first < m_gap_begin)
+        out.append(before().substr(first, std::min(last, m_gap_begin) - first));
+
+    if (last > m_gap_begin)
+    {
+        const std::size_t from { std::max(first, m_gap_begin) - m_gap_begin };
+        out.append(after().substr(from, last - m_gap_begin - from));
+    }
+}
+
+
+auto
+line_editor::insert(std::string_view text) -> change
+{
+    if (text.empty()) return std::nullopt;
+
+    const std::size_t from { m_buffer.cursor() };
+    m_buffer.insert(text);
+    return mf_changed(from, 0, text);
+}
+
+
+auto
+line_editor::backspace() -> change
+{
+    const std::size_t cursor { m_buffer.cursor() };
+    if (cursor == 0) return std::nullopt;
+
+    const std::size_t from { mf_previous(cursor) };
+    m_buffer.erase_before(cursor - from);
+    return mf_changed(from, cursor - from, {});
+}
+
+
+auto
+line_editor::del() -> change
+{
+    const std::size_t cursor { m_buffer.cursor() };
+    if (cursor == m_buffer.size()) return std::nullopt;
+
+    const std::size_t count { mf_next(cursor) - cursor };
+    m_buffer.erase_after(count);
+    return mf_changed(cursor, count, {});
+}
+
+
+auto
+line_editor::kill_to_start() -> change
+{
+    return mf_kill(0);
+}
+
+
+auto
+line_editor::kill_to_end() -> change
+{
+    return mf_kill(m_buffer.size());
+}
+
+
+auto
+line_editor::kill_word_before() -> change
+{
+    std::size_t first { m_buffer.cursor() };
+
+    while (first > 0 && is_blank(m_buffer[first - 1])) first--;
+    while (first > 0 && !is_blank(m_buffer[first - 1])) first--;
+
+    return mf_kill(first);
+}
+
+
+auto
+line_editor::yank() -> change
+{
+    return insert(m_killed);
+}
+
+
+void
+line_editor::left() noexcept
+{
+    m_buffer.move_to(mf_previous(m_buffer.cursor()));
+}
+
+
+void
+line_editor::right() noexcept
+{
+    m_buffer.move_to(mf_next(m_buffer.cursor()));
+}
+
+
+void
+line_editor::word_left() noexcept
+{
+    std::size_t position { m_buffer.cursor() };
+
+    while (position > 0 && is_blank(m_buffer[position - 1])) position--;
+    while (position > 0 && !is_blank(m_buffer[position - 1])) position--;
+
+    m_buffer.move_to(position);
+}
+
+
+void
+line_editor::word_right() noexcept
+{
+    std::size_t position { m_buffer.cursor() };
+    const auto  size { m_buffer.size() };
+
+    while (position < size && is_blank(m_buffer[position])) position++;
+    while (position < size && !is_blank(m_buffer[position])) position++;
+
+    m_buffer.move_to(position);
+}
+
+
+void
+line_editor::home() noexcept
+{
+    m_buffer.move_to(0);
+}
+
+
+void
+line_editor::end() noexcept
+{
+    m_buffer.move_to(m_buffer.size());
+}
+
+
+void
+line_editor::clear() noexcept
+{
+    m_buffer.clear();
+    m_text.clear();
+    m_tokens.clear();
+}
+
+
+auto
+line_editor::mf_previous(std::size_t position) const noexcept -> std::size_t
+{
+    if (position == 0) return 0;
+
+    position--;
+    while (position > 0 && is_continuation(m_buffer[position])) position--;
+
+    return position;
+}
+
+
+auto
+line_editor::mf_next(std::size_t position) const noexcept -> std::size_t
+{
+    const auto size { m_buffer.size() };
+    if (position >= size) return size;
+
+    position++;
+    while (position < size && is_continuation(m_buffer[position])) position++;
+
+    return position;
+}
+
+
+auto
+line_editor::mf_kill(std::size_t first) -> change
+{
+    const std::size_t cursor { m_buffer.cursor() };
+    if (first == cursor) return std::nullopt;
+
+    m_killed.clear();
+
+    if (first < cursor)
+    {
+        m_buffer.copy(first, cursor, m_killed);
+        m_buffer.erase_before(cursor - first);
+        return mf_changed(first, cursor - first, {});
+    }
+
+    m_buffer.copy(cursor, first, m_killed);
+    m_buffer.erase_after(first - cursor);
+    return mf_changed(cursor, first - cursor, {});
+}
+
+
+auto
+line_editor::mf_changed(std::size_t      offset,
+                        std::size_t      removed,
+                        std::string_view inserted) -> change
+{
+    /* the text may move when it grows, the tokens still point at it */
+    const char *previous { m_text.data() };
+
+    m_text.replace(offset, removed, inserted);
+    lexer::relex(m_text, m_tokens, previous,
+                 { .offset   = offset,
+                   .removed  = removed,
+                   .inserted = inserted.size() });
+
+    return offset;
+}
@@ -1,12 +1,17 @@
 #include <atomic>
 #include <csignal>
 #include <cstring>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <utility>
 
 #include <unistd.h>
 
+#include "ansi.hh"
 #include "input.hh"
+#include "lexer.hh"
 #include "shared.hh"
 #include "terminal.hh"
 
@@ -16,28 +21,12 @@ using cchell::input::interactive_input;
 namespace
 {
     using namespace cchell;
-
-
-    auto
-    handle_input(char ch, bool &reading) -> terminal::decode_status
-    {
-        auto [status, event] { terminal::decode(ch) };
-
-        if (status != terminal::decode_status::value) return status;
-
-        if (event->code == terminal::key::enter)
-        {
-            reading = false;
-            return terminal::decode_status::none;
-        }
-
-        return terminal::decode_status::value;
-    }
 }
 
 
 interactive_input *interactive_input::m_instance { nullptr };
-interactive_input::interactive_input()
+interactive_input::interactive_input(std::string prompt)
+    : m_prompt { std::move(prompt) }
 {
     if (shared::tty_status.stdin())
     {
@@ -59,6 +48,15 @@ interactive_input::interactive_input()
 }
 
 
+interactive_input::~interactive_input()
+{
+    if (interactive_input::m_instance != this) return;
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &m_old_term);
+    interactive_input::m_instance = nullptr;
+}
+
+
 void
 interactive_input::install_sigint_action()
 {
@@ -68,6 +66,11 @@ interactive_input::install_sigint_action()
     sa.sa_flags = 0;
 
     sigaction(SIGINT, &sa, nullptr);
+
+    /* no SA_RESTART either, so a read waiting on the terminal returns
+       and the line is drawn again for its new width */
+    sa.sa_handler = interactive_input::sigwinch_handler;
+    sigaction(SIGWINCH, &sa, nullptr);
 }
 
 
@@ -79,6 +82,13 @@ interactive_input::sigint_handler(int sig)
 }
 
 
+void
+interactive_input::sigwinch_handler(int /* sig */)
+{
+    terminal::resized.store(true, std::memory_order::relaxed);
+}
+
+
 void
 interactive_input::set_sigint_flag(bool value)
 {
@@ -95,46 +105,205 @@ interactive_input::is_sigint_triggered() const noexcept -> bool
 
 auto
 interactive_input::read(std::string &text) noexcept -> int
+{
+    /* only on while reading, what runs in between gets the terminal the
+       way it would have without the shell */
+    terminal::screen.print("{}", ansi::command::bracketed_paste(true));
+    int res { mf_read(text) };
+    terminal::screen.print("{}", ansi::command::bracketed_paste(false));
+
+    terminal::screen.flush();
+    return res;
+}
+
+
+auto
+interactive_input::mf_read(std::string &text) noexcept -> int
 {
     text.clear();
     set_sigint_flag(false);
+    m_editor.clear();
+    m_renderer.start(m_prompt);
 
-    bool reading { true };
-    bool escaped { false };
-    char ch;
-    auto read_status { terminal::decode_status::none };
+    auto       &input { terminal::stdin_buffer };
+    bool        escaped { false };
+    std::size_t pasted { std::string::npos }; /* where the paste started */
 
-    while (reading)
+    /* whatever was drawn goes out in one go before waiting for more */
+    auto wait { [&input]
+                {
+                    terminal::screen.flush();
+                    return input.fill(STDIN_FILENO);
+                } };
+
+    while (true)
     {
-        if (::read(STDIN_FILENO, &ch, 1) < 0) return errno;
+        if (input.empty())
+        {
+            int res { wait() };
+
+            if (res == EINTR && !is_sigint_triggered()
+                && terminal::resized.exchange(false))
+            {
+                m_renderer.resize(m_editor.buffer());
+                continue;
+            }
+
+            if (res != 0) return res;
+        }
+
+        auto bytes { input.peek() };
+        bool pasting { pasted != std::string::npos };
+
+        /* 0x04 being "End of Transmission" in ASCII, which deletes when
+           there is anything to delete, as in readline */
+        if (!pasting && bytes.front() == 0x04)
+        {
+            input.consume(1);
+            if (m_editor.buffer().size() == 0) return EOF;
+
+            mf_redraw(m_editor.del());
+            continue;
+        }
+
+        /* the byte after a backslash is taken as it is, enter included */
+        if (!pasting && escaped)
+        {
+            escaped = false;
+            mf_redraw(m_editor.insert({ bytes.data(), 1 }));
+            input.consume(1);
+            continue;
+        }
 
-        /* 0x04 being "End of Transmission" in ASCII */
-        if (ch == 0x04) return EOF;
+        auto [status, event, size, run, is_paste] { m_decoder.decode(bytes) };
 
-        /* decode status is pending, decoder owns the byte */
-        if (read_status == terminal::decode_status::pending)
+        /* a paste goes in whole and is drawn once it ended, its newlines
+           and escapes being just text */
+        if (is_paste)
         {
-            read_status = handle_input(ch, reading);
+            m_editor.insert(run);
+            input.consume(size);
             continue;
         }
 
-        if (!escaped)
+        /* the decoder keeps a sequence the buffer ended in the middle of */
+        if (status != terminal::decode_status::none)
         {
-            if (ch == '\\')
-                escaped = true;
-            else
+            input.consume(size);
+            if (status != terminal::decode_status::value) continue;
+
+            switch (event->code)
+            {
+            case terminal::key::enter:
             {
-                read_status = handle_input(ch, reading);
-                if (read_status != terminal::decode_status::none) continue;
+                /* a quote or bracket left open goes on on the next line,
+                   as in sh */
+                if (auto diag { lexer::verify(m_editor.tokens()) };
+                    diag && diag->incomplete)
+                {
+                    mf_redraw(m_editor.insert("\n"));
+                    break;
+                }
+
+                const auto &buffer { m_editor.buffer() };
+
+                text.append(buffer.before()).append(buffer.after()) += '\n';
+
+                m_renderer.finish();
+                return 0;
             }
 
+            case terminal::key::paste_begin:
+                pasted = m_editor.buffer().cursor();
+                break;
+
+            case terminal::key::paste_end:
+                if (pasting) mf_redraw(pasted);
+                pasted = std::string::npos;
+                break;
+
+            default: mf_key(*event); break;
+            }
+
+            continue;
+        }
+
+        if (run.empty())
+        {
+            input.consume(size);
+            continue;
+        }
+
+        if (run.size() == 1 && static_cast<unsigned char>(run.front()) < 0x20)
+        {
+            mf_control(run.front());
+            input.consume(1);
+            continue;
+        }
+
+        if (auto slash { run.find('\\') }; slash != std::string_view::npos)
+        {
+            run     = run.substr(0, slash + 1);
+            escaped = true;
         }
-        else
-            escaped = false;
 
-        std::fputc(ch, stderr);
-        text += ch;
+        mf_redraw(m_editor.insert(run));
+        input.consume(run.size());
     }
+}
+
+
+void
+interactive_input::mf_key(const terminal::key_event &event)
+{
+    using enum terminal::key;
+
+    switch (event.code)
+    {
+    case arrow_left:
+        event.ctrl ? m_editor.word_left() : m_editor.left();
+        break;
+    case arrow_right:
+        event.ctrl ? m_editor.word_right() : m_editor.right();
+        break;
+    case home: m_editor.home(); break;
+    case end:  m_editor.end(); break;
+
+    case backspace: return mf_redraw(m_editor.backspace());
+    case del:       return mf_redraw(m_editor.del());
+
+    default: return;
+    }
+
+    m_renderer.place(m_editor.buffer());
+}
+
 
-    return 0;
+void
+interactive_input::mf_control(char ch)
+{
+    switch (ch)
+    {
+    case 0x01: m_editor.home(); break;  /* ^A */
+    case 0x02: m_editor.left(); break;  /* ^B */
+    case 0x05: m_editor.end(); break;   /* ^E */
+    case 0x06: m_editor.right(); break; /* ^F */
+
+    case 0x08: return mf_redraw(m_editor.backspace());        /* ^H */
+    case 0x0B: return mf_redraw(m_editor.kill_to_end());      /* ^K */
+    case 0x15: return mf_redraw(m_editor.kill_to_start());    /* ^U */
+    case 0x17: return mf_redraw(m_editor.kill_word_before()); /* ^W */
+    case 0x19: return mf_redraw(m_editor.yank());             /* ^Y */
+
+    default: return;
+    }
+
+    m_renderer.place(m_editor.buffer());
+}
+
+
+void
+interactive_input::mf_redraw(line_editor::change from)
+{
+    if (from) m_renderer.draw(m_editor.buffer(), *from);
 }
@@ -0,0 +1,496 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include <unistd.h>
+
+#include "ansi.hh"
+#include "input.hh"
+#include "terminal.hh"
+
+using cchell::input::line_renderer;
+
+
+namespace
+{
+    using namespace cchell;
+
+
+    constexpr char32_t ZERO_WIDTH_JOINER { 0x200D };
+    constexpr char32_t REPLACEMENT { 0xFFFD };
+
+    /* as many as are still fewer bytes than a cursor left */
+    constexpr std::string_view BACKSPACES { "\b\b\b" };
+
+
+    /* the code point at the front of @param text and how many bytes it
+       takes, a byte that starts nothing valid being one on its own */
+    auto
+    decode_utf8(std::string_view text) noexcept
+        -> std::pair<char32_t, std::size_t>
+    {
+        const auto  lead { static_cast<unsigned char>(text.front()) };
+        std::size_t length { lead >= 0xF0   ? 4UZ
+                             : lead >= 0xE0 ? 3UZ
+                             : lead >= 0xC0 ? 2UZ
+                                            : 1UZ };
+
+        if (lead < 0x80) return { lead, 1 };
+        if (lead < 0xC0 || length > text.size()) return { REPLACEMENT, 1 };
+
+        char32_t code_point { lead & (0x7FU >> length) };
+        for (std::size_t i { 1 }; i < length; i++)
+        {
+            const auto next { static_cast<unsigned char>(text[i]) };
+            if ((next & 0xC0) != 0x80) return { REPLACEMENT, 1 };
+
+            code_point = (code_point << 6) | (next & 0x3F);
+        }
+
+        return { code_point, length };
+    }
+
+
+    /* the bytes after the first of a UTF-8 character */
+    constexpr auto
+    is_continuation(char c) noexcept -> bool
+    {
+        return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    }
+
+
+    constexpr auto
+    is_control(char32_t code_point) noexcept -> bool
+    {
+        return code_point < 0x20 || code_point == 0x7F;
+    }
+
+
+    /* the columns @param code_point is shown in, ^J and the like for the
+       control characters */
+    auto
+    cells_of(char32_t code_point) noexcept -> std::size_t
+    {
+        if (is_control(code_point)) return 2;
+        return static_cast<std::size_t>(terminal::cell_width(code_point));
+    }
+
+
+    struct character
+    {
+        char32_t            code_point;
+        std::size_t         length;
+        std::array<char, 4> bytes;
+    };
+
+
+    /* the character at @param position of @param line, which can go
+       across the gap */
+    auto
+    decode_at(const input::gap_buffer &line, std::size_t position) noexcept
+        -> character
+    {
+        character found {};
+
+        const auto available { std::min(line.size() - position, 4UZ) };
+        for (std::size_t i { 0 }; i < available; i++)
+            found.bytes[i] = line[position + i];
+
+        std::tie(found.code_point, found.length)
+            = decode_utf8({ found.bytes.data(), available });
+
+        return found;
+    }
+
+
+    /* control characters are shown as ^J and the like, so the line stays
+       on the rows it's laid out on */
+    void
+    append_glyph(std::string &glyphs, const character &shown)
+    {
+        if (is_control(shown.code_point))
+            glyphs.append({ '^', static_cast<char>(shown.code_point ^ 0x40) });
+        else if (shown.code_point == REPLACEMENT && shown.length == 1)
+            glyphs += "\uFFFD";
+        else
+            glyphs.append(shown.bytes.data(), shown.length);
+    }
+
+
+    /* @param count steps of a cursor move, which takes at most 65535 */
+    void
+    move_by(auto (*command)(std::uint16_t) noexcept -> ansi::command,
+            std::size_t count)
+    {
+        while (count > 0)
+        {
+            const auto step { std::min<std::size_t>(count, UINT16_MAX) };
+
+            terminal::screen.print("{}", command(step));
+            count -= step;
+        }
+    }
+}
+
+
+void
+line_renderer::start(std::string_view prompt)
+{
+    m_prompt_width = 0;
+    for (std::size_t i { 0 }; i < prompt.size();)
+    {
+        auto [code_point, length] { decode_utf8(prompt.substr(i)) };
+
+        m_prompt_width += terminal::cell_width(code_point);
+        i              += length;
+    }
+
+    m_columns    = terminal::columns(STDERR_FILENO);
+    m_rows       = terminal::rows(STDERR_FILENO);
+    m_origin     = m_prompt_width % m_columns;
+    m_cursor     = { 0, m_origin };
+    m_end        = m_cursor;
+    m_windowed   = false;
+    m_window     = 0;
+    m_window_end = 0;
+
+    m_cells.clear();
+    m_glyphs.clear();
+
+    terminal::screen.write(prompt);
+}
+
+
+void
+line_renderer::draw(const gap_buffer &line, std::size_t from)
+{
+    /* counting bytes rather than cells, which would take going over the
+       whole line */
+    const bool windowed { line.size() > m_columns * (m_rows - 1) };
+
+    if (windowed != m_windowed || (windowed && from < m_window))
+    {
+        m_windowed = windowed;
+        m_window   = windowed ? mf_anchor(line) : 0;
+        return mf_draw(line, 0);
+    }
+
+    /* a cell ending right at the change can take what was put after it,
+       a combining mark say, so it is laid out again too */
+    const auto kept_end { std::ranges::partition_point(
+        m_cells, [from](const cell &kept)
+        { return kept.offset + kept.length < from; }) };
+
+    mf_draw(line, static_cast<std::size_t>(kept_end - m_cells.begin()));
+}
+
+
+void
+line_renderer::place(const gap_buffer &line)
+{
+    if (m_windowed && !mf_shows(line, m_window_end))
+    {
+        /* where the terminal is too narrow for the window to move to
+           the cursor, it stays where it is */
+        if (const auto anchor { mf_anchor(line) }; anchor != m_window)
+        {
+            m_window = anchor;
+            return mf_draw(line, 0);
+        }
+    }
+
+    const std::size_t position { line.cursor() };
+
+    auto at { std::ranges::partition_point(
+        m_cells, [position](const cell &before)
+        { return before.offset + before.length <= position; }) };
+
+    mf_move(at == m_cells.end() ? mf_wrapped(m_end) : at->at);
+}
+
+
+void
+line_renderer::resize(const gap_buffer &line)
+{
+    const std::size_t columns { terminal::columns(STDERR_FILENO) };
+    m_rows = terminal::rows(STDERR_FILENO);
+
+    if (columns == m_columns) return draw(line, m_window);
+
+    /* the terminal wraps the rows again for its new width, which takes
+       the cursor along to the row it gets there */
+    const std::size_t row { (m_cursor.row * m_columns + m_cursor.col)
+                            / columns };
+
+    move_by(ansi::command::cursor_up, row);
+    terminal::screen.write("\r");
+    move_by(ansi::command::cursor_right, m_prompt_width % columns);
+    terminal::screen.print("{}", ansi::command::clear_below());
+
+    m_columns = columns;
+    m_origin  = m_prompt_width % m_columns;
+    m_cursor  = { 0, m_origin };
+    m_end     = m_cursor;
+
+    m_cells.clear();
+    m_glyphs.clear();
+
+    /* the window is placed again for the new width too */
+    m_windowed = false;
+    m_window   = 0;
+    draw(line, 0);
+}
+
+
+void
+line_renderer::finish()
+{
+    /* a newline from a cursor waiting to wrap only takes it down once */
+    if (m_cursor != m_end)
+        mf_move(m_end.col < m_columns ? m_end
+                                      : point { m_end.row, m_columns - 1 });
+
+    terminal::screen.write("\n");
+}
+
+
+void
+line_renderer::mf_draw(const gap_buffer &line, std::size_t first)
+{
+    mf_layout(line, first);
+
+    /* an edit took the cursor out of the window */
+    if (m_windowed && !mf_shows(line, m_next_end))
+    {
+        m_window = mf_anchor(line);
+        first    = 0;
+        mf_layout(line, first);
+    }
+
+    const std::string_view glyphs { m_glyphs };
+    const std::string_view next_glyphs { m_next_glyphs };
+
+    for (std::size_t i { 0 }; i < m_next.size(); i++)
+    {
+        const cell &next { m_next[i] };
+        const auto  glyph { next_glyphs.substr(next.glyph, next.glyph_length) };
+
+        if (first + i < m_cells.size())
+        {
+            const cell &shown { m_cells[first + i] };
+
+            if (shown.at == next.at && shown.width == next.width
+                && glyphs.substr(shown.glyph, shown.glyph_length) == glyph)
+                continue;
+        }
+
+        /* a wide character that didn't fit leaves the end of the row
+           before it, which could still show what was there */
+        const point before { i == 0 ? mf_end(first) : m_next[i - 1].end() };
+
+        if (next.at.col == 0 && before.row + 1 == next.at.row
+            && before.col < m_columns)
+        {
+            mf_move(before);
+            terminal::screen.print("{}", ansi::command::clear_to_end());
+        }
+
+        /* a cursor waiting to wrap gets to the next row by writing */
+        const point wrapped { m_cursor.row + 1, 0 };
+
+        if (m_cursor.col == m_columns && next.at == wrapped)
+            m_cursor = next.at;
+        else
+            mf_move(next.at);
+
+        terminal::screen.write(glyph);
+        m_cursor = next.end();
+    }
+
+    const point end { m_next.empty() ? mf_end(first) : m_next.back().end() };
+
+    /* what the line was longer by */
+    if (mf_wrapped(end) < mf_wrapped(m_end))
+    {
+        mf_move(mf_wrapped(end));
+        terminal::screen.print("{}", ansi::command::clear_below());
+    }
+
+    const std::size_t kept {
+        first == 0 ? 0
+                   : m_cells[first - 1].glyph + m_cells[first - 1].glyph_length
+    };
+
+    m_cells.resize(first);
+    m_glyphs.resize(kept);
+
+    for (cell laid_out : m_next)
+    {
+        laid_out.glyph += kept;
+        m_cells.emplace_back(laid_out);
+    }
+
+    m_glyphs     += m_next_glyphs;
+    m_end         = end;
+    m_window_end  = m_next_end;
+
+    place(line);
+}
+
+
+void
+line_renderer::mf_layout(const gap_buffer &line, std::size_t first)
+{
+    m_next.clear();
+    m_next_glyphs.clear();
+
+    point       at { mf_end(first) };
+    std::size_t position { first == 0 ? m_window
+                                      : m_cells[first - 1].offset
+                                            + m_cells[first - 1].length };
+    bool        joining { false }; /* what follows a joiner is in its cell */
+
+    /* the window keeps the last column for the marker, which also keeps
+       its cursor from waiting to wrap */
+    const std::size_t last { m_windowed ? m_columns - 1 : m_columns };
+
+    auto mark { [&](char marker, std::size_t offset)
+                {
+                    m_next.emplace_back(offset, 0, m_next_glyphs.size(), 1,
+                                        at, 1);
+                    m_next_glyphs += marker;
+                    at.col++;
+                } };
+
+    if (first == 0 && m_window > 0) mark('<', m_window);
+
+    while (position < line.size())
+    {
+        const auto character { decode_at(line, position) };
+        const auto width { cells_of(character.code_point) };
+
+        if ((width == 0 || joining) && !m_next.empty())
+            m_next.back().length += character.length;
+        else
+        {
+            if (m_windowed && at.col + width > last)
+            {
+                m_next_end = position;
+                return mark('>', position);
+            }
+
+            if (at.col + width > m_columns) at = { at.row + 1, 0 };
+
+            m_next.emplace_back(position, character.length,
+                                m_next_glyphs.size(), 0, at, width);
+            at.col += width;
+        }
+
+        append_glyph(m_next_glyphs, character);
+        m_next.back().glyph_length = m_next_glyphs.size() - m_next.back().glyph;
+
+        joining   = character.code_point == ZERO_WIDTH_JOINER;
+        position += character.length;
+    }
+
+    m_next_end = position;
+}
+
+
+/* moves the cursor by as few bytes as it takes, which is what a slow
+   connection notices */
+void
+line_renderer::mf_move(point to)
+{
+    if (m_cursor == to) return;
+
+    /* waiting to wrap, the cursor is still on the last column */
+    m_cursor.col = std::min(m_cursor.col, m_columns - 1);
+
+    if (to.row < m_cursor.row)
+        move_by(ansi::command::cursor_up, m_cursor.row - to.row);
+
+    /* the terminal turns a newline into a carriage return too, and
+       scrolls on the last row where a cursor down would stop */
+    for (; m_cursor.row < to.row; m_cursor.row++)
+    {
+        terminal::screen.write("\n");
+        m_cursor.col = 0;
+    }
+
+    if (to.col == 0 && m_cursor.col != 0)
+        terminal::screen.write("\r");
+    else if (to.col < m_cursor.col
+             && m_cursor.col - to.col <= BACKSPACES.size())
+        terminal::screen.write(BACKSPACES.substr(0, m_cursor.col - to.col));
+    else if (to.col < m_cursor.col)
+        move_by(ansi::command::cursor_left, m_cursor.col - to.col);
+    else if (to.col > m_cursor.col)
+        move_by(ansi::command::cursor_right, to.col - m_cursor.col);
+
+    m_cursor = to;
+}
+
+
+auto
+line_renderer::mf_anchor(const gap_buffer &line) const -> std::size_t
+{
+    const std::size_t cursor { line.cursor() };
+
+    std::size_t position { cursor };
+    std::size_t room { (m_columns - m_origin) / 2 };
+
+    while (position > 0)
+    {
+        std::size_t previous { position - 1 };
+        while (previous > 0 && is_continuation(line[previous])) previous--;
+
+        const auto width { cells_of(decode_at(line, previous).code_point) };
+        if (width > room) break;
+
+        room     -= width;
+        position  = previous;
+    }
+
+    /* what joins the character before it can't start the window */
+    while (position < cursor)
+    {
+        const auto character { decode_at(line, position) };
+        if (cells_of(character.code_point) != 0) break;
+
+        position += character.length;
+    }
+
+    return position;
+}
+
+
+auto
+line_renderer::mf_shows(const gap_buffer &line,
+                        std::size_t       end) const noexcept -> bool
+{
+    const std::size_t cursor { line.cursor() };
+
+    return cursor >= m_window
+        && (cursor < end || (cursor == end && end == line.size()));
+}
+
+
+auto
+line_renderer::mf_end(std::size_t count) const noexcept -> point
+{
+    if (count == 0) return { 0, m_origin };
+
+    return m_cells[count - 1].end();
+}
+
+
+auto
+line_renderer::mf_wrapped(point at) const noexcept -> point
+{
+    return at.col < m_columns ? at : point { at.row + 1, 0 };
+}
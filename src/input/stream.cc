@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "input.hh"
+
+using cchell::input::stream_input;
+
+
+namespace
+{
+    /* enough for most scripts to arrive in one read */
+    constexpr std::size_t CHUNK_SIZE { 64 * 1024 };
+}
+
+
+stream_input::stream_input(int fd, bool shared)
+    : m_fd(fd), m_shared(shared)
+{
+    struct stat info {};
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+        return;
+
+    const auto size { static_cast<std::size_t>(info.st_size) };
+    void *data { mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+
+    /* what can't be mapped is still readable */
+    if (data == MAP_FAILED) return;
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    m_mapping = { static_cast<const char *>(data), size };
+}
+
+
+stream_input::~stream_input()
+{
+    if (!m_mapping.empty())
+        munmap(const_cast<char *>(m_mapping.data()), m_mapping.size());
+}
+
+
+auto
+stream_input::mapped() const noexcept -> std::optional<std::string_view>
+{
+    if (m_mapping.empty()) return std::nullopt;
+    return m_mapping;
+}
+
+
+auto
+stream_input::read(std::string &text) noexcept -> int
+{
+    text.clear();
+
+    if (!m_mapping.empty())
+    {
+        /* what it ran may have read on, or the line may have run elsewhere */
+        if (off_t at { m_shared ? lseek(m_fd, 0, SEEK_CUR) : -1 }; at >= 0)
+            m_begin = std::min(static_cast<std::size_t>(at), m_mapping.size());
+
+        if (m_begin == m_mapping.size()) return EOF;
+
+        auto end { m_mapping.find('\n', m_begin) };
+        end = end == std::string_view::npos ? m_mapping.size() : end + 1;
+
+        text.assign(m_mapping.substr(m_begin, end - m_begin));
+        m_begin = end;
+
+        if (m_shared) lseek(m_fd, static_cast<off_t>(m_begin), SEEK_SET);
+        return 0;
+    }
+
+    while (true)
+    {
+        if (auto end { m_buffer.find('\n', m_begin) };
+            end != std::string::npos)
+        {
+            text.assign(m_buffer, m_begin, end + 1 - m_begin);
+            m_begin = end + 1;
+            return 0;
+        }
+
+        if (m_eof)
+        {
+            if (m_begin == m_buffer.size()) return EOF;
+
+            text.assign(m_buffer, m_begin);
+            m_begin = m_buffer.size();
+            return 0;
+        }
+
+        /* what was handed out is dropped before reading more, so the
+           buffer only ever holds about a line */
+        m_buffer.erase(0, m_begin);
+        m_begin = 0;
+
+        const std::size_t used { m_buffer.size() };
+        const std::size_t wanted { m_shared ? 1 : CHUNK_SIZE };
+        m_buffer.resize(used + wanted);
+
+        ssize_t got { ::read(m_fd, m_buffer.data() + used, wanted) };
+        m_buffer.resize(used + static_cast<std::size_t>(std::max(got, 0Z)));
+
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return errno;
+        if (got == 0) m_eof = true;
+    }
+}
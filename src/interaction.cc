@@ -1,9 +1,11 @@
 #include <interaction.hh>
 
+#include <cerrno>
 #include <iostream>
 #include <ranges>
 
 #include <shared.hh>
+#include <terminal.hh>
 #include <unistd.h>
 
 using cchell::interaction::impl::ask;
@@ -23,15 +25,16 @@ question::render()
 {
     std::cout.flush();
 
-    std::print(std::cerr, "{}ask{}: {} [{}/", style.tag_color, color::reset(),
-               message, static_cast<char>(std::toupper(options[0])));
+    auto &screen { cchell::terminal::screen };
+
+    screen.print("{}ask{}: {} [{}", style.tag_color, color::reset(), message,
+                 static_cast<char>(std::toupper(options[0])));
 
     for (auto i : std::views::iota(1UZ, options.length()))
-        if (i == options.length() - 1)
-            std::cerr << options[i];
-        else
-            std::cerr << options[i] << '/';
-    std::cerr << "] ";
+        screen.print("/{}", options[i]);
+
+    /* drawn once the answer is waited for */
+    screen.write("] ");
 }
 
 
@@ -73,31 +76,38 @@ ask::get_last_error() const -> int
 auto
 ask::mf_get_response() -> int
 {
-    char resp { '\0' };
+    auto &input { cchell::terminal::stdin_buffer };
+    auto &screen { cchell::terminal::screen };
 
     while (true)
     {
-        if (auto n { ::read(STDIN_FILENO, &resp, 1) }; n < 0)
-        {
-            m_error = errno;
-            return -1;
-        }
-        else if (n == 0) /* NOLINT: Do not use 'else' after 'return' */
-        {
-            m_error = EOF;
-            return 0;
-        }
-
-        if (resp == '\n')
-        {
-            if (m_echo) std::putc(resp, stderr);
-            return m_question.options.front();
-        }
-
-        if (m_question.options.contains(resp))
+        if (input.empty())
+            if (int res { (screen.flush(), input.fill(STDIN_FILENO)) };
+                res != 0)
+            {
+                if (res == EINTR && cchell::terminal::resized.exchange(false))
+                    continue;
+
+                m_error = res;
+                return res == EOF ? 0 : -1;
+            }
+
+        /* everything read is looked at here, no byte costs a read */
+        for (char resp : input.peek())
         {
-            if (m_echo) std::cerr << resp << '\n';
-            return resp;
+            input.consume(1);
+
+            if (resp == '\n')
+            {
+                if (m_echo) screen.write("\n");
+                return screen.flush(), m_question.options.front();
+            }
+
+            if (m_question.options.contains(resp))
+            {
+                if (m_echo) screen.print("{}\n", resp);
+                return screen.flush(), resp;
+            }
         }
     }
 
@@ -1,120 +1,975 @@
 #include <algorithm>
+#include <charconv>
+#include <csignal>
+#include <cstdint>
 #include <cstring>
 #include <expected>
-#include <memory>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include <fnmatch.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "glob.hh"
 #include "interpreter.hh"
-#include "parser.hh"
 #include "shared.hh"
 
 
-using namespace cchell::diagnostics;
-using namespace cchell::parser;
+using namespace cchell::interpreter;
 using namespace cchell;
 
 
 namespace
 {
-    auto
-    clean_escape(std::string_view string) -> std::string
+    using status = std::expected<int, std::string>;
+
+
+    /* $$ stays the shell's own pid, even inside of a subshell */
+    const pid_t SHELL_PID { getpid() };
+
+    /* deep enough for any sane recursion, shallow enough for the stack */
+    constexpr std::size_t MAX_CALL_DEPTH { 1024 };
+
+    /* past what any command line can take, a for loop streams them instead */
+    constexpr std::uint64_t MAX_BRACE_WORDS { 1U << 24 };
+
+
+    class machine
     {
-        std::string clean;
-        clean.reserve(string.length());
+    public:
+        machine(const chunk                       &code,
+                environment                       &env,
+                std::span<const std::string_view>  params = {},
+                std::size_t                        depth  = 0)
+            : m_code(code), m_env(env), m_params(params), m_depth(depth),
+              m_frames(code.frames)
+        {
+        }
+
 
-        bool escape { false };
-        for (auto c : string)
+        auto
+        run() -> status
         {
-            if (c == '\\')
+            auto res { mf_run(m_code) };
+
+            if (!res)
+                for (pid_t pid : m_pids) impl::wait_for(pid);
+
+            /* a child must never return into whoever called execute */
+            if (m_forked)
             {
-                if (escape) clean += c;
-                escape = !escape;
-                continue;
+                if (!res) std::println(std::cerr, "cchell: {}", res.error());
+                mf_exit(res ? *res : 1);
             }
 
-            if (escape)
-                escape = false;
-            else
-                clean += c;
+            return res;
         }
 
-        if (escape) clean += '\\';
+    private:
+        /* where a deferred brace word is at, see opcode::defer */
+        struct cursor
+        {
+            const brace_word *words;
+            std::uint64_t     next;
+            std::size_t       before; /* the item it comes before */
+        };
 
-        return clean;
-    }
+        /* the state of one loop or case */
+        struct frame
+        {
+            impl::arguments     items;
+            std::size_t         next { 0 };
+            std::vector<cursor> deferred;
+            std::size_t         cursor { 0 };
+            impl::arguments     fields; /* of the last deferred word */
+            std::size_t         field { 0 };
+            std::string         subject;
+            int                 status { 0 };
+        };
 
+        const chunk                      &m_code;
+        environment                      &m_env;
+        std::span<const std::string_view> m_params;
+        std::size_t                       m_depth;
 
-    auto
-    ast_to_process(const std::unique_ptr<ast_node> &tree)
-        -> std::expected<interpreter::impl::process, std::string>
-    {
-        interpreter::impl::process proc;
+        std::vector<frame> m_frames;
+        binding            m_dynamic; /* for names known only when running */
+
+        impl::arguments                                        m_args;
+        std::vector<std::pair<environment::slot, std::string>> m_assignments;
+
+        /* what the assignments of the running command replaced */
+        std::vector<std::pair<environment::slot, std::optional<std::string>>>
+            m_replaced;
+
+        /* views and pointers into m_args, kept for their capacity */
+        std::vector<std::string_view> m_views;
+        std::vector<char *>           m_argv;
+
+        /* the words begin started, kept for their capacity as well */
+        std::vector<std::string> m_words;
+        std::size_t              m_open { 0 };
+        std::string              m_modified;
+
+        std::vector<cursor>      m_deferred; /* until collect takes them */
+        std::string              m_escaped;
+        std::vector<std::string> m_patterns;
+        std::vector<std::string> m_matches;
+
+        std::vector<pid_t> m_pids;
+        int                m_in { STDIN_FILENO };
+        int                m_out { STDOUT_FILENO };
+        int                m_next_in { -1 };
+
+        int  m_status { 0 };
+        bool m_forked { false };
+
+
+        /* runs @param running, which is m_code but for the words of braces
+           compiled while running */
+        auto
+        mf_run(const chunk &running) -> status
+        {
+            const auto &code { running.code };
+
+            for (std::size_t pc { 0 }; pc < code.size();)
+            {
+                const auto [op, reg, operand] { code[pc++] };
+
+                switch (op)
+                {
+                case opcode::literal:
+                    mf_append(running.strings[operand], 0);
+                    break;
+
+                case opcode::expand:
+                {
+                    const auto *value { m_env.get(operand) };
+                    mf_append(value != nullptr ? *value : "", reg);
+                    break;
+                }
+
+                case opcode::push_arg: m_args.end_word(); break;
+                case opcode::glob:     mf_glob(); break;
+
+                case opcode::arg: m_args.push(running.strings[operand]); break;
+
+                case opcode::assign:
+                    m_assignments.emplace_back(operand, m_args.word());
+                    m_args.drop_word();
+                    break;
+
+                case opcode::set:
+                    m_env.set(operand, m_args.word());
+                    m_args.drop_word();
+                    break;
+
+                case opcode::param:
+                    mf_append(mf_parameter(POSITIONAL | operand).value_or(""),
+                              reg);
+                    break;
+
+                case opcode::special: mf_special(operand, reg); break;
+
+                case opcode::push_params:
+                    for (std::string_view param : m_params) m_args.push(param);
+                    break;
+
+                case opcode::braces:
+                {
+                    const brace_word &words { running.braces[operand] };
+
+                    if (words.size() > MAX_BRACE_WORDS)
+                        return std::unexpected { std::format(
+                            "braces make more than {} words",
+                            MAX_BRACE_WORDS) };
+
+                    for (std::uint64_t i { 0 }; i < words.size(); i++)
+                    {
+                        m_escaped.clear();
+                        words.generate(i, m_escaped);
+
+                        if (impl::is_plain(m_escaped))
+                            m_args.push(m_escaped);
+                        else if (auto res { mf_run(
+                                     impl::compile_word(m_escaped, m_env)) };
+                                 !res)
+                            return res;
+                    }
+                    break;
+                }
+
+                case opcode::begin:
+                    if (m_open == m_words.size()) m_words.emplace_back();
+                    m_words[m_open++].clear();
+                    break;
+
+                case opcode::modify:
+                    if (auto res { mf_modify(operand, reg) }; !res)
+                        return std::unexpected { res.error() };
+                    break;
+
+                case opcode::arith:
+                {
+                    auto value { impl::evaluate(running.arithmetics[operand],
+                                                m_env, m_params, m_status) };
+                    if (!value) return std::unexpected { value.error() };
+
+                    mf_append(std::to_string(*value), reg);
+                    break;
+                }
+
+                case opcode::spawn:
+                    if (auto res { mf_spawn(operand) }; !res) return res;
+                    if (m_env.exit_requested()) return m_status;
+                    break;
+
+                case opcode::exec:
+                    if (auto res { mf_exec(operand) }; !res) return res;
+                    mf_exit(m_status);
+
+                case opcode::define:
+                {
+                    const auto &[name, body] { running.functions[operand] };
+                    m_env.define(name, body);
+
+                    /* bound right away, calls only compare a generation */
+                    for (binding &target : body->bindings)
+                        impl::bind(target, m_env);
+
+                    m_status = 0;
+                    break;
+                }
+
+                case opcode::pipe:
+                {
+                    int fds[2];
+                    if (::pipe(fds) < 0)
+                        return std::unexpected { std::strerror(errno) };
+
+                    m_out     = fds[1];
+                    m_next_in = fds[0];
+                    break;
+                }
+
+                case opcode::fork:
+                {
+                    auto pid { mf_fork() };
+                    if (!pid) return std::unexpected { pid.error() };
+
+                    if (*pid > 0) pc = operand;
+                    break;
+                }
+
+                case opcode::wait:
+                    for (pid_t pid : m_pids) m_status = impl::wait_for(pid);
+                    m_pids.clear();
+                    break;
+
+                case opcode::exit: mf_exit(m_status);
+
+                case opcode::status: m_status = static_cast<int>(operand); break;
+
+                case opcode::jump: pc = operand; break;
+
+                case opcode::jump_if_success:
+                    if (m_status == 0) pc = operand;
+                    break;
+
+                case opcode::jump_if_failure:
+                    if (m_status != 0) pc = operand;
+                    break;
+
+                case opcode::save:    m_frames[reg].status = m_status; break;
+                case opcode::restore: m_status = m_frames[reg].status; break;
+
+                /* swapped, so the arguments get the old items' buffer */
+                case opcode::collect:
+                    std::swap(m_frames[reg].items, m_args);
+                    std::swap(m_frames[reg].deferred, m_deferred);
+                    m_frames[reg].next   = 0;
+                    m_frames[reg].cursor = 0;
+                    m_frames[reg].fields.clear();
+                    m_frames[reg].field = 0;
+                    m_args.clear();
+                    m_deferred.clear();
+                    break;
+
+                case opcode::defer:
+                    m_deferred.emplace_back(&running.braces[operand], 0,
+                                            m_args.size());
+                    break;
+
+                case opcode::next:
+                {
+                    auto more { mf_next(m_frames[reg]) };
+                    if (!more) return std::unexpected { more.error() };
+
+                    if (!*more) pc = operand;
+                    break;
+                }
+
+                case opcode::subject:
+                    m_frames[reg].subject = m_args.word();
+                    m_args.drop_word();
+                    break;
+
+                case opcode::match:
+                {
+                    bool matched { fnmatch(m_args.word().data(),
+                                           m_frames[reg].subject.c_str(), 0)
+                                   == 0 };
+                    m_args.drop_word();
+
+                    if (matched) pc = operand;
+                    break;
+                }
+
+                /* as with exit, a bad status is 2, and returns all the
+                   same */
+                case opcode::word_status:
+                {
+                    auto value { mf_number(running.strings[operand]) };
+                    if (!value)
+                        std::println(std::cerr, "cchell: {}", value.error());
+
+                    m_status = value ? static_cast<int>(*value & 0xff) : 2;
+                    break;
+                }
+
+                case opcode::loop_levels:
+                {
+                    auto levels { mf_number(running.strings[operand]) };
+                    if (!levels) return std::unexpected { levels.error() };
 
-        if (tree->type != ast_type::statement)
-            return std::unexpected {
-                "the AST's root is not of type \"statement\""
-            };
+                    if (*levels < 1)
+                        return std::unexpected { std::format(
+                            "{}: {}: loop count out of range",
+                            running.strings[operand], *levels) };
 
-        for (auto &child : tree->child)
+                    /* more than there are loops leaves all of them */
+                    m_status  = 0;
+                    pc       += std::min<std::size_t>(
+                                    static_cast<std::size_t>(*levels), reg)
+                        - 1;
+                    break;
+                }
+                }
+            }
+
+            return m_status;
+        }
+
+
+        /* takes the number out of the current word, for the builtin
+           @param name */
+        auto
+        mf_number(std::string_view name)
+            -> std::expected<std::int64_t, std::string>
+        {
+            std::string_view word { m_args.word() };
+            std::int64_t     value { 0 };
+
+            const char *last { word.data() + word.size() };
+            auto [end, ec] { std::from_chars(word.data(), last, value) };
+
+            if (ec != std::errc {} || end != last)
+            {
+                auto error { std::format("{}: {}: numeric argument required",
+                                         name, word) };
+                m_args.drop_word();
+                return std::unexpected { std::move(error) };
+            }
+
+            m_args.drop_word();
+            return value;
+        }
+
+
+        /* moves the frame's next item into the word, if there is one */
+        auto
+        mf_next(frame &current) -> std::expected<bool, std::string>
+        {
+            for (; current.cursor < current.deferred.size(); current.cursor++)
+            {
+                auto &[words, next, before] { current.deferred[current.cursor] };
+                if (before != current.next) break;
+
+                /* a word that still expands can make several fields, or
+                   none, which are taken in turn */
+                while (current.field < current.fields.size()
+                       || next < words->size())
+                {
+                    if (current.field < current.fields.size())
+                    {
+                        m_args.append(current.fields[current.field++]);
+                        return true;
+                    }
+
+                    m_escaped.clear();
+                    words->generate(next++, m_escaped);
+
+                    if (impl::is_plain(m_escaped))
+                    {
+                        m_args.append(m_escaped);
+                        return true;
+                    }
+
+                    if (auto res { mf_expand(m_escaped, current) }; !res)
+                        return std::unexpected { res.error() };
+                }
+            }
+
+            if (current.next == current.items.size()) return false;
+
+            m_args.append(current.items[current.next++]);
+            return true;
+        }
+
+
+        /* expands @param word into the fields of @param current */
+        auto
+        mf_expand(std::string_view word, frame &current) -> status
+        {
+            chunk code { impl::compile_word(word, m_env) };
+
+            current.fields.clear();
+            current.field = 0;
+
+            std::swap(m_args, current.fields);
+            auto res { mf_run(code) };
+            std::swap(m_args, current.fields);
+
+            return res;
+        }
+
+
+        [[noreturn]]
+        static void
+        mf_exit(int status)
+        {
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(status);
+        }
+
+
+        /* only assignments, which then apply to the shell itself */
+        void
+        mf_assign()
         {
-            if (child.type == ast_type::assignment)
-                proc.envp.emplace_back(child.data);
+            for (auto &[slot, value] : m_assignments)
+                m_env.set(slot, value);
+
+            m_assignments.clear();
+            m_status = 0;
+        }
+
 
-            if (child.type == ast_type::command)
+        /* assignments for the length of one command, see mf_restore() */
+        void
+        mf_assign_scoped()
+        {
+            m_replaced.clear();
+
+            for (auto &[slot, value] : m_assignments)
             {
-                if (child.data.starts_with("./"))
-                    proc.path = child.data;
+                const std::string *old { m_env.get(slot) };
+                m_replaced.emplace_back(slot,
+                                        old != nullptr
+                                            ? std::optional { *old }
+                                            : std::nullopt);
+                m_env.set(slot, value);
+            }
+
+            m_assignments.clear();
+        }
+
+
+        /* undoes mf_assign_scoped(), latest first for a name set twice */
+        void
+        mf_restore()
+        {
+            for (auto &[slot, value] : m_replaced | std::views::reverse)
+                if (value)
+                    m_env.set(slot, *value);
                 else
-                    proc.path = shared::executables.closest(child.data)
-                                    ->second.c_str();
+                    m_env.unset(slot);
 
-                proc.argv.emplace_back(proc.path);
+            m_replaced.clear();
+        }
+
+
+        /* builtins run in the shell, but only the special ones keep their
+           assignments, the rest are like any other command */
+        void
+        mf_builtin(std::uint32_t index)
+        {
+            bool special { impl::is_special_builtin(index) };
+            if (special)
+                mf_assign();
+            else
+                mf_assign_scoped();
+
+            m_args.views(m_views);
+            m_status = impl::run_builtin(index, m_views, m_env);
+            m_args.clear();
+
+            if (!special) mf_restore();
+        }
+
+
+        /* the environment of a command, with its own assignments on top */
+        auto
+        mf_envp(std::vector<std::string> &storage) -> std::vector<char *>
+        {
+            std::vector<char *> envp;
+
+            for (char **entry { m_env.envp() }; *entry != nullptr; entry++)
+            {
+                std::string_view view { *entry };
+                std::string_view name { view.substr(0, view.find('=')) };
+
+                bool overridden { false };
+                for (const auto &[slot, _] : m_assignments)
+                    overridden = overridden || m_env.name(slot) == name;
+
+                if (!overridden) envp.emplace_back(*entry);
             }
 
-            if (child.type == ast_type::option)
-                proc.argv.emplace_back(clean_escape(child.data));
+            storage.reserve(m_assignments.size());
+            for (const auto &[slot, value] : m_assignments)
+                storage.emplace_back(std::format("{}={}", m_env.name(slot),
+                                                 value));
+
+            for (std::string &entry : storage) envp.emplace_back(entry.data());
+            envp.emplace_back(nullptr);
+
+            return envp;
         }
 
-        return proc;
-    }
-}
 
+        /**
+         * appends @param text to the word begin last started, or to the
+         * current argument, split into fields if @param flags say so.
+         */
+        void
+        mf_append(std::string_view text, std::uint16_t flags)
+        {
+            if ((flags & ESCAPE_GLOB) != 0)
+            {
+                m_escaped.clear();
+                for (char c : text)
+                {
+                    if (std::string_view { "*?[]\\" }.contains(c))
+                        m_escaped += '\\';
+                    m_escaped += c;
+                }
+                text = m_escaped;
+            }
 
-auto
-interpreter::impl::process::exec() -> bool
-{
-    std::vector<char *> c_argv { argv.size() + 1 };
-    std::vector<char *> c_envp { envp.size() + 1 };
+            if (m_open > 0)
+                m_words[m_open - 1] += text;
+            else if ((flags & SPLIT_FIELDS) != 0)
+                m_args.split(text, m_env.field_separators());
+            else
+                m_args.append(text);
+        }
 
-    std::ranges::transform(argv, c_argv.begin(),
-                           [](std::string &s) { return s.data(); });
-    c_argv.emplace_back(nullptr);
-    std::ranges::transform(envp, c_envp.begin(),
-                           [](std::string &s) { return s.data(); });
-    c_envp.emplace_back(nullptr);
 
-    return execve(path.c_str(), c_argv.data(), c_envp.data()) >= 0;
-}
+        /* every field of the word is a pattern, left as is if it matches
+           nothing */
+        void
+        mf_glob()
+        {
+            m_args.finish();
 
+            std::size_t first { m_args.size() - m_args.fields() };
 
-auto
-interpreter::execute(const std::unique_ptr<ast_node> &tree)
-    -> std::expected<pid_t, std::string>
-{
-    impl::process proc;
+            m_patterns.clear();
+            for (std::size_t i { first }; i < m_args.size(); i++)
+                m_patterns.emplace_back(m_args[i]);
+            m_args.truncate(first);
+
+            for (const std::string &pattern : m_patterns)
+            {
+                m_matches.clear();
+
+                if (glob::has_magic(pattern)
+                    && glob::expand(pattern, m_matches))
+                {
+                    for (const std::string &path : m_matches)
+                        m_args.push(path);
+                    continue;
+                }
+
+                m_escaped.clear();
+                glob::unescape(pattern, m_escaped);
+                m_args.push(m_escaped);
+            }
+
+            m_args.end_word();
+        }
+
+
+        void
+        mf_special(std::uint32_t name, std::uint16_t flags)
+        {
+            switch (static_cast<char>(name))
+            {
+            case '?': mf_append(std::to_string(m_status), flags); break;
+            case '#': mf_append(std::to_string(m_params.size()), flags); break;
+            case '$': mf_append(std::to_string(SHELL_PID), flags); break;
+
+            /* unquoted, every parameter is split on its own */
+            case '@': [[fallthrough]];
+            case '*':
+            {
+                std::string_view separator {
+                    m_env.field_separators().substr(0, 1)
+                };
+
+                for (std::size_t i { 0 }; i < m_params.size(); i++)
+                {
+                    if (i > 0 && (flags & SPLIT_FIELDS) != 0 && m_open == 0)
+                        m_args.finish();
+                    else if (i > 0)
+                        mf_append(separator, flags);
+
+                    mf_append(m_params[i], flags);
+                }
+
+                if (m_params.empty()) mf_append("", flags);
+                break;
+            }
+
+            default: break;
+            }
+        }
+
+
+        /* the value of parameter @param operand, see POSITIONAL */
+        auto
+        mf_parameter(std::uint32_t operand) -> std::optional<std::string_view>
+        {
+            if ((operand & POSITIONAL) == 0)
+            {
+                const auto *value { m_env.get(operand) };
+                if (value == nullptr) return std::nullopt;
+                return *value;
+            }
+
+            operand &= ~POSITIONAL;
+
+            if (operand == 0) return PROJECT_NAME;
+            if (operand > m_params.size()) return std::nullopt;
+
+            return m_params[operand - 1];
+        }
+
+
+        /* ${parameter<op>word}, with its words being the last ones begun */
+        auto
+        mf_modify(std::uint32_t operand, std::uint16_t reg)
+            -> std::expected<void, std::string>
+        {
+            using enum modifier;
+
+            auto type { static_cast<modifier>(reg & 0xff) };
+            auto value { mf_parameter(operand) };
+            bool unset { !value
+                         || ((reg & EMPTY_IS_UNSET) != 0 && value->empty()) };
+
+            std::size_t count { type == length                           ? 0UZ
+                                : type == replace || type == replace_all ? 2UZ
+                                                                         : 1UZ };
+
+            /* still valid after closing them, nothing begins in between */
+            m_open -= count;
+            std::string_view word {};
+            if (count > 0) word = m_words[m_open];
+
+            switch (type)
+            {
+            case length:
+                mf_append(std::to_string(value ? value->length() : 0), reg);
+                break;
+
+            case use_default:
+                mf_append(unset ? word : *value, reg);
+                break;
+
+            case assign_default:
+                if (unset)
+                {
+                    if ((operand & POSITIONAL) != 0)
+                        return std::unexpected { std::format(
+                            "${}: cannot assign in this way",
+                            operand & ~POSITIONAL) };
+
+                    m_env.set(operand, word);
+                }
+                mf_append(unset ? word : *value, reg);
+                break;
+
+            case use_alternative:
+                mf_append(unset ? "" : word, reg);
+                break;
+
+            case error_if_unset:
+                if (unset)
+                    return std::unexpected { std::format(
+                        "{}: {}", mf_parameter_name(operand),
+                        word.empty() ? "parameter null or not set" : word) };
+
+                mf_append(*value, reg);
+                break;
+
+            case replace: [[fallthrough]];
+            case replace_all:
+                m_modified.clear();
+                impl::replace(value.value_or(""), word, m_words[m_open + 1],
+                              type == replace_all, m_modified);
+                mf_append(m_modified, reg);
+                break;
+
+            default:
+                m_modified.clear();
+                impl::remove_affix(value.value_or(""), word, type, m_modified);
+                mf_append(m_modified, reg);
+                break;
+            }
+
+            return {};
+        }
+
+
+        auto
+        mf_parameter_name(std::uint32_t operand) const -> std::string
+        {
+            if ((operand & POSITIONAL) != 0)
+                return std::to_string(operand & ~POSITIONAL);
+            return m_env.name(operand);
+        }
+
+
+        /* the binding for @param operand, see binding */
+        auto
+        mf_target(std::uint32_t operand) -> const binding &
+        {
+            binding &target { operand == 0 ? m_dynamic
+                                           : m_code.bindings[operand - 1] };
+
+            if (operand == 0)
+            {
+                target.name       = m_args.front();
+                target.generation = 0;
+            }
+
+            impl::bind(target, m_env);
+            return target;
+        }
+
+
+        /* runs a function in a machine of its own, sharing our environment */
+        auto
+        mf_call(const binding &target) -> status
+        {
+            /* held, the function might redefine itself while running */
+            auto body { target.function.lock() };
+            if (body == nullptr) return m_status = 127;
 
-    if (auto buf { ast_to_process(tree) }; !buf)
-        return std::unexpected { buf.error() };
-    else /* NOLINT: Do not use 'else' after 'return' */
-        proc = *buf;
+            if (m_depth >= MAX_CALL_DEPTH)
+                return std::unexpected { std::format(
+                    "{}: maximum function nesting exceeded", target.name) };
 
-    pid_t pid { fork() };
+            /* VAR=value f only sets VAR while f runs */
+            mf_assign_scoped();
 
-    if (pid == 0)
-        if (!proc.exec()) return std::unexpected { std::strerror(errno) };
-    return pid;
+            /* the arguments stay put while the function runs, so its
+               parameters can point right into them */
+            m_args.views(m_views);
+
+            auto res { machine { *body, m_env,
+                                 std::span { m_views }.subspan(1),
+                                 m_depth + 1 }
+                           .run() };
+            m_args.clear();
+            mf_restore();
+            if (!res) return res;
+
+            return m_status = *res;
+        }
+
+
+        void
+        mf_not_found()
+        {
+            std::println(std::cerr, "cchell: {}: command not found",
+                         m_args.front());
+
+            m_args.clear();
+            m_assignments.clear();
+            m_status = 127;
+        }
+
+
+        /* replaces the current process with the program at @param path */
+        [[noreturn]]
+        void
+        mf_exec_program(const std::string &path)
+        {
+            m_args.pointers(m_argv);
+
+            char **envp { m_env.envp() };
+
+            std::vector<std::string> storage;
+            std::vector<char *>      merged;
+
+            if (!m_assignments.empty())
+            {
+                merged = mf_envp(storage);
+                envp   = merged.data();
+            }
+
+            execve(path.c_str(), m_argv.data(), envp);
+
+            std::println(std::cerr, "cchell: {}: {}", m_args.front(),
+                         std::strerror(errno));
+            mf_exit(errno == ENOENT ? 127 : 126);
+        }
+
+
+        /* like spawn, but the command is the last thing this child does */
+        auto
+        mf_exec(std::uint32_t operand) -> status
+        {
+            if (m_args.empty()) return mf_assign(), 0;
+
+            const binding &target { mf_target(operand) };
+
+            switch (target.type)
+            {
+            case binding::kind::builtin:  mf_builtin(target.builtin); break;
+            case binding::kind::function: return mf_call(target);
+            case binding::kind::program:  mf_exec_program(target.path);
+            case binding::kind::missing:  mf_not_found(); break;
+            }
+
+            return m_status;
+        }
+
+
+        auto
+        mf_spawn(std::uint32_t operand) -> status
+        {
+            if (m_args.empty()) return mf_assign(), 0;
+
+            const binding &target { mf_target(operand) };
+
+            switch (target.type)
+            {
+            case binding::kind::builtin:
+                mf_builtin(target.builtin);
+                return m_status;
+
+            case binding::kind::function: return mf_call(target);
+
+            /* a missing program shouldn't cost a fork */
+            case binding::kind::missing: mf_not_found(); return m_status;
+
+            case binding::kind::program: break;
+            }
+
+            auto pid { mf_fork() };
+            if (!pid) return std::unexpected { pid.error() };
+            if (*pid == 0) mf_exec_program(target.path);
+
+            m_args.clear();
+            m_assignments.clear();
+            m_pids.pop_back();
+
+            return m_status = impl::wait_for(*pid);
+        }
+
+
+        /**
+         * forks with the pending pipe ends as the child's stdin and stdout,
+         * the child starts over with a clean pipeline state.
+         */
+        auto
+        mf_fork() -> std::expected<pid_t, std::string>
+        {
+            std::cout.flush();
+            std::cerr.flush();
+
+            pid_t pid { ::fork() };
+
+            if (pid < 0)
+            {
+                std::string error { std::strerror(errno) };
+                mf_close_pending();
+                return std::unexpected { error };
+            }
+
+            if (pid == 0)
+            {
+                std::signal(SIGINT, SIG_DFL);
+
+                if (m_in != STDIN_FILENO) dup2(m_in, STDIN_FILENO), close(m_in);
+                if (m_out != STDOUT_FILENO)
+                    dup2(m_out, STDOUT_FILENO), close(m_out);
+                if (m_next_in >= 0) close(m_next_in);
+
+                m_in      = STDIN_FILENO;
+                m_out     = STDOUT_FILENO;
+                m_next_in = -1;
+                m_forked  = true;
+                m_pids.clear();
+
+                return pid;
+            }
+
+            if (m_in != STDIN_FILENO) close(m_in);
+            if (m_out != STDOUT_FILENO) close(m_out);
+
+            m_in      = m_next_in >= 0 ? m_next_in : STDIN_FILENO;
+            m_out     = STDOUT_FILENO;
+            m_next_in = -1;
+            m_pids.emplace_back(pid);
+
+            return pid;
+        }
+
+
+        void
+        mf_close_pending()
+        {
+            for (int fd : { m_in, m_out, m_next_in })
+                if (fd > STDERR_FILENO) close(fd);
+
+            m_in      = STDIN_FILENO;
+            m_out     = STDOUT_FILENO;
+            m_next_in = -1;
+        }
+    };
+}
+
+
+auto
+interpreter::execute(const chunk                      &code,
+                     environment                      &env,
+                     std::span<const std::string_view> params)
+    -> std::expected<int, std::string>
+{
+    return machine { code, env, params }.run();
 }
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "interpreter.hh"
+
+using namespace cchell::interpreter;
+
+
+namespace
+{
+    auto
+    is_blank(char c) -> bool
+    {
+        return c == ' ' || c == '\t' || c == '\n';
+    }
+}
+
+
+void
+impl::arguments::split(std::string_view text, std::string_view separators)
+{
+    if (separators.empty()) return append(text);
+
+    /* blanks only ever end a field, while any other separator delimits
+       one, even an empty one, unless blanks already ended it */
+    bool after_blank { false };
+
+    for (char c : text)
+    {
+        if (!separators.contains(c))
+        {
+            m_buffer += c;
+            m_pending   = true;
+            after_blank = false;
+            continue;
+        }
+
+        if (is_blank(c))
+        {
+            after_blank = after_blank || m_pending;
+            finish();
+            continue;
+        }
+
+        if (!after_blank) m_pending = true;
+        finish();
+        after_blank = false;
+    }
+}
+
+
+void
+impl::arguments::finish()
+{
+    if (!m_pending) return;
+
+    m_buffer += '\0';
+    m_starts.emplace_back(static_cast<std::uint32_t>(m_word));
+
+    m_word    = m_buffer.size();
+    m_pending = false;
+}
+
+
+auto
+impl::arguments::word() const -> std::string_view
+{
+    return std::string_view { m_buffer }.substr(m_word);
+}
+
+
+void
+impl::arguments::drop_word()
+{
+    m_buffer.resize(m_word);
+    m_pending = false;
+}
+
+
+auto
+impl::arguments::operator[](std::size_t index) const -> std::string_view
+{
+    std::size_t end { index + 1 < m_starts.size() ? m_starts[index + 1]
+                                                  : m_word };
+
+    return std::string_view { m_buffer }.substr(m_starts[index],
+                                                end - 1 - m_starts[index]);
+}
+
+
+void
+impl::arguments::truncate(std::size_t count)
+{
+    if (count >= m_starts.size()) return;
+
+    m_buffer.resize(m_starts[count]);
+    m_starts.resize(count);
+
+    m_word    = m_buffer.size();
+    m_first   = std::min(m_first, count);
+    m_pending = false;
+}
+
+
+void
+impl::arguments::clear()
+{
+    m_buffer.clear();
+    m_starts.clear();
+    m_word    = 0;
+    m_first   = 0;
+    m_pending = false;
+}
+
+
+void
+impl::arguments::pointers(std::vector<char *> &out)
+{
+    out.clear();
+    for (std::uint32_t start : m_starts) out.emplace_back(&m_buffer[start]);
+    out.emplace_back(nullptr);
+}
+
+
+void
+impl::arguments::views(std::vector<std::string_view> &out) const
+{
+    out.clear();
+    for (std::size_t i { 0 }; i < m_starts.size(); i++)
+        out.emplace_back((*this)[i]);
+}
@@ -0,0 +1,793 @@
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <expected>
+#include <format>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "interpreter.hh"
+#include "shared.hh"
+
+using namespace cchell::interpreter;
+using namespace cchell;
+
+
+namespace
+{
+    using op = arithmetic::op;
+
+
+    /* wraps around on overflow, like the shells do, instead of being UB */
+    auto
+    wrapping(std::uint64_t value) -> std::int64_t
+    {
+        return static_cast<std::int64_t>(value);
+    }
+
+
+    auto
+    apply(op operation, std::int64_t a, std::int64_t b)
+        -> std::expected<std::int64_t, std::string_view>
+    {
+        auto ua { static_cast<std::uint64_t>(a) };
+        auto ub { static_cast<std::uint64_t>(b) };
+
+        switch (operation)
+        {
+        case op::add:           return wrapping(ua + ub);
+        case op::subtract:      return wrapping(ua - ub);
+        case op::multiply:      return wrapping(ua * ub);
+        case op::shift_left:    return wrapping(ua << (ub & 63));
+        case op::shift_right:   return a >> (ub & 63);
+        case op::less:          return a < b;
+        case op::less_equal:    return a <= b;
+        case op::greater:       return a > b;
+        case op::greater_equal: return a >= b;
+        case op::equal:         return a == b;
+        case op::not_equal:     return a != b;
+        case op::bit_and:       return a & b;
+        case op::bit_xor:       return a ^ b;
+        case op::bit_or:        return a | b;
+
+        case op::divide: [[fallthrough]];
+        case op::modulo:
+            if (b == 0) return std::unexpected { "division by 0" };
+            if (b == -1) return operation == op::divide ? wrapping(0 - ua) : 0;
+            return operation == op::divide ? a / b : a % b;
+
+        case op::power:
+        {
+            if (b < 0) return std::unexpected { "exponent less than 0" };
+
+            std::uint64_t result { 1 };
+            for (; ub != 0; ub >>= 1, ua *= ua)
+                if ((ub & 1) != 0) result *= ua;
+
+            return wrapping(result);
+        }
+
+        default: return std::unexpected { "bad operator" };
+        }
+    }
+
+
+    auto
+    apply(op operation, std::int64_t a) -> std::int64_t
+    {
+        switch (operation)
+        {
+        case op::negate:
+            return wrapping(0 - static_cast<std::uint64_t>(a));
+        case op::complement:  return ~a;
+        case op::logical_not: return a == 0 ? 1 : 0;
+        default:              return a;
+        }
+    }
+
+
+    struct node
+    {
+        enum class kind : std::uint8_t
+        {
+            constant,
+            variable,
+            param,
+            count,
+            status,
+            unary,
+            binary,
+            logical_and,
+            logical_or,
+            ternary,
+            assign,    /* operation is op::constant for a plain = */
+            increment, /* value is the step, ++ or -- */
+            comma,
+        };
+
+        kind                               type;
+        op                                 operation { op::constant };
+        std::int64_t                       value { 0 };
+        environment::slot                  slot { 0 };
+        bool                               postfix { false };
+        std::vector<std::unique_ptr<node>> children;
+    };
+
+    using node_ptr = std::unique_ptr<node>;
+
+
+    auto
+    make_constant(std::int64_t value) -> node_ptr
+    {
+        auto result { std::make_unique<node>(node::kind::constant) };
+        result->value = value;
+        return result;
+    }
+
+
+    struct binary_operator
+    {
+        std::string_view text;
+        op               operation;
+        int              precedence;
+        node::kind       type { node::kind::binary };
+    };
+
+
+    /* the longer ones first, so << isn't taken for < */
+    constexpr std::array BINARY_OPERATORS {
+        binary_operator { "<<=", op::shift_left, 2, node::kind::assign },
+        binary_operator { ">>=", op::shift_right, 2, node::kind::assign },
+        binary_operator { "**", op::power, 14 },
+        binary_operator { "<<", op::shift_left, 11 },
+        binary_operator { ">>", op::shift_right, 11 },
+        binary_operator { "<=", op::less_equal, 10 },
+        binary_operator { ">=", op::greater_equal, 10 },
+        binary_operator { "==", op::equal, 9 },
+        binary_operator { "!=", op::not_equal, 9 },
+        binary_operator { "&&", op::constant, 5, node::kind::logical_and },
+        binary_operator { "||", op::constant, 4, node::kind::logical_or },
+        binary_operator { "+=", op::add, 2, node::kind::assign },
+        binary_operator { "-=", op::subtract, 2, node::kind::assign },
+        binary_operator { "*=", op::multiply, 2, node::kind::assign },
+        binary_operator { "/=", op::divide, 2, node::kind::assign },
+        binary_operator { "%=", op::modulo, 2, node::kind::assign },
+        binary_operator { "&=", op::bit_and, 2, node::kind::assign },
+        binary_operator { "^=", op::bit_xor, 2, node::kind::assign },
+        binary_operator { "|=", op::bit_or, 2, node::kind::assign },
+        binary_operator { "*", op::multiply, 13 },
+        binary_operator { "/", op::divide, 13 },
+        binary_operator { "%", op::modulo, 13 },
+        binary_operator { "+", op::add, 12 },
+        binary_operator { "-", op::subtract, 12 },
+        binary_operator { "<", op::less, 10 },
+        binary_operator { ">", op::greater, 10 },
+        binary_operator { "&", op::bit_and, 8 },
+        binary_operator { "^", op::bit_xor, 7 },
+        binary_operator { "|", op::bit_or, 6 },
+        binary_operator { "?", op::constant, 3, node::kind::ternary },
+        binary_operator { "=", op::constant, 2, node::kind::assign },
+        binary_operator { ",", op::constant, 1, node::kind::comma },
+    };
+
+
+    /**
+     * a precedence climbing parser, folding every operation whose operands
+     * turned out constant as soon as it has them.
+     */
+    class precedence_parser
+    {
+    public:
+        precedence_parser(std::string_view source, environment &env)
+            : m_source(source), m_env(env)
+        {
+        }
+
+
+        auto
+        parse() -> std::expected<node_ptr, std::string>
+        {
+            auto result { mf_expression(1) };
+
+            mf_skip_blank();
+            if (result && m_pos < m_source.length())
+                mf_fail(std::format("unexpected '{}'", m_source.substr(m_pos)));
+
+            if (!m_error.empty()) return std::unexpected { m_error };
+            return result;
+        }
+
+    private:
+        std::string_view m_source;
+        environment     &m_env;
+        std::size_t      m_pos { 0 };
+        std::string      m_error;
+
+
+        auto
+        mf_fail(std::string message) -> node_ptr
+        {
+            if (m_error.empty()) m_error = std::move(message);
+            return nullptr;
+        }
+
+
+        void
+        mf_skip_blank()
+        {
+            while (m_pos < m_source.length()
+                   && std::isspace(static_cast<unsigned char>(m_source[m_pos]))
+                          != 0)
+                m_pos++;
+        }
+
+
+        auto
+        mf_accept(std::string_view text) -> bool
+        {
+            mf_skip_blank();
+            if (!m_source.substr(m_pos).starts_with(text)) return false;
+
+            m_pos += text.length();
+            return true;
+        }
+
+
+        auto
+        mf_expression(int min) -> node_ptr
+        {
+            auto left { mf_unary() };
+
+            while (left)
+            {
+                mf_skip_blank();
+
+                std::string_view rest { m_source.substr(m_pos) };
+                const auto      *it { std::ranges::find_if(
+                    BINARY_OPERATORS, [&](const binary_operator &candidate)
+                    { return rest.starts_with(candidate.text); }) };
+
+                if (it == BINARY_OPERATORS.end() || it->precedence < min)
+                    break;
+                m_pos += it->text.length();
+
+                /* ** and the assignments group to the right, and so does
+                   ?:, whose middle can be anything */
+                bool right { it->precedence <= 3
+                             || it->operation == op::power };
+
+                node_ptr middle;
+                if (it->type == node::kind::ternary)
+                {
+                    middle = mf_expression(1);
+                    if (!middle) return nullptr;
+                    if (!mf_accept(":")) return mf_fail("expected ':'");
+                }
+
+                auto rhs { mf_expression(right ? it->precedence
+                                               : it->precedence + 1) };
+                if (!rhs) return nullptr;
+
+                if (it->type == node::kind::assign
+                    && left->type != node::kind::variable)
+                    return mf_fail("attempted assignment to non-variable");
+
+                left = mf_combine(*it, std::move(left), std::move(middle),
+                                  std::move(rhs));
+            }
+
+            return left;
+        }
+
+
+        auto
+        mf_combine(const binary_operator &info,
+                   node_ptr               left,
+                   node_ptr               middle,
+                   node_ptr               right) -> node_ptr
+        {
+            using enum node::kind;
+
+            bool left_constant { left->type == constant };
+            bool both_constant { left_constant && right->type == constant };
+
+            switch (info.type)
+            {
+            case binary:
+                if (both_constant)
+                    if (auto value { apply(info.operation, left->value,
+                                           right->value) })
+                        return make_constant(*value);
+                break;
+
+            case logical_and: [[fallthrough]];
+            case logical_or:
+            {
+                bool deciding { info.type == logical_and
+                                    ? left_constant && left->value == 0
+                                    : left_constant && left->value != 0 };
+
+                if (deciding) return make_constant(info.type == logical_or);
+                if (both_constant) return make_constant(right->value != 0);
+                break;
+            }
+
+            case ternary:
+                if (left_constant)
+                    return left->value != 0 ? std::move(middle)
+                                            : std::move(right);
+                break;
+
+            default: break;
+            }
+
+            auto result { std::make_unique<node>(info.type, info.operation) };
+
+            if (info.type == assign) result->slot = left->slot;
+
+            result->children.emplace_back(std::move(left));
+            if (middle) result->children.emplace_back(std::move(middle));
+            result->children.emplace_back(std::move(right));
+
+            return result;
+        }
+
+
+        auto
+        mf_unary() -> node_ptr
+        {
+            for (std::int64_t step : { 1, -1 })
+            {
+                if (!mf_accept(step > 0 ? "++" : "--")) continue;
+
+                auto operand { mf_unary() };
+                if (!operand) return nullptr;
+                if (operand->type != node::kind::variable)
+                    return mf_fail("++ and -- need a variable");
+
+                auto result { std::make_unique<node>(node::kind::increment) };
+                result->value = step;
+                result->slot  = operand->slot;
+                return result;
+            }
+
+            constexpr std::array<std::pair<char, op>, 4> PREFIXES {
+                { { '-', op::negate },
+                  { '+', op::constant },
+                  { '!', op::logical_not },
+                  { '~', op::complement } }
+            };
+
+            mf_skip_blank();
+            for (auto [c, operation] : PREFIXES)
+            {
+                if (m_pos >= m_source.length() || m_source[m_pos] != c)
+                    continue;
+                m_pos++;
+
+                auto operand { mf_unary() };
+                if (!operand || operation == op::constant) return operand;
+
+                if (operand->type == node::kind::constant)
+                    return make_constant(apply(operation, operand->value));
+
+                auto result { std::make_unique<node>(node::kind::unary,
+                                                     operation) };
+                result->children.emplace_back(std::move(operand));
+                return result;
+            }
+
+            return mf_postfix(mf_primary());
+        }
+
+
+        auto
+        mf_postfix(node_ptr operand) -> node_ptr
+        {
+            if (!operand || operand->type != node::kind::variable)
+                return operand;
+
+            for (std::int64_t step : { 1, -1 })
+            {
+                if (!mf_accept(step > 0 ? "++" : "--")) continue;
+
+                auto result { std::make_unique<node>(node::kind::increment) };
+                result->value   = step;
+                result->slot    = operand->slot;
+                result->postfix = true;
+                return result;
+            }
+
+            return operand;
+        }
+
+
+        auto
+        mf_primary() -> node_ptr
+        {
+            mf_skip_blank();
+            if (m_pos >= m_source.length())
+                return mf_fail("expected an operand");
+
+            char c { m_source[m_pos] };
+
+            if (c == '(')
+            {
+                m_pos++;
+                auto inner { mf_expression(1) };
+                if (inner && !mf_accept(")")) return mf_fail("expected ')'");
+                return inner;
+            }
+
+            if (std::isdigit(static_cast<unsigned char>(c)) != 0)
+                return mf_number();
+
+            if (c == '$')
+            {
+                m_pos++;
+                return mf_parameter();
+            }
+
+            if (std::isalpha(static_cast<unsigned char>(c)) != 0 || c == '_')
+                return mf_variable(mf_name());
+
+            return mf_fail(std::format("unexpected '{}'", c));
+        }
+
+
+        auto
+        mf_name() -> std::string_view
+        {
+            std::size_t start { m_pos };
+
+            while (m_pos < m_source.length()
+                   && (std::isalnum(static_cast<unsigned char>(m_source[m_pos]))
+                           != 0
+                       || m_source[m_pos] == '_'))
+                m_pos++;
+
+            return m_source.substr(start, m_pos - start);
+        }
+
+
+        auto
+        mf_variable(std::string_view name) -> node_ptr
+        {
+            auto result { std::make_unique<node>(node::kind::variable) };
+            result->slot = m_env.resolve(name);
+            return result;
+        }
+
+
+        /* decimal, 0x hexadecimal and 0 octal */
+        auto
+        mf_number() -> node_ptr
+        {
+            std::string_view rest { m_source.substr(m_pos) };
+            int              base { 10 };
+
+            if (rest.starts_with("0x") || rest.starts_with("0X"))
+                base = 16, rest.remove_prefix(2);
+            else if (rest.length() > 1 && rest.front() == '0'
+                     && std::isdigit(static_cast<unsigned char>(rest[1])) != 0)
+                base = 8, rest.remove_prefix(1);
+
+            std::uint64_t value { 0 };
+            auto [end, ec] { std::from_chars(
+                rest.data(), rest.data() + rest.size(), value, base) };
+
+            if (ec != std::errc {}
+                || (end < rest.data() + rest.size()
+                    && std::isalnum(static_cast<unsigned char>(*end)) != 0))
+                return mf_fail(std::format("invalid number '{}'",
+                                           m_source.substr(m_pos)));
+
+            m_pos = static_cast<std::size_t>(end - m_source.data());
+            return make_constant(wrapping(value));
+        }
+
+
+        /* what follows a $, like in $x, ${x}, $1, $# and $? */
+        auto
+        mf_parameter() -> node_ptr
+        {
+            bool braced { mf_accept("{") };
+            node_ptr result;
+
+            char c { m_pos < m_source.length() ? m_source[m_pos] : '\0' };
+
+            if (c == '#' || c == '?')
+            {
+                m_pos++;
+                result = std::make_unique<node>(c == '#' ? node::kind::count
+                                                         : node::kind::status);
+            }
+            else if (std::isdigit(static_cast<unsigned char>(c)) != 0)
+            {
+                result = std::make_unique<node>(node::kind::param);
+
+                /* only ${10} goes past one digit */
+                do
+                    result->value = result->value * 10
+                                  + (m_source[m_pos++] - '0');
+                while (braced && m_pos < m_source.length()
+                       && std::isdigit(
+                              static_cast<unsigned char>(m_source[m_pos]))
+                              != 0);
+            }
+            else if (std::string_view name { mf_name() }; !name.empty())
+                result = mf_variable(name);
+            else
+                return mf_fail("bad substitution");
+
+            if (braced && !mf_accept("}")) return mf_fail("expected '}'");
+            return result;
+        }
+    };
+
+
+    class generator
+    {
+    public:
+        explicit generator(arithmetic &out) : m_out(out) {}
+
+
+        void
+        generate(const node &current)
+        {
+            using enum node::kind;
+
+            const auto &children { current.children };
+
+            switch (current.type)
+            {
+            case constant: mf_emit(op::constant, current.value); break;
+            case variable: mf_emit(op::load, current.slot); break;
+            case param:    mf_emit(op::param, current.value); break;
+            case count:    mf_emit(op::count); break;
+            case status:   mf_emit(op::status); break;
+
+            case unary:
+                generate(*children[0]);
+                mf_emit(current.operation);
+                break;
+
+            case binary:
+                generate(*children[0]);
+                generate(*children[1]);
+                mf_emit(current.operation);
+                break;
+
+            case logical_and: [[fallthrough]];
+            case logical_or:
+            {
+                /* a && b is 0 as soon as one side is, and a || b is 1 as
+                   soon as one side isn't */
+                op test { current.type == logical_and ? op::jump_if_zero
+                                                      : op::jump_if_set };
+
+                generate(*children[0]);
+                auto left { mf_emit(test) };
+                generate(*children[1]);
+                auto right { mf_emit(test) };
+
+                mf_emit(op::constant, current.type == logical_and);
+                auto end { mf_emit(op::jump) };
+
+                mf_patch(left);
+                mf_patch(right);
+                mf_emit(op::constant, current.type == logical_or);
+                mf_patch(end);
+                break;
+            }
+
+            case ternary:
+            {
+                generate(*children[0]);
+                auto otherwise { mf_emit(op::jump_if_zero) };
+
+                generate(*children[1]);
+                auto end { mf_emit(op::jump) };
+
+                mf_patch(otherwise);
+                generate(*children[2]);
+                mf_patch(end);
+                break;
+            }
+
+            case assign:
+                if (current.operation != op::constant)
+                    mf_emit(op::load, current.slot);
+
+                generate(*children[1]);
+
+                if (current.operation != op::constant)
+                    mf_emit(current.operation);
+                mf_emit(op::store, current.slot);
+                break;
+
+            case increment:
+                mf_emit(op::load, current.slot);
+                if (current.postfix) mf_emit(op::load, current.slot);
+
+                mf_emit(op::constant, current.value);
+                mf_emit(op::add);
+                mf_emit(op::store, current.slot);
+
+                if (current.postfix) mf_emit(op::pop);
+                break;
+
+            case comma:
+                generate(*children[0]);
+                mf_emit(op::pop);
+                generate(*children[1]);
+                break;
+            }
+        }
+
+    private:
+        arithmetic &m_out;
+
+
+        auto
+        mf_emit(op code, std::int64_t value = 0) -> std::size_t
+        {
+            m_out.steps.emplace_back(code, value);
+            return m_out.steps.size() - 1;
+        }
+
+
+        void
+        mf_patch(std::size_t at)
+        {
+            m_out.steps[at].value = static_cast<std::int64_t>(
+                m_out.steps.size());
+        }
+    };
+
+
+    auto
+    to_integer(std::string_view name, const std::string *value)
+        -> std::expected<std::int64_t, std::string>
+    {
+        if (value == nullptr || value->empty()) return 0;
+
+        std::int64_t result { 0 };
+        auto [end, ec] { std::from_chars(value->data(),
+                                         value->data() + value->size(),
+                                         result) };
+
+        if (ec != std::errc {} || end != value->data() + value->size())
+            return std::unexpected { std::format("{}: '{}' is not an integer",
+                                                 name, *value) };
+        return result;
+    }
+}
+
+
+auto
+arithmetic::constant() const -> std::optional<std::int64_t>
+{
+    if (!error.empty() || steps.size() != 1 || steps[0].code != op::constant)
+        return std::nullopt;
+    return steps[0].value;
+}
+
+
+auto
+impl::compile_arithmetic(std::string_view source, environment &env)
+    -> arithmetic
+{
+    arithmetic result;
+
+    auto tree { precedence_parser { source, env }.parse() };
+    if (!tree)
+        result.error = std::format("{}: {}", source, tree.error());
+    else
+        generator { result }.generate(**tree);
+
+    return result;
+}
+
+
+auto
+impl::evaluate(const arithmetic                 &expression,
+               environment                      &env,
+               std::span<const std::string_view> params,
+               int status) -> std::expected<std::int64_t, std::string>
+{
+    if (!expression.error.empty())
+        return std::unexpected { expression.error };
+
+    shared::inline_stack<std::int64_t, 32> stack;
+
+    auto pop { [&]
+               {
+                   std::int64_t value { stack.top() };
+                   stack.pop();
+                   return value;
+               } };
+
+    const auto &steps { expression.steps };
+
+    for (std::size_t pc { 0 }; pc < steps.size();)
+    {
+        const auto [code, value] { steps[pc++] };
+        auto slot { static_cast<environment::slot>(value) };
+
+        switch (code)
+        {
+        case op::constant: stack.push(value); break;
+
+        case op::load:
+        {
+            auto loaded { to_integer(env.name(slot), env.get(slot)) };
+            if (!loaded) return loaded;
+
+            stack.push(*loaded);
+            break;
+        }
+
+        case op::store: env.set(slot, std::to_string(stack.top())); break;
+
+        case op::param:
+        {
+            auto index { static_cast<std::size_t>(value) };
+            if (index == 0 || index > params.size())
+            {
+                stack.push(0);
+                break;
+            }
+
+            std::string copy { params[index - 1] };
+            auto loaded { to_integer(std::format("${}", index), &copy) };
+            if (!loaded) return loaded;
+
+            stack.push(*loaded);
+            break;
+        }
+
+        case op::count:
+            stack.push(static_cast<std::int64_t>(params.size()));
+            break;
+
+        case op::status: stack.push(status); break;
+        case op::pop:    stack.pop(); break;
+
+        case op::negate:      [[fallthrough]];
+        case op::complement:  [[fallthrough]];
+        case op::logical_not: stack.push(apply(code, pop())); break;
+
+        case op::jump: pc = static_cast<std::size_t>(value); break;
+
+        case op::jump_if_zero:
+            if (pop() == 0) pc = static_cast<std::size_t>(value);
+            break;
+
+        case op::jump_if_set:
+            if (pop() != 0) pc = static_cast<std::size_t>(value);
+            break;
+
+        default:
+        {
+            std::int64_t right { pop() };
+            std::int64_t left { pop() };
+
+            auto result { apply(code, left, right) };
+            if (!result)
+                return std::unexpected { std::string { result.error() } };
+
+            stack.push(*result);
+            break;
+        }
+        }
+    }
+
+    return stack.empty() ? 0 : stack.top();
+}
@@ -0,0 +1,49 @@
+#include <string>
+
+#include "interpreter.hh"
+#include "shared.hh"
+
+using namespace cchell::interpreter;
+
+
+void
+impl::bind(binding &target, const environment &env)
+{
+    if (target.generation == env.generation()) return;
+
+    target.generation = env.generation();
+    target.function.reset();
+    target.path.clear();
+
+    if (auto function { env.function(target.name) })
+    {
+        target.type     = binding::kind::function;
+        target.function = function;
+        return;
+    }
+
+    if (auto index { find_builtin(target.name) })
+    {
+        target.type    = binding::kind::builtin;
+        target.builtin = *index;
+        return;
+    }
+
+    if (target.name.contains('/'))
+    {
+        target.type = binding::kind::program;
+        target.path = target.name;
+        return;
+    }
+
+    env.refresh_executables();
+
+    if (const auto *path { cchell::shared::executables.find(target.name) })
+    {
+        target.type = binding::kind::program;
+        target.path = path->string();
+        return;
+    }
+
+    target.type = binding::kind::missing;
+}
@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "interpreter.hh"
+
+using namespace cchell::interpreter;
+
+
+namespace
+{
+    /* every argument is null-terminated, see impl::arguments */
+    using args_t = std::span<const std::string_view>;
+
+
+    auto
+    to_int(std::string_view string) -> std::optional<long long>
+    {
+        long long value { 0 };
+        auto [end, ec] { std::from_chars(string.data(),
+                                         string.data() + string.size(), value) };
+
+        if (ec != std::errc {} || end != string.data() + string.size())
+            return std::nullopt;
+        return value;
+    }
+
+
+    auto
+    do_true(args_t /* args */, environment & /* env */) -> int
+    {
+        return 0;
+    }
+
+
+    auto
+    do_false(args_t /* args */, environment & /* env */) -> int
+    {
+        return 1;
+    }
+
+
+    auto
+    do_echo(args_t args, environment & /* env */) -> int
+    {
+        bool        newline { args.size() < 2 || args[1] != "-n" };
+        std::size_t first { newline ? 1UZ : 2UZ };
+
+        std::string line;
+        for (std::size_t i { first }; i < args.size(); i++)
+        {
+            if (i > first) line += ' ';
+            line += args[i];
+        }
+
+        if (newline) line += '\n';
+        std::cout << line;
+
+        return 0;
+    }
+
+
+    auto
+    do_cd(args_t args, environment &env) -> int
+    {
+        environment::slot home { env.resolve("HOME") };
+        environment::slot pwd { env.resolve("PWD") };
+        environment::slot oldpwd { env.resolve("OLDPWD") };
+
+        std::string target;
+
+        if (args.size() < 2)
+        {
+            const auto *value { env.get(home) };
+            if (value == nullptr)
+                return std::println(std::cerr, "cchell: cd: $HOME is not set"),
+                       1;
+            target = *value;
+        }
+        else if (args[1] == "-")
+        {
+            const auto *value { env.get(oldpwd) };
+            if (value == nullptr)
+                return std::println(std::cerr,
+                                    "cchell: cd: $OLDPWD is not set"),
+                       1;
+            target = *value;
+            std::cout << target << '\n';
+        }
+        else
+            target = args[1];
+
+        std::error_code ec;
+        std::string     old { std::filesystem::current_path(ec).string() };
+
+        if (chdir(target.c_str()) < 0)
+            return std::println(std::cerr, "cchell: cd: {}: {}", target,
+                                std::strerror(errno)),
+                   1;
+
+        env.set(oldpwd, old);
+        env.set(pwd, std::filesystem::current_path(ec).string());
+        env.mark_exported(oldpwd);
+        env.mark_exported(pwd);
+
+        return 0;
+    }
+
+
+    auto
+    do_exit(args_t args, environment &env) -> int
+    {
+        int status { 0 };
+
+        if (args.size() > 1)
+        {
+            auto value { to_int(args[1]) };
+            if (!value)
+                return std::println(std::cerr,
+                                    "cchell: exit: {}: numeric argument "
+                                    "required",
+                                    args[1]),
+                       2;
+            status = static_cast<int>(*value & 0xff);
+        }
+
+        env.request_exit(status);
+        return status;
+    }
+
+
+    auto
+    do_export(args_t args, environment &env) -> int
+    {
+        if (args.size() < 2)
+        {
+            for (char **entry { env.envp() }; *entry != nullptr; entry++)
+                std::cout << "export " << *entry << '\n';
+            return 0;
+        }
+
+        for (std::string_view arg : args.subspan(1))
+        {
+            std::size_t       idx { arg.find('=') };
+            environment::slot slot { env.resolve(arg.substr(0, idx)) };
+
+            if (idx != std::string_view::npos)
+                env.set(slot, arg.substr(idx + 1));
+            env.mark_exported(slot);
+        }
+
+        return 0;
+    }
+
+
+    auto
+    do_unset(args_t args, environment &env) -> int
+    {
+        for (std::string_view arg : args.subspan(1))
+            env.unset(env.resolve(arg));
+
+        return 0;
+    }
+
+
+    /* reaching these means there was no loop to leave */
+    auto
+    do_loop_control(args_t args, environment & /* env */) -> int
+    {
+        std::println(std::cerr, "cchell: {}: only meaningful in a loop",
+                     args[0]);
+        return 0;
+    }
+
+
+    /* and this one means there was no function to return from */
+    auto
+    do_return(args_t /* args */, environment & /* env */) -> int
+    {
+        std::println(std::cerr,
+                     "cchell: return: only meaningful in a function");
+        return 1;
+    }
+
+
+    auto
+    test_unary(std::string_view op, std::string_view operand)
+        -> std::optional<bool>
+    {
+        if (op == "-n") return !operand.empty();
+        if (op == "-z") return operand.empty();
+
+        struct stat st {};
+        bool        exists { op == "-L" || op == "-h"
+                                 ? lstat(operand.data(), &st) == 0
+                                 : stat(operand.data(), &st) == 0 };
+
+        if (op == "-e") return exists;
+        if (op == "-f") return exists && S_ISREG(st.st_mode);
+        if (op == "-d") return exists && S_ISDIR(st.st_mode);
+        if (op == "-s") return exists && st.st_size > 0;
+        if (op == "-L" || op == "-h") return exists && S_ISLNK(st.st_mode);
+        if (op == "-r") return access(operand.data(), R_OK) == 0;
+        if (op == "-w") return access(operand.data(), W_OK) == 0;
+        if (op == "-x") return access(operand.data(), X_OK) == 0;
+
+        return std::nullopt;
+    }
+
+
+    auto
+    test_binary(std::string_view left,
+                std::string_view op,
+                std::string_view right) -> std::optional<bool>
+    {
+        if (op == "=" || op == "==") return left == right;
+        if (op == "!=") return left != right;
+
+        auto lhs { to_int(left) };
+        auto rhs { to_int(right) };
+        if (!lhs || !rhs) return std::nullopt;
+
+        if (op == "-eq") return *lhs == *rhs;
+        if (op == "-ne") return *lhs != *rhs;
+        if (op == "-lt") return *lhs < *rhs;
+        if (op == "-le") return *lhs <= *rhs;
+        if (op == "-gt") return *lhs > *rhs;
+        if (op == "-ge") return *lhs >= *rhs;
+
+        return std::nullopt;
+    }
+
+
+    /* the expression without the command name, returns 2 on a bad one */
+    auto
+    test_expression(args_t args) -> int
+    {
+        if (!args.empty() && args[0] == "!" && args.size() > 1)
+        {
+            int res { test_expression(args.subspan(1)) };
+            return res == 2 ? 2 : 1 - res;
+        }
+
+        std::optional<bool> res;
+
+        switch (args.size())
+        {
+        case 0: return 1;
+        case 1: return args[0].empty() ? 1 : 0;
+        case 2: res = test_unary(args[0], args[1]); break;
+        case 3: res = test_binary(args[0], args[1], args[2]); break;
+        default: break;
+        }
+
+        if (!res)
+        {
+            std::println(std::cerr, "cchell: test: invalid expression");
+            return 2;
+        }
+
+        return *res ? 0 : 1;
+    }
+
+
+    auto
+    do_test(args_t args, environment & /* env */) -> int
+    {
+        if (args[0] == "[")
+        {
+            if (args.back() != "]")
+                return std::println(std::cerr, "cchell: [: missing ']'"), 2;
+            args = args.first(args.size() - 1);
+        }
+
+        return test_expression(args.subspan(1));
+    }
+
+
+    /**
+     * reads the -j option of batch and parallel, if @param args start with
+     * it, moving @param first past it. 0 means one job per CPU.
+     */
+    auto
+    job_count(args_t args, std::size_t &first, std::size_t fallback)
+        -> std::optional<std::size_t>
+    {
+        first = 1;
+        if (args.size() < 2 || !args[1].starts_with("-j")) return fallback;
+
+        std::string_view count { args[1].substr(2) };
+        first = 2;
+
+        if (count.empty() && args.size() > 2) count = args[first++];
+
+        auto value { to_int(count) };
+        if (!value || *value < 0)
+            return std::println(std::cerr, "cchell: {}: {}: invalid job count",
+                                args[0], count),
+                   std::nullopt;
+
+        if (*value == 0)
+            return static_cast<std::size_t>(
+                std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)));
+        return static_cast<std::size_t>(*value);
+    }
+
+
+    /* resolves @param name for batch and parallel, which can't run just
+       anything */
+    auto
+    job_target(std::string_view caller, std::string_view name,
+               environment &env, bool programs_only) -> std::optional<binding>
+    {
+        binding target { .name = std::string { name } };
+        impl::bind(target, env);
+
+        if (target.type == binding::kind::missing
+            || (programs_only && target.type != binding::kind::program))
+            return std::println(std::cerr, "cchell: {}: {}: {}", caller, name,
+                                target.type == binding::kind::missing
+                                    ? "command not found"
+                                    : "not a program"),
+                   std::nullopt;
+
+        return target;
+    }
+
+
+    /**
+     * batch [-j jobs] command [args...] [-- items...]
+     *
+     * runs command with as many of the items at a time as fit into one
+     * execve, rather than failing with E2BIG on a huge expansion. without
+     * a --, the options right after command stay with it, as in batch rm
+     * -f *, and everything after them is an item. -j runs that many
+     * batches at once, 0 being one per CPU.
+     */
+    auto
+    do_batch(args_t args, environment &env) -> int
+    {
+        std::size_t first { 1 };
+
+        auto jobs { job_count(args, first, 1) };
+        if (!jobs) return 2;
+
+        if (first >= args.size())
+            return std::println(
+                       std::cerr,
+                       "cchell: batch: usage: batch [-j jobs] command "
+                       "[args...] [-- items...]"),
+                   2;
+
+        args_t      command { args.subspan(first) };
+        std::size_t split { 1 };
+        std::size_t skip { 0 }; /* the -- itself */
+
+        if (auto it { std::ranges::find(command, "--") }; it != command.end())
+        {
+            split = static_cast<std::size_t>(it - command.begin());
+            skip  = 1;
+        }
+        else
+            while (split < command.size() && command[split].starts_with('-')
+                   && command[split] != "-")
+                split++;
+
+        args_t fixed { command.first(split) };
+        args_t items { command.subspan(split + skip) };
+
+        auto target { job_target("batch", command.front(), env, true) };
+        if (!target) return 127;
+
+        char **envp { env.envp() };
+
+        auto ends { impl::plan_batches(fixed, items, envp) };
+        if (!ends)
+            return std::println(std::cerr, "cchell: batch: {}", ends.error()),
+                   1;
+
+        return impl::run_batches(target->path, fixed, items, *ends, *jobs,
+                                 envp);
+    }
+
+
+    /**
+     * parallel [-j jobs] command [args...] ::: items...
+     *
+     * runs command once per item, with the item as its last argument, as
+     * many at a time as there are CPUs unless -j says otherwise. command can
+     * be a function, which is how a loop body is run in parallel. whatever
+     * the jobs print comes out in the order of the items.
+     */
+    auto
+    do_parallel(args_t args, environment &env) -> int
+    {
+        std::size_t first { 1 };
+
+        auto jobs { job_count(args, first, 0) };
+        if (!jobs) return 2;
+
+        args_t command { args.subspan(first) };
+        auto   separator { std::ranges::find(command, ":::") };
+
+        if (command.empty() || separator == command.begin()
+            || separator == command.end())
+            return std::println(std::cerr,
+                                "cchell: parallel: usage: parallel [-j jobs] "
+                                "command [args...] ::: items..."),
+                   2;
+
+        auto   split { static_cast<std::size_t>(separator - command.begin()) };
+        args_t items { command.subspan(split + 1) };
+
+        auto target { job_target("parallel", command.front(), env, false) };
+        if (!target) return 127;
+
+        /* every job's arguments are the fixed ones and its own item */
+        std::vector<std::string_view> views { command.begin(), separator };
+        views.emplace_back();
+
+        std::vector<char *> argv;
+        for (std::string_view arg : views)
+            argv.emplace_back(const_cast<char *>(arg.data()));
+        argv.emplace_back(nullptr);
+
+        char **envp { env.envp() };
+
+        impl::scheduler running { *jobs };
+
+        for (std::string_view item : items)
+        {
+            views.back()          = item;
+            argv[argv.size() - 2] = const_cast<char *>(item.data());
+
+            auto pid { running.fork() };
+            if (!pid)
+            {
+                std::println(std::cerr, "cchell: parallel: {}", pid.error());
+                return running.wait(), 1;
+            }
+
+            if (*pid > 0) continue;
+
+            int status { 0 };
+
+            switch (target->type)
+            {
+            case binding::kind::program:
+                execve(target->path.c_str(), argv.data(), envp);
+                std::println(std::cerr, "cchell: {}: {}", target->name,
+                             std::strerror(errno));
+                _exit(errno == ENOENT ? 127 : 126);
+
+            case binding::kind::builtin:
+                status = impl::run_builtin(target->builtin, views, env);
+                break;
+
+            default:
+            {
+                auto res { execute(*target->function.lock(), env,
+                                   std::span { views }.subspan(1)) };
+                if (!res) std::println(std::cerr, "cchell: {}", res.error());
+                status = res.value_or(1);
+                break;
+            }
+            }
+
+            std::cout.flush();
+            _exit(status);
+        }
+
+        return running.wait();
+    }
+
+
+    struct entry
+    {
+        std::string_view name;
+        impl::builtin    run;
+        bool             special { false }; /* as POSIX has them */
+    };
+
+
+    constexpr std::array BUILTINS {
+        entry { ":", do_true, true },
+        entry { "[", do_test },
+        entry { "batch", do_batch },
+        entry { "break", do_loop_control, true },
+        entry { "cd", do_cd },
+        entry { "continue", do_loop_control, true },
+        entry { "echo", do_echo },
+        entry { "exit", do_exit, true },
+        entry { "export", do_export, true },
+        entry { "false", do_false },
+        entry { "parallel", do_parallel },
+        entry { "return", do_return, true },
+        entry { "test", do_test },
+        entry { "true", do_true },
+        entry { "unset", do_unset, true },
+    };
+}
+
+
+auto
+impl::find_builtin(std::string_view name) -> std::optional<std::uint32_t>
+{
+    const auto *it { std::ranges::find(BUILTINS, name, &entry::name) };
+    if (it == BUILTINS.end()) return std::nullopt;
+
+    return static_cast<std::uint32_t>(it - BUILTINS.begin());
+}
+
+
+auto
+impl::is_special_builtin(std::uint32_t index) -> bool
+{
+    return BUILTINS[index].special;
+}
+
+
+auto
+impl::run_builtin(std::uint32_t                     index,
+                  std::span<const std::string_view> args,
+                  environment                      &env) -> int
+{
+    return BUILTINS[index].run(args, env);
+}
+
+
+auto
+cchell::interpreter::is_builtin(std::string_view name) -> bool
+{
+    return impl::find_builtin(name).has_value();
+}
@@ -0,0 +1,47 @@
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "interpreter.hh"
+
+using namespace cchell::interpreter;
+
+
+cache::cache(std::size_t capacity) : m_capacity(capacity == 0 ? 1 : capacity)
+{
+}
+
+
+auto
+cache::find(std::string_view source) -> const chunk *
+{
+    auto it { m_index.find(source) };
+    if (it == m_index.end()) return nullptr;
+
+    /* most recently used entries are kept at the front */
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &it->second->second;
+}
+
+
+auto
+cache::insert(std::string_view source, chunk code) -> const chunk &
+{
+    if (auto it { m_index.find(source) }; it != m_index.end())
+    {
+        it->second->second = std::move(code);
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->second;
+    }
+
+    if (m_entries.size() == m_capacity)
+    {
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+    }
+
+    m_entries.emplace_front(std::string { source }, std::move(code));
+    m_index.emplace(m_entries.front().first, m_entries.begin());
+
+    return m_entries.front().second;
+}
@@ -0,0 +1,1137 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "glob.hh"
+#include "interpreter.hh"
+#include "parser.hh"
+
+using namespace cchell::interpreter;
+using namespace cchell::parser;
+using cchell::interpreter::impl::compile_arithmetic;
+using cchell::interpreter::impl::parse_braces;
+
+
+namespace
+{
+    auto
+    is_name_start(char c) -> bool
+    {
+        return std::isalpha(static_cast<unsigned char>(c)) != 0 || c == '_';
+    }
+
+
+    auto
+    is_name_char(char c) -> bool
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) != 0 || c == '_';
+    }
+
+
+    /* a piece of a word, either literal text or what to expand */
+    struct segment
+    {
+        enum class kind : std::uint8_t
+        {
+            literal,
+            variable,   /* $name and ${name} */
+            positional, /* $1 and ${10} */
+            special,    /* $?, $#, $@, $* and $$ */
+            arithmetic, /* $(( )), text being what's inside */
+        };
+
+        std::string text;
+        kind        type;
+        bool        quoted { false }; /* so not split into fields */
+
+        /* set for ${parameter<op>word}, along with its words */
+        std::optional<modifier>  op;
+        bool                     colon { false };
+        std::vector<std::string> words;
+    };
+
+
+    /* how many words @param op takes, and whether the first is a pattern */
+    auto
+    words_of(modifier op) -> std::pair<std::size_t, bool>
+    {
+        switch (op)
+        {
+        case modifier::length:                return { 0, false };
+        case modifier::replace:               [[fallthrough]];
+        case modifier::replace_all:           return { 2, true };
+        case modifier::remove_prefix:         [[fallthrough]];
+        case modifier::remove_longest_prefix: [[fallthrough]];
+        case modifier::remove_suffix:         [[fallthrough]];
+        case modifier::remove_longest_suffix: return { 1, true };
+        default:                              return { 1, false };
+        }
+    }
+
+
+    /**
+     * where the } ending the ${ before @param rest is, skipping anything
+     * quoted and nested ${}.
+     */
+    auto
+    closing_brace(std::string_view rest) -> std::size_t
+    {
+        std::size_t depth { 0 };
+        char        quote { '\0' };
+
+        for (std::size_t i { 0 }; i < rest.length(); i++)
+        {
+            char c { rest[i] };
+
+            if (quote == '\'')
+            {
+                if (c == '\'') quote = '\0';
+                continue;
+            }
+
+            if (c == '\\')
+                i++;
+            else if (c == '"' || (c == '\'' && quote == '\0'))
+                quote = quote == c ? '\0' : c;
+            else if (c == '$' && i + 1 < rest.length() && rest[i + 1] == '{')
+                depth++, i++;
+            else if (c == '}' && quote == '\0' && depth-- == 0)
+                return i;
+        }
+
+        return std::string_view::npos;
+    }
+
+
+    /* the length of the parameter name @param rest starts with */
+    auto
+    name_length(std::string_view rest, bool braced) -> std::size_t
+    {
+        if (rest.empty()) return 0;
+
+        std::size_t end { 0 };
+
+        if (is_name_start(rest.front()))
+            while (end < rest.length() && is_name_char(rest[end])) end++;
+        else if (braced)
+            while (end < rest.length()
+                   && std::isdigit(static_cast<unsigned char>(rest[end])) != 0)
+                end++;
+
+        return end;
+    }
+
+
+    /* splits the words of ${p/pattern/word} on the first unquoted / */
+    auto
+    split_replacement(std::string_view body) -> std::vector<std::string>
+    {
+        char quote { '\0' };
+
+        for (std::size_t i { 0 }; i < body.length(); i++)
+        {
+            char c { body[i] };
+
+            if (quote == '\'')
+            {
+                if (c == '\'') quote = '\0';
+                continue;
+            }
+
+            if (c == '\\')
+                i++;
+            else if (c == '"' || (c == '\'' && quote == '\0'))
+                quote = quote == c ? '\0' : c;
+            else if (c == '/' && quote == '\0')
+                return { std::string { body.substr(0, i) },
+                         std::string { body.substr(i + 1) } };
+        }
+
+        return { std::string { body }, std::string {} };
+    }
+
+
+    /* what follows the name in ${name<rest>}, false if it makes no sense */
+    auto
+    parse_modifier(std::string_view rest, segment &out) -> bool
+    {
+        using enum modifier;
+
+        struct entry
+        {
+            std::string_view text;
+            modifier         op;
+        };
+
+        /* the longer ones first, so ## isn't taken for # */
+        constexpr std::array OPERATORS {
+            entry { "-", use_default },
+            entry { "=", assign_default },
+            entry { "+", use_alternative },
+            entry { "?", error_if_unset },
+            entry { "##", remove_longest_prefix },
+            entry { "#", remove_prefix },
+            entry { "%%", remove_longest_suffix },
+            entry { "%", remove_suffix },
+            entry { "//", replace_all },
+            entry { "/", replace },
+        };
+
+        out.colon = rest.starts_with(':');
+        if (out.colon) rest.remove_prefix(1);
+
+        for (const auto &[text, op] : OPERATORS)
+        {
+            if (!rest.starts_with(text)) continue;
+
+            /* the colon only goes with the first four */
+            if (out.colon && op > error_if_unset) return false;
+
+            std::string_view body { rest.substr(text.length()) };
+
+            out.op = op;
+            if (op == replace || op == replace_all)
+                out.words = split_replacement(body);
+            else
+                out.words.emplace_back(body);
+
+            return true;
+        }
+
+        return false;
+    }
+
+
+    /* everything between ${ and }, in @param inner */
+    auto
+    parse_braced(std::string_view inner) -> std::optional<segment>
+    {
+        using enum segment::kind;
+
+        segment result { {}, variable };
+
+        if (inner.length() > 1 && inner.front() == '#')
+        {
+            std::string_view name { inner.substr(1) };
+            if (name_length(name, true) != name.length()) return std::nullopt;
+
+            inner    = name;
+            result.op = modifier::length;
+        }
+
+        std::size_t length { name_length(inner, true) };
+
+        if (length == 0 && !result.op && !inner.empty()
+            && std::string_view { "?#@*$" }.contains(inner.front()))
+        {
+            if (inner.length() != 1) return std::nullopt;
+            return segment { std::string { inner }, special };
+        }
+
+        if (length == 0) return std::nullopt;
+
+        result.text = inner.substr(0, length);
+        result.type = is_name_start(result.text.front()) ? variable : positional;
+
+        if (length < inner.length()
+            && !parse_modifier(inner.substr(length), result))
+            return std::nullopt;
+
+        return result;
+    }
+
+
+    /**
+     * the parameter after a $ at the start of @param rest, along with how
+     * much of @param rest it takes up.
+     */
+    auto
+    parameter_at(std::string_view rest)
+        -> std::optional<std::pair<segment, std::size_t>>
+    {
+        using enum segment::kind;
+
+        char first { rest.front() };
+
+        if (rest.starts_with("(("))
+        {
+            std::size_t depth { 0 };
+
+            for (std::size_t i { 2 }; i < rest.length(); i++)
+            {
+                if (rest[i] == '(') depth++;
+                if (rest[i] != ')') continue;
+
+                if (depth > 0)
+                    depth--;
+                else if (i + 1 < rest.length() && rest[i + 1] == ')')
+                    return std::pair {
+                        segment { std::string { rest.substr(2, i - 2) },
+                                  arithmetic },
+                        i + 2
+                    };
+                else
+                    return std::nullopt;
+            }
+
+            return std::nullopt;
+        }
+
+        if (std::isdigit(static_cast<unsigned char>(first)) != 0)
+            return std::pair { segment { std::string { first }, positional },
+                               1UZ };
+
+        if (std::string_view { "?#@*$" }.contains(first))
+            return std::pair { segment { std::string { first }, special },
+                               1UZ };
+
+        if (first == '{')
+        {
+            std::size_t end { closing_brace(rest.substr(1)) };
+            if (end == std::string_view::npos) return std::nullopt;
+
+            auto parameter { parse_braced(rest.substr(1, end)) };
+            if (!parameter) return std::nullopt;
+
+            return std::pair { std::move(*parameter), end + 2 };
+        }
+
+        std::size_t length { name_length(rest, false) };
+        if (length == 0) return std::nullopt;
+
+        return std::pair { segment { std::string { rest.substr(0, length) },
+                                     variable },
+                           length };
+    }
+
+
+    /**
+     * splits @param word into its segments, removing the quoting on the way.
+     * for a @param pattern, quoted glob characters are escaped instead, so
+     * they only match themselves.
+     */
+    auto
+    split_word(std::string_view word, bool pattern) -> std::vector<segment>
+    {
+        std::vector<segment> segments;
+        std::string          literal;
+        char                 quote { '\0' };
+
+        /* "" still makes a word, even with nothing else in it, which
+           quoted expansions and literals take care of on their own */
+        bool quoted { false };
+        bool marked { false };
+
+        auto add_quoted { [&](char c)
+                          {
+                              if (pattern
+                                  && std::string_view { "*?[]\\" }.contains(c))
+                                  literal += '\\';
+                              literal += c;
+                          } };
+
+        auto flush { [&](bool last)
+                     {
+                         if (!literal.empty() || (last && quoted && !marked))
+                         {
+                             segments.emplace_back(std::move(literal),
+                                                   segment::kind::literal);
+                             marked = true;
+                         }
+                         literal.clear();
+                     } };
+
+        for (std::size_t i { 0 }; i < word.length(); i++)
+        {
+            char c { word[i] };
+
+            if (quote == '\'')
+            {
+                if (c == '\'')
+                    quote = '\0';
+                else
+                    add_quoted(c);
+                continue;
+            }
+
+            if (c == '\\' && i + 1 < word.length())
+            {
+                char next { word[i + 1] };
+
+                /* inside double quotes, only a few characters are
+                   escapable */
+                if (quote == '"'
+                    && std::string_view { "\"\\$`" }.find(next)
+                           == std::string_view::npos)
+                    add_quoted(c);
+
+                if (next != '\n') add_quoted(next);
+                i++;
+                continue;
+            }
+
+            if (c == '"' || (c == '\'' && quote == '\0'))
+            {
+                quote  = quote == c ? '\0' : c;
+                quoted = true;
+                continue;
+            }
+
+            if (c == '$' && i + 1 < word.length())
+            {
+                if (auto parameter { parameter_at(word.substr(i + 1)) })
+                {
+                    flush(false);
+
+                    parameter->first.quoted = quote == '"';
+                    marked                  = marked || quote == '"';
+                    segments.emplace_back(std::move(parameter->first));
+                    i += parameter->second;
+                    continue;
+                }
+            }
+
+            if (quote == '"')
+                add_quoted(c);
+            else
+                literal += c;
+        }
+
+        flush(true);
+        return segments;
+    }
+
+
+    /* up to this many words, braces are expanded while compiling */
+    constexpr std::uint64_t EAGER_BRACES { 64 };
+
+
+    /* whether the unquoted parts of a word have glob characters */
+    auto
+    is_glob(const std::vector<segment> &segments) -> bool
+    {
+        return std::ranges::any_of(
+            segments,
+            [](const segment &part)
+            {
+                return part.type == segment::kind::literal
+                       && cchell::glob::has_magic(part.text);
+            });
+    }
+
+
+    /* the text of @param word if it doesn't expand to anything */
+    auto
+    literal_of(std::string_view word) -> std::optional<std::string>
+    {
+        auto segments { split_word(word, false) };
+
+        if (segments.size() != 1
+            || segments.front().type != segment::kind::literal)
+            return std::nullopt;
+        return std::move(segments.front().text);
+    }
+
+
+    /* the number @param word is, when it's a literal one */
+    auto
+    count_of(std::string_view word) -> std::optional<std::int64_t>
+    {
+        auto text { literal_of(word) };
+        if (!text) return std::nullopt;
+
+        std::int64_t value { 0 };
+        auto [end, ec] { std::from_chars(
+            text->data(), text->data() + text->size(), value) };
+
+        if (ec != std::errc {} || end != text->data() + text->size())
+            return std::nullopt;
+        return value;
+    }
+
+
+    class compiler
+    {
+    public:
+        compiler(const ast &tree, environment &env, chunk &code)
+            : m_tree(tree), m_env(env), m_code(code)
+        {
+        }
+
+
+        /* compiles the body of a function, where return can be used */
+        void
+        function(node_index body)
+        {
+            m_function = true;
+
+            const ast_node &current { m_tree[body] };
+
+            /* a brace group doesn't need anything else than its list */
+            if (current.type == ast_type::group)
+                mf_list(body);
+            else
+                node(body);
+
+            for (std::uint32_t jump : m_returns) mf_patch(jump);
+        }
+
+
+        void
+        node(node_index index)
+        {
+            const ast_node &current { m_tree[index] };
+
+            switch (current.type)
+            {
+            case ast_type::statement: [[fallthrough]];
+            case ast_type::group:     [[fallthrough]];
+            case ast_type::list:      mf_list(index); break;
+
+            case ast_type::subshell:
+            {
+                std::uint32_t fork { mf_emit(opcode::fork) };
+                mf_forked(index);
+                mf_patch(fork);
+                mf_emit(opcode::wait);
+                break;
+            }
+
+            case ast_type::and_if: [[fallthrough]];
+            case ast_type::or_if:
+            {
+                node(current.first_child);
+
+                std::uint32_t skip { mf_emit(current.type == ast_type::and_if
+                                                 ? opcode::jump_if_failure
+                                                 : opcode::jump_if_success) };
+                node(current.last_child);
+                mf_patch(skip);
+                break;
+            }
+
+            case ast_type::pipeline:
+            {
+                for (node_index child : m_tree.children(index))
+                {
+                    if (m_tree[child].next_sibling != null_node)
+                        mf_emit(opcode::pipe);
+
+                    std::uint32_t fork { mf_emit(opcode::fork) };
+                    mf_forked(child);
+                    mf_patch(fork);
+                }
+
+                mf_emit(opcode::wait);
+                break;
+            }
+
+            case ast_type::simple_command:
+                mf_simple(index, opcode::spawn);
+                break;
+
+            case ast_type::while_clause:
+                mf_while(index, opcode::jump_if_failure);
+                break;
+
+            case ast_type::until_clause:
+                mf_while(index, opcode::jump_if_success);
+                break;
+
+            case ast_type::if_clause:    mf_if(index); break;
+            case ast_type::for_clause:   mf_for(index); break;
+            case ast_type::case_clause:  mf_case(index); break;
+            case ast_type::function_def: mf_define(index); break;
+
+            default: break;
+            }
+        }
+
+        /* a single argument, see impl::compile_word() */
+        void
+        word(std::string_view word)
+        {
+            mf_word(word, instruction { opcode::push_arg });
+        }
+
+    private:
+        /* the targets of break and continue */
+        struct loop
+        {
+            std::uint32_t              top;
+            std::vector<std::uint32_t> breaks;
+        };
+
+        const ast   &m_tree;
+        environment &m_env;
+        chunk       &m_code;
+
+        std::vector<loop> m_loops;
+        std::uint16_t     m_depth { 0 };
+
+        bool                       m_function { false };
+        std::vector<std::uint32_t> m_returns;
+
+        std::unordered_map<std::string, std::uint32_t> m_bindings;
+
+
+        auto
+        mf_emit(opcode op, std::uint32_t operand = 0, std::uint16_t reg = 0)
+            -> std::uint32_t
+        {
+            m_code.code.emplace_back(op, reg, operand);
+            return static_cast<std::uint32_t>(m_code.code.size() - 1);
+        }
+
+
+        /* points the jump at @param at to the next instruction */
+        void
+        mf_patch(std::uint32_t at)
+        {
+            m_code.code[at].operand
+                = static_cast<std::uint32_t>(m_code.code.size());
+        }
+
+
+        /* a frame for a loop or case, which nested ones don't touch */
+        auto
+        mf_push_frame() -> std::uint16_t
+        {
+            std::uint16_t reg { m_depth++ };
+            if (m_depth > m_code.frames) m_code.frames = m_depth;
+
+            return reg;
+        }
+
+
+        void
+        mf_list(node_index index)
+        {
+            for (node_index child : m_tree.children(index)) node(child);
+        }
+
+
+        /* code that runs inside a child, which has to end by leaving it */
+        void
+        mf_forked(node_index index)
+        {
+            const ast_node &current { m_tree[index] };
+
+            if (current.type == ast_type::subshell
+                && current.first_child == current.last_child
+                && current.first_child != null_node)
+                return mf_forked(current.first_child);
+
+            /* a child can't leave the loops of its parent */
+            auto loops { std::exchange(m_loops, {}) };
+
+            /* nothing left to do after the command, so it can take over */
+            if (current.type == ast_type::simple_command)
+                mf_simple(index, opcode::exec);
+            else
+            {
+                if (current.type == ast_type::subshell)
+                    mf_list(index);
+                else
+                    node(index);
+
+                mf_emit(opcode::exit);
+            }
+
+            m_loops = std::move(loops);
+        }
+
+
+        /* ( list list )+ list? */
+        void
+        mf_if(node_index index)
+        {
+            std::vector<std::uint32_t> ends;
+            bool                       has_else { false };
+
+            for (node_index child { m_tree[index].first_child };
+                 child != null_node;)
+            {
+                node_index body { m_tree[child].next_sibling };
+
+                if (body == null_node)
+                {
+                    mf_list(child);
+                    has_else = true;
+                    break;
+                }
+
+                mf_list(child);
+                std::uint32_t skip { mf_emit(opcode::jump_if_failure) };
+
+                mf_list(body);
+                ends.emplace_back(mf_emit(opcode::jump));
+                mf_patch(skip);
+
+                child = m_tree[body].next_sibling;
+            }
+
+            /* no condition held */
+            if (!has_else) mf_emit(opcode::status, 0);
+
+            for (std::uint32_t end : ends) mf_patch(end);
+        }
+
+
+        /* the status of a loop is the one of its last body, or 0 */
+        void
+        mf_while(node_index index, opcode leave)
+        {
+            const ast_node &current { m_tree[index] };
+            std::uint16_t   reg { mf_push_frame() };
+
+            mf_emit(opcode::status, 0);
+            mf_emit(opcode::save, 0, reg);
+
+            auto top { static_cast<std::uint32_t>(m_code.code.size()) };
+
+            mf_list(current.first_child);
+            std::uint32_t exit { mf_emit(leave) };
+
+            mf_loop_body(current.last_child, top, reg);
+            mf_patch(exit);
+            mf_loop_end(reg);
+        }
+
+
+        /* literal* list */
+        void
+        mf_for(node_index index)
+        {
+            const ast_node &current { m_tree[index] };
+            std::uint16_t   reg { mf_push_frame() };
+
+            for (node_index child : m_tree.children(index))
+                if (m_tree[child].type == ast_type::literal)
+                    mf_argument(m_tree[child].data, reg);
+
+            mf_emit(opcode::collect, 0, reg);
+            mf_emit(opcode::status, 0);
+            mf_emit(opcode::save, 0, reg);
+
+            auto top { static_cast<std::uint32_t>(m_code.code.size()) };
+
+            std::uint32_t exit { mf_emit(opcode::next, 0, reg) };
+            mf_emit(opcode::set, m_env.resolve(current.data));
+
+            mf_loop_body(current.last_child, top, reg);
+            mf_patch(exit);
+            mf_loop_end(reg);
+        }
+
+
+        void
+        mf_loop_body(node_index body, std::uint32_t top, std::uint16_t reg)
+        {
+            m_loops.emplace_back(top);
+            mf_list(body);
+
+            mf_emit(opcode::save, 0, reg);
+            mf_emit(opcode::jump, top);
+        }
+
+
+        void
+        mf_loop_end(std::uint16_t reg)
+        {
+            for (std::uint32_t jump : m_loops.back().breaks) mf_patch(jump);
+            m_loops.pop_back();
+
+            mf_emit(opcode::restore, 0, reg);
+            m_depth--;
+        }
+
+
+        /* case_item*, each being literal+ list */
+        void
+        mf_case(node_index index)
+        {
+            std::uint16_t reg { mf_push_frame() };
+
+            mf_word(m_tree[index].data, instruction { opcode::subject, reg });
+            mf_emit(opcode::status, 0);
+
+            std::vector<std::uint32_t> ends;
+
+            for (node_index item : m_tree.children(index))
+            {
+                std::vector<std::uint32_t> matches;
+
+                for (node_index pattern : m_tree.children(item))
+                    if (m_tree[pattern].type == ast_type::literal)
+                        matches.emplace_back(
+                            mf_word(m_tree[pattern].data,
+                                    instruction { opcode::match, reg }, true));
+
+                std::uint32_t skip { mf_emit(opcode::jump) };
+
+                for (std::uint32_t match : matches) mf_patch(match);
+                mf_list(m_tree[item].last_child);
+                ends.emplace_back(mf_emit(opcode::jump));
+
+                mf_patch(skip);
+            }
+
+            for (std::uint32_t end : ends) mf_patch(end);
+            m_depth--;
+        }
+
+
+        /* the body gets a chunk of its own, which outlives this one */
+        void
+        mf_define(node_index index)
+        {
+            auto body { std::make_shared<chunk>() };
+            compiler { m_tree, m_env, *body }.function(
+                m_tree[index].first_child);
+
+            m_code.functions.emplace_back(std::string { m_tree[index].data },
+                                          std::move(body));
+
+            mf_emit(opcode::define,
+                    static_cast<std::uint32_t>(m_code.functions.size() - 1));
+        }
+
+
+        /* returns the operand spawn and exec take for @param name */
+        auto
+        mf_binding(std::string name) -> std::uint32_t
+        {
+            if (auto it { m_bindings.find(name) }; it != m_bindings.end())
+                return it->second;
+
+            m_code.bindings.emplace_back(name);
+
+            auto operand { static_cast<std::uint32_t>(m_code.bindings.size()) };
+            m_bindings.emplace(std::move(name), operand);
+
+            return operand;
+        }
+
+
+        /* return is a jump to the end of the function's chunk */
+        auto
+        mf_return(node_index argument) -> bool
+        {
+            if (!m_function) return false;
+
+            if (argument != null_node)
+            {
+                std::string_view word { m_tree[argument].data };
+
+                if (auto status { count_of(word) })
+                    mf_emit(opcode::status,
+                            static_cast<std::uint32_t>(*status & 0xff));
+                else
+                    mf_word(word, instruction { opcode::word_status, 0,
+                                                m_code.intern("return") });
+            }
+
+            m_returns.emplace_back(mf_emit(opcode::jump));
+            return true;
+        }
+
+
+        /**
+         * break and continue are jumps, they never reach the machine. a
+         * count only known when it runs picks one of a jump for every loop
+         * it can leave.
+         */
+        auto
+        mf_loop_control(std::string_view name, node_index argument) -> bool
+        {
+            if (m_loops.empty()) return false;
+
+            auto count { argument != null_node
+                             ? count_of(m_tree[argument].data)
+                             : std::optional<std::int64_t> { 1 } };
+
+            if (count && *count > 0)
+            {
+                mf_emit(opcode::status, 0);
+                mf_loop_jump(name, std::min<std::size_t>(
+                                       static_cast<std::size_t>(*count),
+                                       m_loops.size()));
+                return true;
+            }
+
+            mf_word(m_tree[argument].data,
+                    instruction { opcode::loop_levels,
+                                  static_cast<std::uint16_t>(m_loops.size()),
+                                  m_code.intern(std::string { name }) });
+
+            for (std::size_t levels { 1 }; levels <= m_loops.size(); levels++)
+                mf_loop_jump(name, levels);
+
+            return true;
+        }
+
+
+        /* jumps out of, or to the top of, the @param levels-th loop out */
+        void
+        mf_loop_jump(std::string_view name, std::size_t levels)
+        {
+            loop &target { m_loops[m_loops.size() - levels] };
+
+            if (name == "continue")
+                mf_emit(opcode::jump, target.top);
+            else
+                target.breaks.emplace_back(mf_emit(opcode::jump));
+        }
+
+
+        void
+        mf_simple(node_index index, opcode run)
+        {
+            std::uint32_t target { 0 };
+
+            for (node_index child : m_tree.children(index))
+            {
+                const ast_node &current { m_tree[child] };
+
+                if (current.type == ast_type::assignment)
+                {
+                    const ast_node &name { m_tree[current.first_child] };
+                    const ast_node &value { m_tree[current.last_child] };
+
+                    mf_word(value.data,
+                            instruction { opcode::assign, 0,
+                                          m_env.resolve(name.data) });
+                }
+                else if (current.type == ast_type::command)
+                {
+                    auto name { literal_of(current.data) };
+
+                    if (name && (*name == "break" || *name == "continue")
+                        && mf_loop_control(*name, current.next_sibling))
+                        return;
+
+                    if (name && *name == "return"
+                        && mf_return(current.next_sibling))
+                        return;
+
+                    if (name && !parse_braces(current.data))
+                        target = mf_binding(std::move(*name));
+                    mf_argument(current.data);
+                }
+                else if (current.type == ast_type::option)
+                    mf_argument(current.data);
+            }
+
+            mf_emit(run, target);
+        }
+
+
+        /**
+         * an argument, or an item of the for loop with @param frame. braces
+         * are expanded right here unless there are too many words, then the
+         * machine makes them only as it needs them, and compiles the ones
+         * that still expand or glob one at a time.
+         */
+        void
+        mf_argument(std::string_view              word,
+                    std::optional<std::uint16_t> frame = std::nullopt)
+        {
+            auto braces { parse_braces(word) };
+
+            if (!braces)
+            {
+                mf_word(word, instruction { opcode::push_arg });
+                return;
+            }
+
+            if (braces->size() <= EAGER_BRACES)
+            {
+                std::string generated;
+
+                for (std::uint64_t i { 0 }; i < braces->size(); i++)
+                {
+                    generated.clear();
+                    braces->generate(i, generated);
+                    mf_word(generated, instruction { opcode::push_arg });
+                }
+                return;
+            }
+
+            m_code.braces.emplace_back(std::move(*braces));
+            auto operand { static_cast<std::uint32_t>(m_code.braces.size()
+                                                      - 1) };
+
+            if (frame)
+                mf_emit(opcode::defer, operand, *frame);
+            else
+                mf_emit(opcode::braces, operand);
+        }
+
+
+        /**
+         * lowers a word to literal and expand instructions, then finishes
+         * it with @param finish, returning where that ended up. an argument
+         * with unquoted glob characters is finished with glob instead.
+         */
+        auto
+        mf_word(std::string_view word, instruction finish, bool pattern = false)
+            -> std::uint32_t
+        {
+            using enum segment::kind;
+
+            auto segments { split_word(word, pattern) };
+
+            if (finish.op == opcode::push_arg)
+            {
+                auto as_pattern { split_word(word, true) };
+
+                if (is_glob(as_pattern))
+                {
+                    segments = std::move(as_pattern);
+                    pattern  = true;
+                    finish   = instruction { opcode::glob };
+                }
+            }
+
+            if (finish.op == opcode::push_arg && segments.size() == 1)
+            {
+                const segment &only { segments.front() };
+
+                /* the common case of a plain word only needs one
+                   instruction */
+                if (only.type == literal)
+                    return mf_emit(opcode::arg, m_code.intern(only.text));
+
+                /* "$@" keeps every parameter as an argument of its own */
+                if (only.type == special && only.text == "@" && only.quoted)
+                    return mf_emit(opcode::push_params);
+            }
+
+            for (segment &part : segments) mf_segment(part, pattern);
+
+            return mf_emit(finish.op, finish.operand, finish.reg);
+        }
+
+
+        void
+        mf_segment(segment &part, bool pattern)
+        {
+            using enum segment::kind;
+
+            std::uint16_t flags { part.quoted ? std::uint16_t { 0 }
+                                              : SPLIT_FIELDS };
+            if (part.quoted && pattern) flags |= ESCAPE_GLOB;
+
+            if (part.op)
+                return mf_modified(part, flags);
+
+            switch (part.type)
+            {
+            case literal:
+                mf_emit(opcode::literal, m_code.intern(std::move(part.text)));
+                break;
+
+            case variable:
+                mf_emit(opcode::expand, m_env.resolve(part.text), flags);
+                break;
+
+            case positional:
+                mf_emit(opcode::param,
+                        static_cast<std::uint32_t>(std::stoul(part.text)),
+                        flags);
+                break;
+
+            case special:
+                mf_emit(opcode::special,
+                        static_cast<std::uint32_t>(part.text.front()), flags);
+                break;
+
+            case arithmetic:
+            {
+                auto expression { compile_arithmetic(part.text, m_env) };
+
+                if (auto value { expression.constant() })
+                {
+                    mf_emit(opcode::literal,
+                            m_code.intern(std::to_string(*value)));
+                    break;
+                }
+
+                m_code.arithmetics.emplace_back(std::move(expression));
+                mf_emit(opcode::arith,
+                        static_cast<std::uint32_t>(
+                            m_code.arithmetics.size() - 1),
+                        flags);
+                break;
+            }
+            }
+        }
+
+
+        /* each of the modifier's words goes into one begin started */
+        void
+        mf_modified(segment &part, std::uint16_t flags)
+        {
+            auto [count, pattern] { words_of(*part.op) };
+
+            for (std::size_t i { 0 }; i < count; i++)
+            {
+                mf_emit(opcode::begin);
+
+                std::string_view word { i < part.words.size() ? part.words[i]
+                                                              : "" };
+                for (segment &nested : split_word(word, pattern && i == 0))
+                    mf_segment(nested, pattern && i == 0);
+            }
+
+            std::uint32_t parameter {
+                part.type == segment::kind::variable
+                    ? m_env.resolve(part.text)
+                    : POSITIONAL
+                          | static_cast<std::uint32_t>(std::stoul(part.text))
+            };
+
+            if (part.colon) flags |= EMPTY_IS_UNSET;
+            mf_emit(opcode::modify, parameter,
+                    flags | static_cast<std::uint16_t>(*part.op));
+        }
+    };
+}
+
+
+auto
+chunk::intern(std::string string) -> std::uint32_t
+{
+    strings.emplace_back(std::move(string));
+    return static_cast<std::uint32_t>(strings.size() - 1);
+}
+
+
+auto
+cchell::interpreter::impl::compile_word(std::string_view word,
+                                        environment     &env) -> chunk
+{
+    chunk code;
+    compiler { ast {}, env, code }.word(word);
+    return code;
+}
+
+
+auto
+cchell::interpreter::compile(const ast &tree, environment &env) -> chunk
+{
+    chunk code;
+    if (tree.empty()) return code;
+
+    compiler { tree, env, code }.node(tree.root());
+    return code;
+}
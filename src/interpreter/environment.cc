@@ -0,0 +1,189 @@
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "interpreter.hh"
+
+using namespace cchell::interpreter;
+
+
+environment::environment(char **envp)
+{
+    for (char **p { envp }; p != nullptr && *p != nullptr; p++)
+    {
+        std::string_view entry { *p };
+        std::size_t      idx { entry.find('=') };
+
+        if (idx == std::string_view::npos) continue;
+
+        slot index { resolve(entry.substr(0, idx)) };
+        set(index, entry.substr(idx + 1));
+        mark_exported(index);
+    }
+
+    /* only now, shared::executables already indexed the inherited $PATH */
+    m_path = resolve("PATH");
+    m_ifs  = resolve("IFS");
+}
+
+
+auto
+environment::resolve(std::string_view name) -> slot
+{
+    if (auto it { m_slots.find(name) }; it != m_slots.end()) return it->second;
+
+    auto index { static_cast<slot>(m_variables.size()) };
+
+    m_variables.emplace_back(std::string { name }, std::string {}, false,
+                             false);
+    m_slots.emplace(name, index);
+
+    return index;
+}
+
+
+auto
+environment::name(slot index) const -> const std::string &
+{
+    return m_variables[index].name;
+}
+
+
+auto
+environment::get(slot index) const -> const std::string *
+{
+    const variable &var { m_variables[index] };
+    return var.set ? &var.value : nullptr;
+}
+
+
+void
+environment::set(slot index, std::string_view value)
+{
+    variable &var { m_variables[index] };
+
+    /* assigned, so a variable set over and over keeps its capacity */
+    var.value.assign(value);
+    var.set   = true;
+
+    if (var.exported) m_dirty = true;
+
+    if (index == m_path)
+    {
+        m_path_changed = true;
+        m_generation++;
+    }
+}
+
+
+void
+environment::unset(slot index)
+{
+    variable &var { m_variables[index] };
+
+    if (var.exported && var.set) m_dirty = true;
+
+    var.value.clear();
+    var.set = false;
+
+    if (index == m_path)
+    {
+        m_path_changed = true;
+        m_generation++;
+    }
+}
+
+
+void
+environment::refresh_executables() const
+{
+    if (!m_path_changed) return;
+
+    const auto *PATH { get(m_path) };
+    shared::executables.load(PATH != nullptr ? std::string_view { *PATH }
+                                             : std::string_view {});
+    m_path_changed = false;
+}
+
+
+void
+environment::mark_exported(slot index)
+{
+    variable &var { m_variables[index] };
+    if (var.exported) return;
+
+    var.exported = true;
+    if (var.set) m_dirty = true;
+}
+
+
+auto
+environment::field_separators() const -> std::string_view
+{
+    const variable &var { m_variables[m_ifs] };
+    return var.set ? std::string_view { var.value } : " \t\n";
+}
+
+
+auto
+environment::envp() -> char **
+{
+    if (!m_dirty) return m_envp.data();
+
+    m_entries.clear();
+    m_envp.clear();
+
+    for (const variable &var : m_variables)
+        if (var.set && var.exported)
+            m_entries.emplace_back(var.name + '=' + var.value);
+
+    /* the pointers are only taken once m_entries stops reallocating */
+    for (std::string &entry : m_entries) m_envp.emplace_back(entry.data());
+    m_envp.emplace_back(nullptr);
+
+    m_dirty = false;
+    return m_envp.data();
+}
+
+
+void
+environment::define(std::string_view name, std::shared_ptr<const chunk> body)
+{
+    if (auto it { m_functions.find(name) }; it != m_functions.end())
+        it->second = std::move(body);
+    else
+        m_functions.emplace(name, std::move(body));
+
+    m_generation++;
+}
+
+
+auto
+environment::function(std::string_view name) const
+    -> std::shared_ptr<const chunk>
+{
+    auto it { m_functions.find(name) };
+    return it == m_functions.end() ? nullptr : it->second;
+}
+
+
+auto
+environment::generation() const -> std::uint64_t
+{
+    return m_generation;
+}
+
+
+void
+environment::request_exit(int status)
+{
+    m_exit = status;
+}
+
+
+auto
+environment::exit_requested() const -> std::optional<int>
+{
+    return m_exit;
+}
@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "glob.hh"
+#include "interpreter.hh"
+
+using namespace cchell::interpreter;
+
+
+namespace
+{
+    auto
+    saturating_multiply(std::uint64_t a, std::uint64_t b) -> std::uint64_t
+    {
+        constexpr auto MAX { std::numeric_limits<std::uint64_t>::max() };
+        return b != 0 && a > MAX / b ? MAX : a * b;
+    }
+
+
+    /* the } closing the { at @param open, and the commas directly in it */
+    struct group
+    {
+        std::size_t              close;
+        std::vector<std::size_t> commas;
+    };
+
+
+    auto
+    find_group(std::string_view word, std::size_t open) -> std::optional<group>
+    {
+        group       found { 0, {} };
+        std::size_t depth { 0 };
+        char        quote { '\0' };
+
+        for (std::size_t i { open + 1 }; i < word.length(); i++)
+        {
+            char c { word[i] };
+
+            if (quote != '\0')
+            {
+                if (c == quote)
+                    quote = '\0';
+                else if (c == '\\' && quote == '"')
+                    i++;
+                continue;
+            }
+
+            if (c == '\\')
+                i++;
+            else if (c == '\'' || c == '"')
+                quote = c;
+            else if (c == '$' && i + 1 < word.length() && word[i + 1] == '{')
+            {
+                i++;
+                depth++;
+            }
+            else if (c == '{')
+                depth++;
+            else if (c == '}' && depth-- == 0)
+            {
+                found.close = i;
+                return found;
+            }
+            else if (c == ',' && depth == 0)
+                found.commas.emplace_back(i);
+        }
+
+        return std::nullopt;
+    }
+
+
+    auto
+    to_integer(std::string_view text) -> std::optional<std::int64_t>
+    {
+        std::int64_t value { 0 };
+        auto [end, ec] { std::from_chars(text.data(),
+                                         text.data() + text.size(), value) };
+
+        if (ec != std::errc {} || end != text.data() + text.size())
+            return std::nullopt;
+        return value;
+    }
+
+
+    auto
+    is_padded(std::string_view number) -> bool
+    {
+        if (number.starts_with('-')) number.remove_prefix(1);
+        return number.length() > 1 && number.front() == '0';
+    }
+
+
+    /* {first..last} and {first..last..step}, @param inner being the part
+       between the braces */
+    auto
+    parse_sequence(std::string_view inner)
+        -> std::optional<brace_word::sequence>
+    {
+        std::size_t dots { inner.find("..") };
+        if (dots == std::string_view::npos) return std::nullopt;
+
+        std::string_view first { inner.substr(0, dots) };
+        std::string_view rest { inner.substr(dots + 2) };
+        std::string_view last { rest.substr(0, rest.find("..")) };
+        std::string_view step_text {};
+
+        if (last.length() < rest.length())
+            step_text = rest.substr(last.length() + 2);
+
+        std::int64_t step { 1 };
+        if (!step_text.empty())
+        {
+            auto value { to_integer(step_text) };
+            if (!value) return std::nullopt;
+            step = std::max<std::int64_t>(*value < 0 ? -*value : *value, 1);
+        }
+
+        brace_word::sequence result { 0, step, 0, 0, false };
+        std::int64_t         end { 0 };
+
+        if (auto from { to_integer(first) }, to { to_integer(last) };
+            from && to)
+        {
+            result.first = *from;
+            end          = *to;
+
+            if (is_padded(first) || is_padded(last))
+                result.width = static_cast<std::uint8_t>(
+                    std::max(first.length(), last.length()));
+        }
+        else if (first.length() == 1 && last.length() == 1)
+        {
+            result.first      = static_cast<unsigned char>(first.front());
+            end               = static_cast<unsigned char>(last.front());
+            result.characters = true;
+        }
+        else
+            return std::nullopt;
+
+        auto distance { static_cast<std::uint64_t>(
+            end >= result.first ? end - result.first : result.first - end) };
+
+        result.count = distance / static_cast<std::uint64_t>(step) + 1;
+        if (end < result.first) result.step = -step;
+
+        return result;
+    }
+
+
+    /* every word @param text makes, for braces nested in other braces */
+    auto
+    expand_all(std::string_view text) -> std::vector<std::string>
+    {
+        auto braces { impl::parse_braces(text) };
+        if (!braces) return { std::string { text } };
+
+        std::vector<std::string> words(braces->size());
+        for (std::uint64_t i { 0 }; i < words.size(); i++)
+            braces->generate(i, words[i]);
+
+        return words;
+    }
+}
+
+
+void
+impl::remove_affix(std::string_view value,
+                   std::string_view pattern,
+                   modifier         type,
+                   std::string     &out)
+{
+    std::size_t         length { value.length() };
+    const glob::matcher match { pattern, false };
+
+    switch (type)
+    {
+    case modifier::remove_prefix:
+        for (std::size_t end { 0 }; end <= length; end++)
+            if (match.matches(value.substr(0, end)))
+            {
+                out += value.substr(end);
+                return;
+            }
+        break;
+
+    case modifier::remove_longest_prefix:
+        if (auto end { match.longest_match(value) })
+        {
+            out += value.substr(*end);
+            return;
+        }
+        break;
+
+    case modifier::remove_suffix:
+        for (std::size_t start { length + 1 }; start-- > 0;)
+            if (match.matches(value.substr(start)))
+            {
+                out += value.substr(0, start);
+                return;
+            }
+        break;
+
+    case modifier::remove_longest_suffix:
+        for (std::size_t start { 0 }; start <= length; start++)
+            if (match.matches(value.substr(start)))
+            {
+                out += value.substr(0, start);
+                return;
+            }
+        break;
+
+    default: break;
+    }
+
+    out += value;
+}
+
+
+void
+impl::replace(std::string_view value,
+              std::string_view pattern,
+              std::string_view replacement,
+              bool             all,
+              std::string     &out)
+{
+    const glob::matcher match { pattern, false };
+    std::size_t         pos { 0 };
+
+    /* without wildcards, the text itself is searched for */
+    if (match.is_literal())
+    {
+        const std::string &literal { match.prefix() };
+        std::size_t        found { 0 };
+
+        while (!literal.empty()
+               && (found = value.find(literal, pos)) != std::string_view::npos)
+        {
+            out += value.substr(pos, found - pos);
+            out += replacement;
+            pos = found + literal.length();
+
+            if (!all) break;
+        }
+
+        out += value.substr(pos);
+        return;
+    }
+
+    while (pos < value.length())
+    {
+        /* the longest match starting here, an empty one doesn't count */
+        auto length { match.longest_match(value.substr(pos)).value_or(0) };
+
+        if (length == 0)
+        {
+            out += value[pos++];
+            continue;
+        }
+
+        out += replacement;
+        pos += length;
+
+        if (!all) break;
+    }
+
+    out += value.substr(pos);
+}
+
+
+brace_word::brace_word(std::vector<part> parts)
+    : m_parts { std::move(parts) }, m_strides(m_parts.size())
+{
+    for (std::size_t i { m_parts.size() }; i-- > 0;)
+    {
+        const part &current { m_parts[i] };
+
+        m_strides[i] = m_size;
+        m_size       = saturating_multiply(
+            m_size, current.range ? current.range->count
+                                        : current.alternatives.size());
+    }
+}
+
+
+void
+brace_word::generate(std::uint64_t index, std::string &out) const
+{
+    for (std::size_t i { 0 }; i < m_parts.size(); i++)
+    {
+        const auto &[alternatives, range] { m_parts[i] };
+        std::uint64_t step { index / m_strides[i] };
+
+        if (!range)
+        {
+            out += alternatives[step % alternatives.size()];
+            continue;
+        }
+
+        auto value { range->first
+                     + static_cast<std::int64_t>(step % range->count)
+                           * range->step };
+
+        if (range->characters)
+        {
+            out += static_cast<char>(value);
+            continue;
+        }
+
+        char buffer[24];
+        auto [end, _] { std::to_chars(std::begin(buffer), std::end(buffer),
+                                      value) };
+
+        std::string_view digits { std::begin(buffer), end };
+        std::size_t      length { digits.length() };
+
+        /* the width counts the sign, like in {-05..5} */
+        if (value < 0)
+        {
+            out += '-';
+            digits.remove_prefix(1);
+        }
+
+        if (range->width > length) out.append(range->width - length, '0');
+        out += digits;
+    }
+}
+
+
+auto
+impl::is_plain(std::string_view word) -> bool
+{
+    return word.find_first_of("$`'\"\\*?[") == std::string_view::npos;
+}
+
+
+auto
+impl::parse_braces(std::string_view word) -> std::optional<brace_word>
+{
+    std::vector<brace_word::part> parts;
+    std::string                   literal;
+    char                          quote { '\0' };
+    bool                          found { false };
+
+    auto flush { [&]
+                 {
+                     if (literal.empty()) return;
+                     parts.emplace_back(std::vector { std::move(literal) },
+                                        std::nullopt);
+                     literal.clear();
+                 } };
+
+    for (std::size_t i { 0 }; i < word.length(); i++)
+    {
+        char c { word[i] };
+
+        /* quotes and escapes are kept, the words get compiled later */
+        if (quote != '\0' || c == '\'' || c == '"' || c == '\\')
+        {
+            literal += c;
+
+            if (quote == '\0' && c != '\\')
+                quote = c;
+            else if (c == quote)
+                quote = '\0';
+            else if (c == '\\' && quote != '\'' && i + 1 < word.length())
+                literal += word[++i];
+            continue;
+        }
+
+        auto braced { c == '{' || (c == '$' && word.substr(i).starts_with("${"))
+                          ? find_group(word, c == '$' ? i + 1 : i)
+                          : std::nullopt };
+
+        if (!braced)
+        {
+            literal += c;
+            continue;
+        }
+
+        /* ${...} is a parameter, left whole for the word compiler */
+        if (c == '$')
+        {
+            literal += word.substr(i, braced->close - i + 1);
+            i = braced->close;
+            continue;
+        }
+
+        std::string_view inner { word.substr(i + 1, braced->close - i - 1) };
+        brace_word::part part {};
+
+        if (!braced->commas.empty())
+        {
+            std::size_t start { i + 1 };
+            braced->commas.emplace_back(braced->close);
+
+            for (std::size_t comma : braced->commas)
+            {
+                for (std::string &alternative :
+                     expand_all(word.substr(start, comma - start)))
+                    part.alternatives.emplace_back(std::move(alternative));
+                start = comma + 1;
+            }
+        }
+        else if (auto range { parse_sequence(inner) })
+            part.range = range;
+        else
+        {
+            /* {} and {a}, though braces inside might still expand */
+            literal += c;
+            continue;
+        }
+
+        flush();
+        parts.emplace_back(std::move(part));
+
+        found = true;
+        i     = braced->close;
+    }
+
+    if (!found) return std::nullopt;
+
+    flush();
+    return brace_word { std::move(parts) };
+}
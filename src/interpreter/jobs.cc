@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <expected>
+#include <format>
+#include <iostream>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "interpreter.hh"
+
+using namespace cchell::interpreter;
+
+
+namespace
+{
+    /* what the kernel keeps aside for itself, the way xargs leaves it */
+    constexpr std::size_t HEADROOM { 2048 };
+
+
+    /* the bytes execve copies for @param string, its pointer included */
+    constexpr auto
+    exec_size(std::string_view string) -> std::size_t
+    {
+        return string.size() + 1 + sizeof(char *);
+    }
+
+
+    auto
+    arg_max() -> std::size_t
+    {
+        long limit { sysconf(_SC_ARG_MAX) };
+        return limit > 0 ? static_cast<std::size_t>(limit) : 128UZ * 1024;
+    }
+
+
+    void
+    write_all(int fd, std::string_view data)
+    {
+        while (!data.empty())
+        {
+            ssize_t written { ::write(fd, data.data(), data.size()) };
+
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return;
+
+            data.remove_prefix(static_cast<std::size_t>(written));
+        }
+    }
+
+
+    /* -1 on kernels older than 5.3, which then get waited for blocking */
+    auto
+    pidfd_open(pid_t pid) -> int
+    {
+#ifdef SYS_pidfd_open
+        return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+        return -1;
+#endif
+    }
+
+
+    void
+    close_fd(int &fd)
+    {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+}
+
+
+auto
+impl::wait_for(pid_t pid) -> int
+{
+    int status { 0 };
+
+    while (waitpid(pid, &status, 0) == -1)
+        if (errno != EINTR) return 1;
+
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+
+    return 0;
+}
+
+
+impl::scheduler::scheduler(std::size_t jobs) : m_jobs(std::max(jobs, 1UZ)) {}
+
+
+impl::scheduler::~scheduler()
+{
+    wait();
+}
+
+
+auto
+impl::scheduler::fork() -> std::expected<pid_t, std::string>
+{
+    while (m_running.size() >= m_jobs) mf_poll();
+
+    /* a terminal stays one, for whatever prompts or checks isatty */
+    if (m_jobs == 1)
+    {
+        std::cout.flush();
+        std::cerr.flush();
+
+        pid_t pid { ::fork() };
+
+        if (pid < 0) return std::unexpected { std::strerror(errno) };
+        if (pid == 0)
+            std::signal(SIGINT, SIG_DFL);
+        else
+            m_running.emplace_back(pid, -1, -1, -1);
+
+        return pid;
+    }
+
+    std::array<int, 2> out {};
+    std::array<int, 2> err {};
+
+    if (pipe2(out.data(), O_CLOEXEC) < 0)
+        return std::unexpected { std::strerror(errno) };
+    if (pipe2(err.data(), O_CLOEXEC) < 0)
+    {
+        std::string error { std::strerror(errno) };
+        close(out[0]), close(out[1]);
+        return std::unexpected { error };
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid_t pid { ::fork() };
+
+    if (pid < 0)
+    {
+        std::string error { std::strerror(errno) };
+        for (int fd : { out[0], out[1], err[0], err[1] }) close(fd);
+        return std::unexpected { error };
+    }
+
+    if (pid == 0)
+    {
+        std::signal(SIGINT, SIG_DFL);
+
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        for (int fd : { out[0], out[1], err[0], err[1] }) close(fd);
+
+        for (job &other : m_running)
+        {
+            close_fd(other.pidfd);
+            close_fd(other.out);
+            close_fd(other.err);
+        }
+        m_running.clear();
+
+        return 0;
+    }
+
+    close(out[1]);
+    close(err[1]);
+
+    m_running.emplace_back(pid, pidfd_open(pid), out[0], err[0]);
+    return pid;
+}
+
+
+auto
+impl::scheduler::wait() -> int
+{
+    while (!m_running.empty()) mf_poll();
+    return m_status;
+}
+
+
+/* blocks until any job has output or exits, and handles all that did */
+void
+impl::scheduler::mf_poll()
+{
+    thread_local std::vector<pollfd>                        fds;
+    thread_local std::vector<std::pair<std::size_t, int *>> owners;
+
+    fds.clear();
+    owners.clear();
+
+    for (std::size_t i { 0 }; i < m_running.size(); i++)
+    {
+        job &current { m_running[i] };
+
+        for (int *fd : { &current.out, &current.err, &current.pidfd })
+        {
+            if (*fd < 0 || (fd == &current.pidfd && current.exited)) continue;
+
+            fds.emplace_back(*fd, POLLIN, 0);
+            owners.emplace_back(i, fd);
+        }
+    }
+
+    if (!fds.empty())
+        while (::poll(fds.data(), fds.size(), -1) < 0)
+            if (errno != EINTR) return;
+
+    thread_local std::array<char, 64 * 1024> buffer;
+
+    for (std::size_t i { 0 }; i < fds.size(); i++)
+    {
+        if (fds[i].revents == 0) continue;
+
+        auto [index, fd] { owners[i] };
+        job &current { m_running[index] };
+
+        if (fd == &current.pidfd)
+        {
+            current.status = wait_for(current.pid);
+            current.exited = true;
+            close_fd(current.pidfd);
+            continue;
+        }
+
+        ssize_t got { ::read(*fd, buffer.data(), buffer.size()) };
+
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0)
+        {
+            close_fd(*fd);
+            continue;
+        }
+
+        mf_output(index, fd == &current.err,
+                  { buffer.data(), static_cast<std::size_t>(got) });
+    }
+
+    /* without a pidfd, a job is waited for once its pipes are closed */
+    for (job &current : m_running)
+        if (!current.exited && current.pidfd < 0 && current.out < 0
+            && current.err < 0)
+        {
+            current.status = wait_for(current.pid);
+            current.exited = true;
+        }
+
+    mf_retire();
+}
+
+
+void
+impl::scheduler::mf_output(std::size_t      index,
+                           bool             error,
+                           std::string_view data)
+{
+    if (index == 0)
+        return write_all(error ? STDERR_FILENO : STDOUT_FILENO, data);
+
+    (error ? m_running[index].held_err : m_running[index].held_out)
+        .append(data);
+}
+
+
+/* drops the finished jobs in front, the next one writing what it held */
+void
+impl::scheduler::mf_retire()
+{
+    while (!m_running.empty())
+    {
+        job &front { m_running.front() };
+
+        write_all(STDOUT_FILENO, front.held_out);
+        write_all(STDERR_FILENO, front.held_err);
+        front.held_out.clear();
+        front.held_err.clear();
+
+        if (!front.exited || front.out >= 0 || front.err >= 0) return;
+
+        if (m_status == 0) m_status = front.status;
+        m_running.pop_front();
+    }
+}
+
+
+auto
+impl::plan_batches(std::span<const std::string_view> fixed,
+                   std::span<const std::string_view> items,
+                   char *const                      *envp)
+    -> std::expected<std::vector<std::size_t>, std::string>
+{
+    std::size_t taken { HEADROOM + sizeof(char *) * 2 };
+
+    for (char *const *entry { envp }; *entry != nullptr; entry++)
+        taken += exec_size(*entry);
+    for (std::string_view arg : fixed) taken += exec_size(arg);
+
+    std::size_t limit { arg_max() };
+    if (taken >= limit)
+        return std::unexpected { "the command alone is too long" };
+
+    std::size_t budget { limit - taken };
+    std::size_t used { 0 };
+
+    std::vector<std::size_t> ends;
+
+    /* packing greedily, in order, is what makes the fewest batches */
+    for (std::size_t i { 0 }; i < items.size(); i++)
+    {
+        std::size_t size { exec_size(items[i]) };
+        if (size > budget)
+            return std::unexpected { std::format(
+                "{}...: argument too long", items[i].substr(0, 32)) };
+
+        if (used + size > budget)
+        {
+            ends.emplace_back(i);
+            used = 0;
+        }
+
+        used += size;
+    }
+
+    ends.emplace_back(items.size());
+    return ends;
+}
+
+
+auto
+impl::run_batches(const std::string                &path,
+                  std::span<const std::string_view> fixed,
+                  std::span<const std::string_view> items,
+                  std::span<const std::size_t>      ends,
+                  std::size_t                       jobs,
+                  char *const                      *envp) -> int
+{
+    /* every argument is null-terminated already, so argv can point right
+       at them rather than copying */
+    std::vector<char *> argv;
+    for (std::string_view arg : fixed)
+        argv.emplace_back(const_cast<char *>(arg.data()));
+
+    scheduler jobs_running { jobs };
+
+    std::size_t begin { 0 };
+    for (std::size_t end : ends)
+    {
+        argv.resize(fixed.size());
+        for (std::string_view item : items.subspan(begin, end - begin))
+            argv.emplace_back(const_cast<char *>(item.data()));
+        argv.emplace_back(nullptr);
+
+        begin = end;
+
+        auto pid { jobs_running.fork() };
+        if (!pid)
+        {
+            std::println(std::cerr, "cchell: batch: {}", pid.error());
+            return jobs_running.wait(), 1;
+        }
+
+        if (*pid == 0)
+        {
+            execve(path.c_str(), argv.data(), envp);
+
+            std::println(std::cerr, "cchell: {}: {}", fixed.front(),
+                         std::strerror(errno));
+            _exit(errno == ENOENT ? 127 : 126);
+        }
+    }
+
+    return jobs_running.wait();
+}
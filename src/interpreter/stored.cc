@@ -0,0 +1,681 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "interpreter.hh"
+#include "shared.hh"
+
+using namespace cchell::interpreter;
+
+
+namespace
+{
+    constexpr std::string_view MAGIC { "cchell\0\2", 8 };
+
+#if PROJECT_IS_RELEASE
+    constexpr std::string_view VERSION { PROJECT_VERSION };
+#else
+    /* a development build can change the format without a new version */
+    constexpr std::string_view VERSION { PROJECT_VERSION " " __DATE__
+                                                         " " __TIME__ };
+#endif
+
+
+    /* what identifies an entry, the file it's in is named after source */
+    struct key
+    {
+        std::uint64_t version;
+        std::uint64_t source;
+        std::uint64_t path;
+        std::uint64_t size;
+    };
+
+    /* the magic, the key, then the payload's hash, lines and names */
+    constexpr std::size_t HEADER_SIZE { MAGIC.size() + (sizeof(key) + 8)
+                                        + (2 * sizeof(std::uint32_t)) };
+
+
+    /**
+     * $PATH along with when each of its directories last changed, which
+     * is whenever a program was added to or removed from one of them.
+     */
+    auto
+    path_generation(environment &env) -> std::uint64_t
+    {
+        const std::string *PATH { env.get(env.resolve("PATH")) };
+        if (PATH == nullptr) return 0;
+
+        std::uint64_t hash { cchell::shared::stable_hash(*PATH) };
+
+        for (auto part : *PATH | std::views::split(':'))
+        {
+            std::string directory { part.begin(), part.end() };
+            struct stat info {};
+
+            if (directory.empty() || stat(directory.c_str(), &info) < 0)
+                continue;
+
+            const std::array<std::int64_t, 3> changed {
+                static_cast<std::int64_t>(info.st_ino),
+                info.st_mtim.tv_sec,
+                info.st_mtim.tv_nsec,
+            };
+
+            hash = cchell::shared::stable_hash(
+                { reinterpret_cast<const char *>(changed.data()),
+                  sizeof changed },
+                hash);
+        }
+
+        return hash;
+    }
+
+
+    auto
+    make_key(std::string_view source, environment &env) -> key
+    {
+        return { .version = cchell::shared::stable_hash(VERSION),
+                 .source  = cchell::shared::stable_hash(source),
+                 .path    = path_generation(env),
+                 .size    = source.size() };
+    }
+
+
+    /* past this, the entries used the longest ago are removed */
+    constexpr std::uintmax_t MAX_CACHE_SIZE { 64UZ << 20 };
+
+
+    /* $XDG_CACHE_HOME/cchell, or ~/.cache/cchell, unless $CCHELL_NO_CACHE
+       is set to anything */
+    auto
+    entry_path(const key &entry) -> std::optional<std::filesystem::path>
+    {
+        std::filesystem::path directory;
+
+        if (const char *off { std::getenv("CCHELL_NO_CACHE") };
+            off != nullptr && *off != '\0')
+            return std::nullopt;
+
+        if (const char *xdg { std::getenv("XDG_CACHE_HOME") };
+            xdg != nullptr && *xdg == '/')
+            directory = xdg;
+        else if (const char *home { std::getenv("HOME") }; home != nullptr)
+            directory = std::filesystem::path { home } / ".cache";
+        else
+            return std::nullopt;
+
+        return directory / "cchell" / std::format("{:016x}", entry.source);
+    }
+
+
+    /* appends values as they are in memory, the version in the key
+       standing for their layout */
+    class writer
+    {
+    public:
+        explicit writer(std::string &out) : m_out(out) {}
+
+
+        template <typename T>
+            requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+        void
+        put(T value)
+        {
+            m_out.append(reinterpret_cast<const char *>(&value), sizeof value);
+        }
+
+
+        void
+        put(std::string_view string)
+        {
+            put(static_cast<std::uint32_t>(string.size()));
+            m_out.append(string);
+        }
+
+    private:
+        std::string &m_out;
+    };
+
+
+    /* the other side of writer, which fails once and then for good */
+    class reader
+    {
+    public:
+        explicit reader(std::string_view in, std::size_t offset = 0)
+            : m_in(in), m_offset(offset)
+        {
+        }
+
+
+        template <typename T>
+            requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+        auto
+        get() -> T
+        {
+            T value {};
+            if (!mf_take(sizeof value)) return value;
+
+            std::memcpy(&value, m_in.data() + m_offset - sizeof value,
+                        sizeof value);
+            return value;
+        }
+
+
+        auto
+        get_string() -> std::string_view
+        {
+            auto size { get<std::uint32_t>() };
+            if (!mf_take(size)) return {};
+
+            return m_in.substr(m_offset - size, size);
+        }
+
+
+        void
+        fail()
+        {
+            m_ok = false;
+        }
+
+
+        [[nodiscard]]
+        auto
+        ok() const -> bool
+        {
+            return m_ok;
+        }
+
+
+        [[nodiscard]]
+        auto
+        offset() const -> std::size_t
+        {
+            return m_offset;
+        }
+
+    private:
+        std::string_view m_in;
+        std::size_t      m_offset;
+        bool             m_ok { true };
+
+
+        auto
+        mf_take(std::size_t size) -> bool
+        {
+            if (!m_ok || m_in.size() - m_offset < size) return m_ok = false;
+
+            m_offset += size;
+            return true;
+        }
+    };
+
+
+    /* whether @param op's operand is a variable's slot */
+    auto
+    takes_slot(const instruction &op) -> bool
+    {
+        switch (op.op)
+        {
+        case opcode::expand: [[fallthrough]];
+        case opcode::assign: [[fallthrough]];
+        case opcode::set:    return true;
+        case opcode::modify: return (op.operand & POSITIONAL) == 0;
+        default:             return false;
+        }
+    }
+
+
+    auto
+    takes_slot(const arithmetic::step &step) -> bool
+    {
+        return step.code == arithmetic::op::load
+            || step.code == arithmetic::op::store;
+    }
+
+
+    /* reads what script_recorder::mf_chunk wrote */
+    auto
+    read_chunk(reader                            &in,
+               std::span<const environment::slot> slots,
+               const environment                 &env) -> chunk
+    {
+        chunk code;
+
+        auto slot_of { [&](std::uint64_t index) -> environment::slot
+                       {
+                           if (index < slots.size()) return slots[index];
+                           return in.fail(), 0;
+                       } };
+
+        code.frames = in.get<std::uint16_t>();
+
+        code.code.resize(in.get<std::uint32_t>());
+        for (instruction &op : code.code)
+        {
+            op.op      = in.get<opcode>();
+            op.reg     = in.get<std::uint16_t>();
+            op.operand = in.get<std::uint32_t>();
+
+            if (takes_slot(op)) op.operand = slot_of(op.operand);
+            if (!in.ok()) return {};
+        }
+
+        code.strings.resize(in.get<std::uint32_t>());
+        for (std::string &string : code.strings)
+            string = in.get_string();
+
+        for (auto i { in.get<std::uint32_t>() }; i > 0 && in.ok(); i--)
+        {
+            std::vector<brace_word::part> parts(in.get<std::uint32_t>());
+
+            for (brace_word::part &part : parts)
+            {
+                part.alternatives.resize(in.get<std::uint32_t>());
+                for (std::string &alternative : part.alternatives)
+                    alternative = in.get_string();
+
+                if (in.get<std::uint8_t>() == 0) continue;
+
+                part.range = brace_word::sequence {
+                    .first      = in.get<std::int64_t>(),
+                    .step       = in.get<std::int64_t>(),
+                    .count      = in.get<std::uint64_t>(),
+                    .width      = in.get<std::uint8_t>(),
+                    .characters = in.get<std::uint8_t>() != 0,
+                };
+            }
+
+            code.braces.emplace_back(std::move(parts));
+        }
+
+        code.arithmetics.resize(in.get<std::uint32_t>());
+        for (arithmetic &expression : code.arithmetics)
+        {
+            expression.steps.resize(in.get<std::uint32_t>());
+            for (arithmetic::step &step : expression.steps)
+            {
+                step.code  = in.get<arithmetic::op>();
+                step.value = in.get<std::int64_t>();
+
+                if (takes_slot(step))
+                    step.value = slot_of(static_cast<std::uint64_t>(
+                        step.value));
+                if (!in.ok()) return {};
+            }
+
+            expression.error = in.get_string();
+        }
+
+        for (auto i { in.get<std::uint32_t>() }; i > 0 && in.ok(); i--)
+        {
+            std::string name { in.get_string() };
+            auto body { std::make_shared<chunk>(read_chunk(in, slots, env)) };
+
+            code.functions.emplace_back(std::move(name), std::move(body));
+        }
+
+        code.bindings.resize(in.get<std::uint32_t>());
+        for (binding &target : code.bindings)
+        {
+            target.name    = in.get_string();
+            target.type    = in.get<binding::kind>();
+            target.builtin = in.get<std::uint32_t>();
+            target.path    = in.get_string();
+
+            /* what was resolved then still is, unless a function now has
+               the same name */
+            if (target.type != binding::kind::missing
+                && env.function(target.name) == nullptr)
+                target.generation = env.generation();
+        }
+
+        return code;
+    }
+
+
+    /**
+     * removes the entries of @param directory that were used the longest
+     * ago, until the rest fit in MAX_CACHE_SIZE. opening an entry touches
+     * it, so when it was last modified is when it was last used.
+     */
+    void
+    evict(const std::filesystem::path &directory)
+    {
+        namespace fs = std::filesystem;
+
+        struct cached
+        {
+            fs::path           path;
+            fs::file_time_type used;
+            std::uintmax_t     size;
+        };
+
+        std::vector<cached> entries;
+        std::uintmax_t      total { 0 };
+        std::error_code     error;
+
+        for (fs::directory_iterator it { directory, error };
+             !error && it != fs::directory_iterator {}; it.increment(error))
+        {
+            std::error_code failed;
+            auto            size { it->file_size(failed) };
+            auto            used { it->last_write_time(failed) };
+
+            if (failed) continue;
+
+            entries.emplace_back(it->path(), used, size);
+            total += size;
+        }
+
+        if (total <= MAX_CACHE_SIZE) return;
+
+        std::ranges::sort(entries, {}, &cached::used);
+
+        for (const cached &entry : entries)
+        {
+            if (total <= MAX_CACHE_SIZE) break;
+            if (fs::remove(entry.path, error)) total -= entry.size;
+        }
+    }
+
+
+    void
+    write_all(int fd, std::string_view data, bool &ok)
+    {
+        while (ok && !data.empty())
+        {
+            ssize_t written { ::write(fd, data.data(), data.size()) };
+
+            if (written < 0 && errno == EINTR) continue;
+
+            if (written <= 0)
+                ok = false;
+            else
+                data.remove_prefix(static_cast<std::size_t>(written));
+        }
+    }
+}
+
+
+auto
+stored_script::open(std::string_view source, environment &env)
+    -> std::optional<stored_script>
+{
+    const key  expected { make_key(source, env) };
+    const auto path { entry_path(expected) };
+    if (!path) return std::nullopt;
+
+    int fd { ::open(path->c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd < 0) return std::nullopt;
+
+    /* used now, which keeps it from being evicted, see evict() */
+    futimens(fd, nullptr);
+
+    struct stat info {};
+    void       *data { MAP_FAILED };
+
+    if (fstat(fd, &info) == 0
+        && static_cast<std::size_t>(info.st_size) > HEADER_SIZE)
+        data = mmap(nullptr, static_cast<std::size_t>(info.st_size),
+                    PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return std::nullopt;
+
+    stored_script script;
+    script.m_mapping = { static_cast<const char *>(data),
+                         static_cast<std::size_t>(info.st_size) };
+
+    reader in { script.m_mapping, MAGIC.size() };
+
+    const key stored { .version = in.get<std::uint64_t>(),
+                       .source  = in.get<std::uint64_t>(),
+                       .path    = in.get<std::uint64_t>(),
+                       .size    = in.get<std::uint64_t>() };
+    const auto payload_hash { in.get<std::uint64_t>() };
+
+    script.m_lines = in.get<std::uint32_t>();
+    auto names { in.get<std::uint32_t>() };
+
+    if (!script.m_mapping.starts_with(MAGIC)
+        || stored.version != expected.version
+        || stored.source != expected.source || stored.path != expected.path
+        || stored.size != expected.size
+        || cchell::shared::stable_hash(script.m_mapping.substr(HEADER_SIZE))
+               != payload_hash)
+        return std::nullopt;
+
+    script.m_slots.reserve(names);
+    for (; names > 0 && in.ok(); names--)
+        script.m_slots.emplace_back(env.resolve(in.get_string()));
+
+    if (!in.ok()) return std::nullopt;
+
+    script.m_offset = in.offset();
+    return script;
+}
+
+
+stored_script::stored_script(stored_script &&other) noexcept
+    : m_mapping(std::exchange(other.m_mapping, {})),
+      m_offset(other.m_offset),
+      m_end(other.m_end),
+      m_lines(other.m_lines),
+      m_slots(std::move(other.m_slots))
+{
+}
+
+
+stored_script::~stored_script()
+{
+    if (!m_mapping.empty())
+        munmap(const_cast<char *>(m_mapping.data()), m_mapping.size());
+}
+
+
+auto
+stored_script::next(const environment &env) -> std::optional<chunk>
+{
+    if (m_lines == 0) return std::nullopt;
+
+    reader in { m_mapping, m_offset };
+    m_end = in.get<std::uint64_t>();
+    chunk code { read_chunk(in, m_slots, env) };
+
+    /* the payload's hash matched, so this is only ever a format bug */
+    if (!in.ok()) return m_lines = 0, std::nullopt;
+
+    m_lines--;
+    m_offset = in.offset();
+    return code;
+}
+
+
+script_recorder::script_recorder(std::string_view source, environment &env)
+{
+    const key entry { make_key(source, env) };
+
+    if (auto path { entry_path(entry) }) m_path = path->string();
+
+    writer header { m_header };
+    m_header.append(MAGIC);
+    header.put(entry.version);
+    header.put(entry.source);
+    header.put(entry.path);
+    header.put(entry.size);
+}
+
+
+void
+script_recorder::add(const chunk       &code,
+                     const environment &env,
+                     std::size_t        end)
+{
+    if (m_path.empty()) return;
+
+    writer { m_payload }.put(static_cast<std::uint64_t>(end));
+    mf_chunk(code, env);
+    m_lines++;
+}
+
+
+void
+script_recorder::store()
+{
+    if (m_path.empty()) return;
+
+    /* the names come first, every line needs them resolved */
+    std::string body;
+    writer      out { body };
+    for (const std::string &name : m_names) out.put(name);
+    body += m_payload;
+
+    std::string header { m_header };
+    writer      head { header };
+    head.put(cchell::shared::stable_hash(body));
+    head.put(m_lines);
+    head.put(static_cast<std::uint32_t>(m_names.size()));
+
+    std::filesystem::path path { m_path };
+    std::error_code       error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    if (error) return;
+
+    /* written aside and renamed over, so a reader sees all of it or none */
+    std::string temporary { std::format("{}.{}", m_path, getpid()) };
+
+    int fd { ::open(temporary.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600) };
+    if (fd < 0) return;
+
+    bool ok { true };
+    write_all(fd, header, ok);
+    write_all(fd, body, ok);
+    ok = close(fd) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), m_path.c_str()) < 0)
+    {
+        unlink(temporary.c_str());
+        return;
+    }
+
+    evict(path.parent_path());
+}
+
+
+void
+script_recorder::mf_chunk(const chunk &code, const environment &env)
+{
+    writer out { m_payload };
+
+    out.put(code.frames);
+
+    out.put(static_cast<std::uint32_t>(code.code.size()));
+    for (instruction op : code.code)
+    {
+        if (takes_slot(op)) op.operand = mf_slot(op.operand, env);
+
+        out.put(op.op);
+        out.put(op.reg);
+        out.put(op.operand);
+    }
+
+    out.put(static_cast<std::uint32_t>(code.strings.size()));
+    for (const std::string &string : code.strings) out.put(string);
+
+    out.put(static_cast<std::uint32_t>(code.braces.size()));
+    for (const brace_word &word : code.braces)
+    {
+        out.put(static_cast<std::uint32_t>(word.parts().size()));
+
+        for (const brace_word::part &part : word.parts())
+        {
+            out.put(static_cast<std::uint32_t>(part.alternatives.size()));
+            for (const std::string &alternative : part.alternatives)
+                out.put(alternative);
+
+            out.put(static_cast<std::uint8_t>(part.range.has_value()));
+            if (!part.range) continue;
+
+            out.put(part.range->first);
+            out.put(part.range->step);
+            out.put(part.range->count);
+            out.put(part.range->width);
+            out.put(static_cast<std::uint8_t>(part.range->characters));
+        }
+    }
+
+    out.put(static_cast<std::uint32_t>(code.arithmetics.size()));
+    for (const arithmetic &expression : code.arithmetics)
+    {
+        out.put(static_cast<std::uint32_t>(expression.steps.size()));
+        for (arithmetic::step step : expression.steps)
+        {
+            if (takes_slot(step))
+                step.value = mf_slot(
+                    static_cast<environment::slot>(step.value), env);
+
+            out.put(step.code);
+            out.put(step.value);
+        }
+
+        out.put(expression.error);
+    }
+
+    out.put(static_cast<std::uint32_t>(code.functions.size()));
+    for (const chunk::definition &function : code.functions)
+    {
+        out.put(function.name);
+        mf_chunk(*function.body, env);
+    }
+
+    out.put(static_cast<std::uint32_t>(code.bindings.size()));
+    for (const binding &target : code.bindings)
+    {
+        /* a function can't be stored, it is looked up again instead, as
+           is anything resolved before its generation moved on */
+        bool current { target.generation == env.generation()
+                       && target.type != binding::kind::function };
+
+        out.put(target.name);
+        out.put(current ? target.type : binding::kind::missing);
+        out.put(target.builtin);
+        out.put(current ? std::string_view { target.path } : "");
+    }
+}
+
+
+auto
+script_recorder::mf_slot(environment::slot slot, const environment &env)
+    -> std::uint32_t
+{
+    constexpr auto UNSEEN { static_cast<std::uint32_t>(-1) };
+
+    if (slot >= m_indices.size()) m_indices.resize(slot + 1, UNSEEN);
+
+    if (m_indices[slot] == UNSEEN)
+    {
+        m_indices[slot] = static_cast<std::uint32_t>(m_names.size());
+        m_names.emplace_back(env.name(slot));
+    }
+
+    return m_indices[slot];
+}
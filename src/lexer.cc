@@ -1,13 +1,17 @@
+#include <algorithm>
+#include <array>
 #include <cstddef>
-#include <limits>
+#include <expected>
+#include <memory>
+#include <optional>
 #include <ranges>
-#include <stack>
+#include <span>
 #include <string_view>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "lexer.hh"
+#include "shared.hh"
 
 using cchell::diagnostics::diagnostic_builder;
 using cchell::diagnostics::severity;
@@ -79,25 +83,6 @@ namespace
     }
 
 
-    auto
-    find_next_whitespace(std::string_view string, std::size_t pos)
-        -> std::size_t
-    {
-        for (auto i : std::views::iota(pos, string.length()))
-            if (std::isspace(string[i]) != 0)
-            {
-                std::uint8_t backslash_count { 0 };
-
-                for (std::size_t j { i - 1 }; j >= 0 && string[j] == '\\'; j--)
-                    backslash_count++;
-
-                if (backslash_count % 2 == 0) return i;
-            }
-
-        return std::string_view::npos;
-    }
-
-
     [[nodiscard]]
     auto
     get_punct_token_type(char c) -> cchell::lexer::token_type
@@ -117,231 +102,615 @@ namespace
 
         case '$': return token_type::dollar;
 
+        case ';': return token_type::separator;
+
         default: return token_type::none;
         }
     }
 
 
-    auto
-    get_tokens_from_word(std::string_view                   word,
-                         std::size_t                        index,
-                         std::size_t                        line_start_index,
-                         cchell::source_location            source,
-                         std::vector<cchell::lexer::token> &out) -> std::size_t
+    /* everything the lexer needs to resume at a token boundary, which
+       is what lets line_lexer carry on where a line ended, and relexing
+       start right before an edit. */
+    struct lex_state
     {
-        using namespace cchell::lexer;
+        std::size_t             index { 0 };
+        std::size_t             line_start_index { 0 };
+        cchell::source_location source;
 
-        std::size_t start { 0 };
 
-        for (std::size_t i { 0 }; i < word.length(); i++)
+        void
+        sync_column()
         {
-            if (is_quote(word[i]) != quote_type::none) return i;
-            if (!is_punct(word[i])) continue;
-
-            if (i > start)
-            {
-                source.column = (index + start) - line_start_index;
-                out.emplace_back(token_type::word,
-                                 word.substr(start, i - start), source);
-            }
+            source.column = index - line_start_index;
+        }
 
-            source.column = (index + i) - line_start_index;
-            out.emplace_back(get_punct_token_type(word[i]), word.substr(i, 1),
-                             source);
 
-            start = i + 1;
+        void
+        new_line()
+        {
+            source.line++;
+            line_start_index = ++index;
+            source.column    = 0;
         }
+    };
+
+
+    /* skips whitespaces, stopping at the next token or newline. */
+    void
+    skip_blank(std::string_view string, lex_state &state)
+    {
+        while (state.index < string.length() && string[state.index] != '\n'
+               && std::isspace(string[state.index]) != 0)
+            state.index++;
+
+        state.sync_column();
+    }
+
 
-        if (start < word.length())
+    void
+    get_tokens_from_word(std::string_view                   string,
+                         lex_state                         &state,
+                         std::vector<cchell::lexer::token> &out)
+    {
+        using cchell::lexer::token_type;
+
+        std::size_t             start { state.index };
+        cchell::source_location source { state.source };
+
+        while (state.index < string.length())
         {
-            source.column = (index + start) - line_start_index;
-            out.emplace_back(token_type::word, word.substr(start), source);
+            char c { string[state.index] };
+
+            if (std::isspace(c) != 0 || is_punct(c)
+                || is_quote(c) != quote_type::none)
+                break;
+
+            if (c == '\\' && state.index + 1 < string.length())
+            {
+                if (string[++state.index] == '\n')
+                {
+                    state.new_line();
+                    continue;
+                }
+            }
+
+            state.index++;
         }
 
-        return std::numeric_limits<std::size_t>::max();
+        out.emplace_back(token_type::word,
+                         string.substr(start, state.index - start), source);
+        state.sync_column();
     }
 
 
+    /* returns false if the string is never closed, in which case
+       the rest of the input belongs to it and lexing has to stop. */
     auto
     get_tokens_from_string(std::string_view                   string,
-                           std::size_t                       &index,
-                           std::size_t                       &line_start_index,
-                           cchell::source_location           &source,
-                           std::vector<cchell::lexer::token> &tokens)
-        -> std::uint8_t
+                           lex_state                         &state,
+                           std::vector<cchell::lexer::token> &tokens) -> bool
     {
         using cchell::lexer::token_type;
-        if (is_quote(string[index]) == quote_type::none) return 0;
 
-        tokens.emplace_back(token_type::quote, string.substr(index, 1), source);
-        source.column++;
+        char quote { string[state.index] };
+
+        tokens.emplace_back(token_type::quote, string.substr(state.index, 1),
+                            state.source);
+        state.index++;
+        state.sync_column();
 
-        std::size_t closing_quote { string.find(string[index], index + 1) };
-        if (closing_quote == std::string::npos)
+        std::size_t             start { state.index };
+        cchell::source_location source { state.source };
+
+        while (state.index < string.length() && string[state.index] != quote)
         {
-            tokens.emplace_back(token_type::word, string.substr(index + 1),
-                                source);
-            return 2;
+            if (quote == '"' && string[state.index] == '\\'
+                && state.index + 1 < string.length())
+                state.index++;
+
+            if (string[state.index] == '\n')
+                state.new_line();
+            else
+                state.index++;
         }
 
-        std::size_t len { closing_quote - (index + 1) };
+        tokens.emplace_back(token_type::word,
+                            string.substr(start, state.index - start), source);
+        state.sync_column();
 
-        tokens.emplace_back(token_type::word, string.substr(index + 1, len),
-                            source);
+        if (state.index >= string.length()) return false;
 
+        tokens.emplace_back(token_type::quote, string.substr(state.index, 1),
+                            state.source);
+        state.index++;
+        state.sync_column();
 
-        for (std::size_t i { index + 1 }; i < closing_quote; i++)
+        return true;
+    }
+
+
+    /* lexes a single top-level step starting at a token boundary,
+       returns false when the lexer can't continue. */
+    auto
+    lex_step(std::string_view                   string,
+             lex_state                         &state,
+             std::vector<cchell::lexer::token> &tokens) -> bool
+    {
+        using cchell::lexer::token_type;
+
+        char c { string[state.index] };
+
+        if (c == '\n')
         {
-            if (string[i] == '\n')
-            {
-                source.line++;
-                source.column    = 0;
-                line_start_index = ++index;
-            }
-            else
-                source.column++;
+            tokens.emplace_back(token_type::separator,
+                                string.substr(state.index, 1), state.source);
+            state.new_line();
+            return true;
         }
 
+        if (is_quote(c) != quote_type::none)
+            return get_tokens_from_string(string, state, tokens);
 
-        tokens.emplace_back(token_type::quote, string.substr(closing_quote, 1),
-                            source);
-        source.column++;
+        /* && and ||, and the ;; ending a case item */
+        if ((c == '&' || c == '|' || c == ';')
+            && state.index + 1 < string.length()
+            && string[state.index + 1] == c)
+        {
+            tokens.emplace_back(c == ';' ? token_type::separator
+                                         : token_type::logical,
+                                string.substr(state.index, 2), state.source);
+            state.index += 2;
+            state.sync_column();
+            return true;
+        }
 
-        index = closing_quote + 1;
-        return 1;
+        if (is_punct(c))
+        {
+            tokens.emplace_back(get_punct_token_type(c),
+                                string.substr(state.index, 1), state.source);
+            state.index++;
+            state.sync_column();
+            return true;
+        }
+
+        get_tokens_from_word(string, state, tokens);
+        return true;
     }
-}
 
 
-auto
-cchell::lexer::lex(std::string_view string) -> std::vector<token>
-{
-    std::vector<token> tokens;
-    tokens.reserve(string.size() / 2);
+    [[nodiscard]]
+    auto
+    unclosed_quote(const cchell::lexer::token &quote)
+        -> cchell::diagnostics::diagnostic
+    {
+        return diagnostic_builder { severity::error }
+            .domain("cchell::lexer")
+            .message("unclosed quote {} found.", quote.data())
+            .annotation("consider adding a closing {}.", quote.data())
+            .source(quote.source())
+            .incomplete()
+            .build();
+    }
 
-    std::size_t      index { 0 };
-    std::size_t      line_start_index { 0 };
-    source_location  source;
-    bool             escaped { false };
 
-    while (index < string.length())
+    /* bracket and quote balance, tracked token by token so it can run
+       inside the lexing pass itself. */
+    class balance
     {
-        char c { string[index] };
+    public:
+        [[nodiscard]]
+        auto
+        feed(const cchell::lexer::token &token)
+            -> std::optional<cchell::diagnostics::diagnostic>
+        {
+            using cchell::lexer::token_type;
+
+            if (token.type() == token_type::quote)
+            {
+                m_quote = m_quote ? std::nullopt : std::optional { token };
+                return std::nullopt;
+            }
+
+            bool command_position { m_command_position };
+            m_command_position = starts_command(token);
+
+            /* case ... esac nests like a bracket, so that the ) ending
+               each of its patterns isn't taken for an extra one */
+            if (token.type() == token_type::word && command_position)
+            {
+                if (token.data() == "case")
+                    m_open.push({ "case", token.source() });
+                else if (token.data() == "esac" && !m_open.empty()
+                         && m_open.top().opening == "case")
+                    m_open.pop();
+            }
+
+            if (token.type() != token_type::bracket) return std::nullopt;
+
+            char c { token.data()[0] };
+
+            if (c == '(' || c == '{' || c == '[')
+            {
+                m_open.push({ token.data(), token.source() });
+                return std::nullopt;
+            }
 
-        if (!escaped && c == '\n')
+            if (m_open.empty())
+                return diagnostic_builder { severity::error }
+                    .domain("cchell::lexer")
+                    .message("extra closing bracket '{}' found.", c)
+                    .annotation("try removing the '{}'.", c)
+                    .source(token.source())
+                    .build();
+
+            auto [open, _] { m_open.top() };
+
+            if (c == ')' && open == "case")
+            {
+                m_command_position = true;
+                return std::nullopt;
+            }
+
+            if (open[0] != matching_open(c))
+                return diagnostic_builder { severity::error }
+                    .domain("cchell::lexer")
+                    .message("closing bracket '{}' doesn't match '{}'.", c,
+                             open)
+                    .annotation("consider closing the '{}' first.", open)
+                    .source(token.source())
+                    .build();
+
+            m_open.pop();
+            return std::nullopt;
+        }
+
+
+        /* whether every bracket and quote opened so far was closed */
+        [[nodiscard]]
+        auto
+        closed() const noexcept -> bool
         {
-            source.line++;
-            source.column    = 0;
-            line_start_index = ++index;
+            return m_open.empty() && !m_quote;
+        }
+
+
+        [[nodiscard]]
+        auto
+        finish() const -> std::optional<cchell::diagnostics::diagnostic>
+        {
+            if (m_quote) return unclosed_quote(*m_quote);
+            if (m_open.empty()) return std::nullopt;
+
+            auto [open, source] { m_open.top() };
 
-            continue;
+            return diagnostic_builder { severity::error }
+                .domain("cchell::lexer")
+                .message("unclosed '{}' found.", open)
+                .annotation("consider adding a closing '{}'.",
+                            closing_of(open))
+                .source(source)
+                .incomplete()
+                .build();
         }
 
-        if (!escaped && c == '\\')
+    private:
+        struct open_bracket
+        {
+            std::string_view        opening;
+            cchell::source_location source;
+        };
+
+        cchell::shared::inline_stack<open_bracket, 32> m_open;
+        std::optional<cchell::lexer::token>            m_quote;
+        bool m_command_position { true };
+
+
+        [[nodiscard]]
+        static constexpr auto
+        closing_of(std::string_view open) -> std::string_view
         {
-            escaped = true;
-            index++;
-            continue;
+            if (open == "(") return ")";
+            if (open == "{") return "}";
+            if (open == "[") return "]";
+            return "esac";
         }
 
-        if (std::uint8_t res { get_tokens_from_string(
-                string, index, line_start_index, source, tokens) };
-            res == 1)
-            continue;
-        else if (res == 2) /* NOLINT: Do not use 'else' after 'return' */
-            return tokens;
 
-        if (!escaped && std::isspace(c) != 0)
+        /* whether the token after @param token starts a command */
+        [[nodiscard]]
+        static auto
+        starts_command(const cchell::lexer::token &token) -> bool
         {
-            index++;
-            source.column = index - line_start_index;
+            using cchell::lexer::token_type;
+
+            switch (token.type())
+            {
+            case token_type::separator: [[fallthrough]];
+            case token_type::logical:   [[fallthrough]];
+            case token_type::pipe:      return true;
+
+            case token_type::bracket:
+                return token.data() == "(" || token.data() == "{";
+
+            case token_type::word:
+            {
+                constexpr std::array<std::string_view, 7> KEYWORDS {
+                    "if", "then", "elif", "else", "while", "until", "do"
+                };
+
+                return std::ranges::find(KEYWORDS, token.data())
+                    != KEYWORDS.end();
+            }
+
+            default: return false;
+            }
         }
+    };
 
-        std::size_t next_whitespace { find_next_whitespace(string, index + 1) };
-        if (next_whitespace == std::string_view::npos)
-            next_whitespace = string.length();
 
-        std::string_view word { string.data() + index,
-                                next_whitespace - index };
+    [[nodiscard]]
+    auto
+    offset_of(const cchell::lexer::token &token, const char *base)
+        -> std::size_t
+    {
+        return static_cast<std::size_t>(token.data().data() - base);
+    }
 
-        std::size_t skip { get_tokens_from_word(word, index, line_start_index,
-                                                source, tokens) };
 
-        if (skip != std::numeric_limits<std::size_t>::max())
-            index = skip;
-        else
-            index = next_whitespace;
+    /* a token is a safe place to resume lexing when it is not adjacent
+       to the token before it, which rules out anything inside a quote */
+    [[nodiscard]]
+    auto
+    is_boundary(std::span<const cchell::lexer::token> tokens, std::size_t i)
+        -> bool
+    {
+        if (i == 0) return true;
 
-        source.column = index - line_start_index;
-        escaped = false;
+        const auto &prev { tokens[i - 1].data() };
+        return prev.data() + prev.length() != tokens[i].data().data();
     }
 
-    return tokens;
+
 }
 
 
+struct cchell::lexer::line_lexer::state
+{
+    lex_state position;
+    balance   brackets;
+};
+
+
+cchell::lexer::line_lexer::line_lexer(std::string_view source)
+    : m_source { source }, m_state { std::make_unique<state>() }
+{
+}
+
+
+cchell::lexer::line_lexer::line_lexer(std::string_view source,
+                                      std::size_t      offset,
+                                      source_location  location)
+    : line_lexer { source }
+{
+    auto &position { m_state->position };
+
+    position.index            = offset;
+    position.source           = location;
+    position.line_start_index = offset - location.column;
+}
+
+
+cchell::lexer::line_lexer::line_lexer(line_lexer &&) noexcept = default;
+
+
 auto
-cchell::lexer::impl::verifier::operator()(
-    const std::vector<token> &tokens) const -> std::optional<diagnostic>
+cchell::lexer::line_lexer::operator=(line_lexer &&) noexcept
+    -> line_lexer & = default;
+
+
+cchell::lexer::line_lexer::~line_lexer() = default;
+
+
+auto
+cchell::lexer::line_lexer::next(std::vector<token> &tokens)
+    -> std::expected<bool, diagnostics::diagnostic>
 {
-    std::unordered_map<char, std::stack<source_location>> bracket {
-        { '(', {} },
-        { '{', {} },
-        { '[', {} }
-    };
+    auto &[position, brackets] { *m_state };
 
-    const token *quote { nullptr };
+    if (skip_blank(m_source, position), position.index >= m_source.length())
+        return false;
 
-    for (const token &token : tokens)
+    do
     {
-        if (token.type() == token_type::bracket)
-        {
-            char c { token.data()[0] };
+        std::size_t first { tokens.size() };
+        bool        closed { lex_step(m_source, position, tokens) };
 
-            if (c == '(' || c == '{' || c == '[')
-                bracket[c].push(token.source());
-            else
-            {
-                char open { matching_open(c) };
+        for (std::size_t i { first }; i < tokens.size(); i++)
+            if (auto diag { brackets.feed(tokens[i]) })
+                return std::unexpected { *diag };
 
-                if (open == 0 || bracket[open].empty())
-                    return diagnostic_builder { severity::error }
-                        .domain("cchell::lexer")
-                        .message("extra closing bracket '{}' found.", c)
-                        .annotation("try removing the '{}'.", c)
-                        .source(token.source())
-                        .build();
+        /* the quote is left open, finish() reports it */
+        if (!closed) break;
 
-                bracket[open].pop();
-            }
-            continue;
-        }
+        /* a newline outside of any bracket is where a line ends */
+        const token &last { tokens.back() };
+        if (last.type() == token_type::separator && last.data() == "\n"
+            && brackets.closed())
+            return true;
+    } while (skip_blank(m_source, position),
+             position.index < m_source.length());
+
+    if (auto diag { brackets.finish() }) return std::unexpected { *diag };
+
+    return true;
+}
+
+
+auto
+cchell::lexer::line_lexer::step(std::vector<token> &tokens) -> bool
+{
+    auto &position { m_state->position };
+
+    if (skip_blank(m_source, position), position.index >= m_source.length())
+        return false;
+
+    return lex_step(m_source, position, tokens);
+}
 
-        if (token.type() == token_type::quote)
+
+auto
+cchell::lexer::line_lexer::done() const noexcept -> bool
+{
+    return m_state->position.index >= m_source.length();
+}
+
+
+auto
+cchell::lexer::line_lexer::offset() const noexcept -> std::size_t
+{
+    lex_state position { m_state->position };
+    skip_blank(m_source, position);
+    return position.index;
+}
+
+
+auto
+cchell::lexer::line_lexer::location() const noexcept -> source_location
+{
+    lex_state position { m_state->position };
+    skip_blank(m_source, position);
+    return position.source;
+}
+
+
+auto
+cchell::lexer::lex(std::string_view string)
+    -> std::expected<std::vector<token>, diagnostics::diagnostic>
+{
+    std::vector<token> tokens;
+    tokens.reserve(string.size() / 2);
+
+    line_lexer lines { string };
+
+    for (;;)
+    {
+        auto more { lines.next(tokens) };
+
+        if (!more) return std::unexpected { std::move(more.error()) };
+        if (!*more) return tokens;
+    }
+}
+
+
+void
+cchell::lexer::relex(std::string_view    string,
+                     std::vector<token> &tokens,
+                     const char         *previous,
+                     edit                change)
+{
+    /* the first token that the edit could have touched, moved back
+       to the nearest boundary so we never start inside a quote. */
+    auto first { std::ranges::partition_point(
+        tokens, [&](const token &t) -> bool
+        { return offset_of(t, previous) + t.data().length() < change.offset; }) };
+
+    auto restart { static_cast<std::size_t>(first - tokens.begin()) };
+    if (restart > 0
+        && (restart == tokens.size()
+            || offset_of(tokens[restart], previous) > change.offset))
+        restart--;
+    while (!is_boundary(tokens, restart)) restart--;
+
+    /* an edit before the first token lexes it all again */
+    bool       resumes { restart < tokens.size()
+                   && offset_of(tokens[restart], previous) <= change.offset };
+    line_lexer lexer { resumes ? line_lexer { string,
+                                              offset_of(tokens[restart],
+                                                        previous),
+                                              tokens[restart].source() }
+                               : line_lexer { string } };
+
+    auto shift { static_cast<std::ptrdiff_t>(change.inserted)
+                 - static_cast<std::ptrdiff_t>(change.removed) };
+    std::size_t edit_end { change.offset + change.inserted };
+
+    std::vector<token> fresh;
+    std::size_t        old { restart };
+    bool               synced { false };
+
+    while (!lexer.done())
+    {
+        /* once past the edit, try to line up with an old boundary, from
+           that point on the old stream is identical, only displaced. */
+        if (std::size_t index { lexer.offset() };
+            index >= edit_end && old < tokens.size())
         {
-            if (quote == nullptr)
-                quote = &token;
-            else
-                quote = nullptr;
+            std::size_t old_index { index - shift };
+
+            while (old < tokens.size()
+                   && offset_of(tokens[old], previous) < old_index)
+                old++;
+
+            if (old < tokens.size()
+                && offset_of(tokens[old], previous) == old_index
+                && is_boundary(tokens, old))
+            {
+                synced = true;
+                break;
+            }
         }
+
+        if (!lexer.step(fresh)) break;
     }
 
-    for (const auto &[open, stack] : bracket)
-        if (!stack.empty())
-            return diagnostic_builder { severity::error }
-                .domain("cchell::lexer")
-                .message("unclosed bracket '{}' found.", open)
-                .annotation("consider adding a closing '{}'.", open)
-                .source(stack.top())
-                .build();
+    if (!synced) old = tokens.size();
 
-    if (quote != nullptr)
-        return diagnostic_builder { severity::error }
-            .domain("cchell::lexer")
-            .message("unclosed quote {} found.", quote->data())
-            .annotation("consider adding a closing {}.", quote->data())
-            .source(quote->source())
-            .build();
+    /* displace the untouched tail into the new buffer */
+    source_location here { lexer.location() };
+    source_location anchor { old < tokens.size() ? tokens[old].source()
+                                                 : source_location {} };
+    auto line_shift { static_cast<std::int64_t>(here.line) - anchor.line };
+    auto column_shift { static_cast<std::int64_t>(here.column)
+                        - anchor.column };
+
+    for (std::size_t i { old }; i < tokens.size(); i++)
+    {
+        const token    &t { tokens[i] };
+        source_location source { t.source() };
+
+        if (source.line == anchor.line) source.column += column_shift;
+        source.line += line_shift;
+
+        tokens[i] = token { t.type(),
+                            string.substr(offset_of(t, previous) + shift,
+                                          t.data().length()),
+                            source };
+    }
+
+    /* the untouched head only needs to point at the new buffer */
+    for (std::size_t i { 0 }; previous != string.data() && i < restart; i++)
+    {
+        const token &t { tokens[i] };
+        tokens[i] = token { t.type(),
+                            string.substr(offset_of(t, previous),
+                                          t.data().length()),
+                            t.source() };
+    }
+
+    auto tail { tokens.erase(tokens.begin() + restart, tokens.begin() + old) };
+    tokens.insert(tail, fresh.begin(), fresh.end());
+}
+
+
+auto
+cchell::lexer::impl::verifier::operator()(
+    const std::vector<token> &tokens) const -> std::optional<diagnostic>
+{
+    balance brackets;
+
+    for (const token &token : tokens)
+        if (auto diag { brackets.feed(token) }) return diag;
 
-    return std::nullopt;
+    return brackets.finish();
 }
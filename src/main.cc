@@ -1,20 +1,30 @@
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <format>
+#include <fstream>
 #include <memory>
+#include <optional>
 #include <print>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <lyra/lyra.hpp>
-#include <sys/wait.h>
 
 #include "diagnostics.hh"
-#include "formatters.hh"
 #include "input.hh"
 #include "interpreter.hh"
 #include "lexer.hh"
 #include "parser.hh"
 #include "shared.hh"
+#include "terminal.hh"
 
 
 namespace
@@ -25,11 +35,16 @@ namespace
         /* clang-format off */
         std::print(
 "Usage: {} [options {{params}}] -- <commands>\n"
+"       {} [options {{params}}] <script>\n"
+"\n"
+"Without commands or a script, a script is read from stdin unless it is a\n"
+"terminal.\n"
 "\n"
 "Options:\n"
 "  -h --help                    Show this message.\n"
 "  -V --version                 Show version info.\n"
-, binary_name
+"  -n --check     {{file}}        Parse and verify a script without running it.\n"
+, binary_name, binary_name
         );
         /* clang-format on */
     }
@@ -67,73 +82,449 @@ namespace
     }
 
 
+    /* runs all of @param source at once, @param name being what
+       diagnostics call it */
+    auto
+    run_source(std::string_view                  source,
+               std::string_view                  name,
+               cchell::interpreter::environment &env) -> int
+    {
+        auto tokens { cchell::lexer::lex(source) };
+
+        if (!tokens)
+        {
+            std::cerr << tokens.error().render(source, name);
+            return 1;
+        }
+
+        cchell::parser::ast ast;
+
+        if (auto diag { cchell::parser::parse(*tokens, ast) })
+        {
+            std::cerr << diag->render(source, name);
+            return 1;
+        }
+
+        if (auto diag { cchell::parser::check_in(env)(ast) })
+        {
+            std::cerr << diag->render(source, name);
+            return 1;
+        }
+
+        auto status { cchell::interpreter::execute(
+            cchell::interpreter::compile(ast, env), env) };
+
+        if (!status)
+        {
+            std::cerr << status.error() << '\n';
+            return 1;
+        }
+
+        return *status;
+    }
+
+
+    /* how many lines the parser may get ahead of the ones running */
+    constexpr std::size_t LOOKAHEAD { 256 };
+
+
+    /* moves @param fd, the script's own fd if what it runs shares it and
+       -1 otherwise, right past the line about to run, where sh would have
+       read up to. what runs then reads on from there */
     void
-    fill_global_env(char **envp)
+    seek_past(int fd, std::size_t end)
+    {
+        if (fd >= 0) lseek(fd, static_cast<off_t>(end), SEEK_SET);
+    }
+
+
+    /* whether what ran read on from where seek_past() left @param fd */
+    auto
+    read_past(int fd, std::size_t end) -> bool
+    {
+        return fd >= 0 && lseek(fd, 0, SEEK_CUR) != static_cast<off_t>(end);
+    }
+
+
+    /**
+     * runs all of @param source a line at a time, while a second thread
+     * lexes and parses the lines ahead of the one running. a syntax error
+     * is only reported once every line before it ran, the same as it
+     * would be for a script coming through a pipe. a script that ran to
+     * its end is stored, see interpreter::stored_script.
+     *
+     * @param shared is as for seek_past(). once what ran read some of the
+     * script, std::nullopt is returned so the rest is read from the fd.
+     */
+    auto
+    run_pipelined(std::string_view                  source,
+                  std::string_view                  name,
+                  int                               shared,
+                  cchell::interpreter::environment &env) -> std::optional<int>
     {
-        for (char **p { envp }; *p != nullptr; p++)
+        using cchell::diagnostics::diagnostic;
+
+        struct line
+        {
+            cchell::parser::ast       tree;
+            std::optional<diagnostic> error;
+            std::size_t               end { 0 }; /* in the source */
+        };
+
+        /* trees go back to the parser once run, so their storage is only
+           allocated once. there are never more of them than fit in both
+           queues, so handing one back never blocks */
+        using owned_line = std::unique_ptr<line>;
+        cchell::shared::bounded_queue<owned_line> parsed { LOOKAHEAD };
+        cchell::shared::bounded_queue<owned_line> spare { LOOKAHEAD + 2 };
+
+        std::jthread parser {
+            [&]
+            {
+                cchell::lexer::line_lexer         lines { source };
+                std::vector<cchell::lexer::token> tokens;
+                std::size_t                       index { 0 };
+                owned_line                        next;
+                std::optional<diagnostic>         late;
+
+                /* lines are lexed as they are needed, and a statement still
+                   missing its end is parsed again once there are more of
+                   them. twice as many are added each time, so a long one
+                   isn't parsed once per line it spans */
+                for (std::size_t wanted { 1 };;)
+                {
+                    for (std::size_t i { 0 }; i < wanted && !lines.done(); i++)
+                    {
+                        std::size_t lexed { tokens.size() };
+                        auto        more { lines.next(tokens) };
+
+                        /* what comes before a lexer error still gets to run */
+                        if (!more)
+                        {
+                            late = std::move(more.error());
+                            tokens.erase(tokens.begin() + lexed, tokens.end());
+                            break;
+                        }
+                    }
+
+                    bool last { late || lines.done() };
+
+                    while (index < tokens.size())
+                    {
+                        if (!next) next = spare.try_pop().value_or(nullptr);
+                        if (!next) next = std::make_unique<line>();
+
+                        std::size_t start { index };
+                        next->error = cchell::parser::parse_line(tokens, index,
+                                                                 next->tree);
+
+                        if (next->error && next->error->incomplete)
+                        {
+                            if (!last)
+                            {
+                                index = start;
+                                wanted *= 2;
+                                break;
+                            }
+
+                            /* the lexer error is what left it unfinished */
+                            if (late) next->error = std::exchange(late, {});
+                        }
+
+                        bool failed { next->error.has_value() };
+
+                        if (!failed)
+                        {
+                            const auto &last { tokens[index - 1].data() };
+                            next->end = static_cast<std::size_t>(
+                                last.data() + last.size() - source.data());
+                        }
+
+                        if (!parsed.push(std::move(next)) || failed)
+                            return parsed.close();
+                    }
+
+                    if (last) break;
+
+                    /* the trees only point into the source, not the tokens */
+                    if (index == tokens.size())
+                    {
+                        tokens.clear();
+                        index  = 0;
+                        wanted = 1;
+                    }
+                }
+
+                if (late)
+                    parsed.push(std::make_unique<line>(
+                        line { .tree = {}, .error = std::move(late) }));
+                parsed.close();
+            }
+        };
+
+        cchell::interpreter::script_recorder recorder { source, env };
+        int                                  status { 0 };
+        bool                                 finished { true };
+        bool                                 read { false };
+
+        while (auto popped { parsed.pop() })
         {
-            std::string_view env { *p };
+            owned_line next { std::move(*popped) };
+
+            std::optional<diagnostic> error { std::move(next->error) };
+            if (!error) error = cchell::parser::check_in(env)(next->tree);
+
+            if (error)
+            {
+                std::cerr << error->render(source, name);
+                status   = 1;
+                finished = false;
+                break;
+            }
+
+            auto code { cchell::interpreter::compile(next->tree, env) };
+
+            seek_past(shared, next->end);
+            auto result { cchell::interpreter::execute(code, env) };
+
+            if (!result) std::cerr << result.error() << '\n';
+            status = result.value_or(1);
+
+            recorder.add(code, env, next->end);
 
-            if (auto idx { env.find('=') }; idx != std::string_view::npos)
-                cchell::shared::envp.emplace(env.substr(0, idx),
-                                             env.substr(idx + 1));
+            if (auto exit { env.exit_requested() })
+            {
+                /* an exit on the last line still leaves it all compiled */
+                status   = *exit;
+                finished = !parsed.pop();
+                break;
+            }
+
+            if (read_past(shared, next->end))
+            {
+                read     = true;
+                finished = false;
+                break;
+            }
+
+            spare.push(std::move(next));
         }
+
+        parsed.close();
+        spare.close();
+
+        if (finished) recorder.store();
+        if (read) return std::nullopt;
+        return status;
     }
 
 
+    /**
+     * runs @param input a statement at a time, each as soon as it is
+     * complete, so a pipe is acted on before its writer is done. a
+     * statement grows by a line for as long as it is only missing its end.
+     */
     auto
-    run_commands_from_argv(std::string_view commands) -> int
+    run_stream(cchell::input::stream_input      &input,
+               std::string_view                  name,
+               cchell::interpreter::environment &env) -> int
     {
-        auto tokens { cchell::lexer::lex(commands) };
+        cchell::parser::ast ast;
+        std::string         statement;
+        std::string         line;
+        int                 status { 0 };
+        int                 res;
+
+        while ((res = input.read(line)) == 0)
+        {
+            statement += line;
+
+            if (statement.find_first_not_of(" \t\n") == std::string::npos)
+            {
+                statement.clear();
+                continue;
+            }
+
+            auto tokens { cchell::lexer::lex(statement) };
 
-        if (auto diag { cchell::lexer::verify(tokens) })
+            if (!tokens)
+            {
+                if (tokens.error().incomplete) continue;
+
+                std::cerr << tokens.error().render(statement, name);
+                return 1;
+            }
+
+            if (auto diag { cchell::parser::parse(*tokens, ast) })
+            {
+                if (diag->incomplete) continue;
+
+                std::cerr << diag->render(statement, name);
+                return 1;
+            }
+
+            if (auto diag { cchell::parser::check_in(env)(ast) })
+            {
+                std::cerr << diag->render(statement, name);
+                return 1;
+            }
+
+            auto result { cchell::interpreter::execute(
+                cchell::interpreter::compile(ast, env), env) };
+
+            if (!result) std::cerr << result.error() << '\n';
+            status = result.value_or(1);
+            statement.clear();
+
+            /* whoever reads the other end sees each statement's output as
+               it finishes, not once the writer is done */
+            std::cout.flush();
+
+            if (auto exit { env.exit_requested() }) return *exit;
+        }
+
+        if (res != EOF)
         {
-            std::cerr << diag->render(commands, "argv");
+            std::println(std::cerr, "cchell: {}: {}", name,
+                         std::strerror(res));
             return 1;
         }
 
-        // std::println("{}", tokens);
+        /* what is left could only have been finished by more input */
+        if (!statement.empty()) return run_source(statement, name, env);
+
+        return status;
+    }
 
-        auto ast { cchell::parser::parse(tokens) };
 
-        if (auto diag { cchell::parser::verify(*ast) })
+    /* as run_pipelined(), for the chunks stored the last time it ran */
+    auto
+    run_stored(cchell::interpreter::stored_script &script,
+               int                                 shared,
+               cchell::interpreter::environment   &env) -> std::optional<int>
+    {
+        int status { 0 };
+
+        while (auto code { script.next(env) })
         {
-            std::cerr << diag->render(commands, "argv");
-            return 1;
+            seek_past(shared, script.end());
+            auto result { cchell::interpreter::execute(*code, env) };
+
+            if (!result) std::cerr << result.error() << '\n';
+            status = result.value_or(1);
+
+            if (auto exit { env.exit_requested() }) return *exit;
+            if (read_past(shared, script.end())) return std::nullopt;
         }
 
-        // std::println("{}", *ast);
+        return status;
+    }
+
 
-        pid_t child_pid { -1 };
-        if (auto buf { cchell::interpreter::execute(ast) }; !buf)
+    auto
+    run_script(int                               fd,
+               std::string_view                  name,
+               cchell::interpreter::environment &env) -> int
+    {
+        /* the commands of a script on stdin read from it too */
+        const bool                  shared { fd == STDIN_FILENO };
+        cchell::input::stream_input input { fd, shared };
+
+        /* a file is there in full, so it is lexed in place, unless it ran
+           before and its chunks were stored */
+        if (auto source { input.mapped() })
         {
-            std::cerr << buf.error() << '\n';
-            return 1;
+            const int seek { shared ? fd : -1 };
+
+            auto stored { cchell::interpreter::stored_script::open(*source,
+                                                                   env) };
+            auto status { stored ? run_stored(*stored, seek, env)
+                                 : run_pipelined(*source, name, seek, env) };
+            if (status) return *status;
+        }
+
+        /* what is left of a script that what ran read from goes on from
+           where it stopped, see stream_input */
+        return run_stream(input, name, env);
+    }
+
+
+    /* lexes, parses and verifies @param path, returning the rendered
+       diagnostic or an empty string */
+    auto
+    check_file(const std::string &path) -> std::string
+    {
+        std::ifstream file { path };
+        if (!file) return std::format("{}: {}\n", path, std::strerror(errno));
+
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string source { buffer.str() };
+
+        auto tokens { cchell::lexer::lex(source) };
+        if (!tokens) return tokens.error().render(source, path);
+
+        cchell::parser::ast ast;
+
+        if (auto diag { cchell::parser::parse(*tokens, ast) })
+            return diag->render(source, path);
+
+        if (auto diag { cchell::parser::check(ast) })
+            return diag->render(source, path);
+
+        return {};
+    }
+
+
+    /* every file is checked on its own worker, the parser keeps no state
+       outside of the context a single parse owns */
+    auto
+    check_files(const std::vector<std::string> &paths) -> int
+    {
+        std::vector<std::string> results(paths.size());
+        std::atomic_size_t       next { 0 };
+
+        {
+            const auto count { std::clamp<std::size_t>(
+                std::thread::hardware_concurrency(), 1, paths.size()) };
+
+            std::vector<std::jthread> workers;
+            workers.reserve(count);
+
+            for (std::size_t i { 0 }; i < count; i++)
+                workers.emplace_back(
+                    [&]
+                    {
+                        for (auto j { next++ }; j < paths.size(); j = next++)
+                            results[j] = check_file(paths[j]);
+                    });
         }
-        else /* NOLINT: Do not use 'else' after 'return' */
-            child_pid = *buf;
 
         int status { 0 };
-        if (waitpid(child_pid, &status, 0) == -1) return 1;
 
-        if (WIFEXITED(status)) return WEXITSTATUS(status);
-        if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+        for (const auto &result : results)
+        {
+            if (result.empty()) continue;
+            std::cerr << result;
+            status = 1;
+        }
 
-        return 0;
+        return status;
     }
 
 
     auto
-    run_repl() -> int
+    run_repl(cchell::interpreter::environment &env) -> int
     {
         using namespace cchell::diagnostics;
 
         cchell::input::interactive_input input;
+        cchell::parser::ast              ast;
+        cchell::interpreter::cache       cache;
         std::string                      text;
 
         while (true)
         {
-            std::print(std::cerr, "$ ");
             int res { input.read(text) };
 
             if (res == EOF)
@@ -160,25 +551,38 @@ namespace
                 continue;
             }
 
-            auto tokens { cchell::lexer::lex(text) };
+            const auto *code { cache.find(text) };
 
-            if (auto diag { cchell::lexer::verify(tokens) })
+            if (code == nullptr)
             {
-                std::cerr << diag->render(text, "argv");
-                continue;
+                auto tokens { cchell::lexer::lex(text) };
+
+                if (!tokens)
+                {
+                    std::cerr << tokens.error().render(text, "argv");
+                    continue;
+                }
+
+                if (auto diag { cchell::parser::parse(*tokens, ast) })
+                {
+                    std::cerr << diag->render(text, "argv");
+                    continue;
+                }
+
+                if (auto diag { cchell::parser::verify_in(env)(ast) })
+                {
+                    std::cerr << diag->render(text, "argv");
+                    continue;
+                }
+
+                code = &cache.insert(text,
+                                     cchell::interpreter::compile(ast, env));
             }
 
-            std::println("{}", tokens);
+            auto status { cchell::interpreter::execute(*code, env) };
+            if (!status) std::cerr << status.error() << '\n';
 
-            auto ast { cchell::parser::parse(tokens) };
-
-            if (auto diag { cchell::parser::verify(*ast) })
-            {
-                std::cerr << diag->render(text, "argv");
-                continue;
-            }
-
-            std::println("{}", *ast);
+            if (auto exit { env.exit_requested() }) return *exit;
         }
 
         return 0;
@@ -189,16 +593,21 @@ namespace
 auto
 main(int argc, char **argv, char **envp) -> int
 {
-    fill_global_env(envp);
-    std::string commands { get_commands(argc, argv) };
+    cchell::interpreter::environment env { envp };
+    std::string                      commands { get_commands(argc, argv) };
 
     bool show_help { false };
     bool show_version { false };
 
+    std::vector<std::string> check;
+    std::string              script;
+
     /* clang-format off */
     auto cli { lyra::cli {}
              | lyra::opt { show_version }["-V"]["--version"]
-             | lyra::help { show_help } };
+             | lyra::opt { check, "file" }["-n"]["--check"]
+             | lyra::help { show_help }
+             | lyra::arg { script, "script" } };
     /* clang-format on */
 
     if (auto res { cli.parse({ argc, argv }) }; !res)
@@ -206,7 +615,27 @@ main(int argc, char **argv, char **envp) -> int
 
     if (show_help) return print_help(*argv), 0;
     if (show_version) return print_version(), 0;
+    if (!check.empty()) return check_files(check);
+
+    if (!commands.empty()) return run_source(commands, "argv", env);
+
+    if (!script.empty())
+    {
+        int fd { open(script.c_str(), O_RDONLY | O_CLOEXEC) };
+        if (fd < 0)
+        {
+            std::println(std::cerr, "cchell: {}: {}", script,
+                         std::strerror(errno));
+            return 127;
+        }
+
+        int status { run_script(fd, script, env) };
+        close(fd);
+        return status;
+    }
+
+    if (!cchell::shared::tty_status.stdin())
+        return run_script(STDIN_FILENO, "stdin", env);
 
-    if (commands.empty()) return run_repl();
-    return run_commands_from_argv(commands);
+    return run_repl(env);
 }
@@ -1,7 +1,21 @@
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <span>
+
+#include "interpreter.hh"
 #include "lexer.hh"
 #include "parser.hh"
 
+using cchell::diagnostics::diagnostic;
+using cchell::diagnostics::diagnostic_builder;
+using cchell::diagnostics::severity;
+using cchell::lexer::token;
+using cchell::lexer::token_type;
+using cchell::parser::ast;
 using cchell::parser::ast_node;
+using cchell::parser::ast_type;
+using cchell::parser::node_index;
 
 
 auto
@@ -21,62 +35,708 @@ ast_node::set_source(source_location source) noexcept -> ast_node &
 
 
 auto
-ast_node::set_parent(ast_node *parent) noexcept -> ast_node &
+ast_node::set_data(std::string_view data) noexcept -> ast_node &
 {
-    this->parent = parent;
+    this->data = data;
     return *this;
 }
 
 
 auto
-ast_node::set_data(std::string_view data) noexcept -> ast_node &
+ast::add(ast_node node, node_index parent) -> node_index
 {
-    this->data = data;
-    return *this;
+    auto index { static_cast<node_index>(m_nodes.size()) };
+
+    node.parent = parent;
+    m_nodes.emplace_back(node);
+
+    if (parent == null_node) return index;
+
+    ast_node &owner { m_nodes[parent] };
+
+    if (owner.last_child == null_node)
+        owner.first_child = index;
+    else
+        m_nodes[owner.last_child].next_sibling = index;
+
+    owner.last_child = index;
+    return index;
+}
+
+
+auto
+cchell::parser::impl::context::done() const -> bool
+{
+    return index >= tokens.size();
+}
+
+
+auto
+cchell::parser::impl::context::peek() const -> const token &
+{
+    return tokens[index];
+}
+
+
+auto
+cchell::parser::impl::context::at(token_type       type,
+                                  std::string_view data) const -> bool
+{
+    return !done() && peek().type() == type
+        && (data.empty() || peek().data() == data);
+}
+
+
+auto
+cchell::parser::impl::context::at_lone(std::string_view data) const -> bool
+{
+    if (done() || peek().data() != data) return false;
+    if (peek().type() != token_type::bracket && peek().type() != token_type::word)
+        return false;
+
+    context lookahead { *this };
+    impl::word(lookahead);
+    return lookahead.index == index + 1;
+}
+
+
+void
+cchell::parser::impl::context::skip_separators()
+{
+    while (at(token_type::separator) && peek().data() != ";;") index++;
+}
+
+
+void
+cchell::parser::impl::context::skip_newlines()
+{
+    while (at(token_type::separator, "\n")) index++;
+}
+
+
+auto
+ast::wrap(node_index index, ast_node node) -> node_index
+{
+    auto moved { static_cast<node_index>(m_nodes.size()) };
+    m_nodes.emplace_back(m_nodes[index]);
+
+    ast_node &child { m_nodes[moved] };
+    child.parent       = index;
+    child.next_sibling = null_node;
+
+    for (node_index grandchild : children(moved))
+        m_nodes[grandchild].parent = moved;
+
+    node.parent       = m_nodes[index].parent;
+    node.next_sibling = m_nodes[index].next_sibling;
+    node.first_child  = moved;
+    node.last_child   = moved;
+
+    m_nodes[index] = node;
+    return index;
+}
+
+
+auto
+ast::intern(std::string_view data) -> std::string_view
+{
+    return m_strings.emplace_back(data);
+}
+
+
+void
+ast::clear() noexcept
+{
+    m_nodes.clear();
+    m_strings.clear();
+}
+
+
+void
+ast::reserve(std::size_t size)
+{
+    m_nodes.reserve(size);
+}
+
+
+auto
+ast::root() const noexcept -> node_index
+{
+    return m_nodes.empty() ? null_node : 0;
 }
 
 
 auto
-cchell::parser::parse(const std::vector<lexer::token> &tokens)
-    -> std::unique_ptr<ast_node>
+ast::size() const noexcept -> std::size_t
 {
-    auto root { std::make_unique<ast_node>(
-        ast_node {}.set_type(ast_type::statement)) };
+    return m_nodes.size();
+}
+
+
+auto
+ast::empty() const noexcept -> bool
+{
+    return m_nodes.empty();
+}
+
+
+auto
+ast::children(node_index index) const -> child_range
+{
+    return { .first = { this, m_nodes[index].first_child },
+             .last  = { this, null_node } };
+}
+
+
+namespace
+{
+    namespace impl = cchell::parser::impl;
+    using impl::context;
+
+    using closing_words = std::initializer_list<std::string_view>;
+
+
+    /* the words that end a list, so they can't start a command */
+    constexpr std::array<std::string_view, 8> CLOSING_WORDS {
+        "}", "then", "elif", "else", "fi", "do", "done", "esac"
+    };
+
+
+    /* whether the node at @param index is part of a function body */
+    [[nodiscard]]
+    auto
+    in_function(const ast &tree, node_index index) -> bool
+    {
+        for (index = tree[index].parent; index != cchell::parser::null_node;
+             index = tree[index].parent)
+            if (tree[index].type == ast_type::function_def) return true;
+        return false;
+    }
+
+
+    [[nodiscard]]
+    auto
+    here(const context &ctx) -> cchell::source_location
+    {
+        if (!ctx.done()) return ctx.peek().source();
+        return ctx.tokens.empty() ? cchell::source_location {}
+                                  : ctx.tokens.back().source();
+    }
+
+
+    /* @param expected names what should have been found instead */
+    [[nodiscard]]
+    auto
+    unexpected(const context &ctx, std::string_view expected = {})
+        -> diagnostic
+    {
+        diagnostic_builder builder { severity::error };
+        builder.domain("cchell::parser");
+
+        if (expected.empty())
+            builder.annotation("a command is expected here.");
+        else
+            builder.annotation("'{}' is expected here.", expected);
+
+        if (ctx.done())
+            return builder.message("unexpected end of input.")
+                .source(here(ctx))
+                .incomplete()
+                .build();
+
+        const token &token { ctx.peek() };
+
+        return builder
+            .message("unexpected '{}' found.",
+                     token.data() == "\n" ? "\\n" : token.data())
+            .source(token.source())
+            .length(token.data().length())
+            .build();
+    }
+
+
+    /* consumes the reserved word @param word */
+    [[nodiscard]]
+    auto
+    expect(context &ctx, std::string_view word) -> std::optional<diagnostic>
+    {
+        if (!ctx.at_lone(word)) return unexpected(ctx, word);
+
+        ctx.index++;
+        return std::nullopt;
+    }
+
+
+    [[nodiscard]]
+    auto
+    at_closing(const context &ctx, closing_words closing) -> bool
+    {
+        return std::ranges::any_of(
+            closing,
+            [&](std::string_view word) -> bool
+            {
+                if (word == ")") return ctx.at(token_type::bracket, ")");
+                if (word == ";;") return ctx.at(token_type::separator, ";;");
+                return ctx.at_lone(word);
+            });
+    }
+
+
+    auto parse_list(context &ctx, node_index parent, closing_words closing)
+        -> std::optional<diagnostic>;
+
+
+    /* a non-empty list node, up to one of @param closing */
+    auto
+    parse_body(context &ctx, node_index parent, closing_words closing)
+        -> std::optional<diagnostic>
+    {
+        node_index node { ctx.tree.add(
+            ast_node {}.set_type(ast_type::list).set_source(here(ctx)),
+            parent) };
+
+        if (auto diag { parse_list(ctx, node, closing) }) return diag;
+        if (ctx.tree[node].first_child == cchell::parser::null_node)
+            return unexpected(ctx);
+
+        return std::nullopt;
+    }
+
+
+    /* ( list ) and { list; } */
+    auto
+    parse_compound(context &ctx, node_index parent, ast_type type)
+        -> std::optional<diagnostic>
+    {
+        std::string_view closing { type == ast_type::group ? "}" : ")" };
+
+        node_index node { ctx.tree.add(
+            ast_node {}.set_type(type).set_source(ctx.peek().source()),
+            parent) };
+        ctx.index++;
+
+        if (auto diag { parse_list(ctx, node, { closing }) }) return diag;
+        if (ctx.tree[node].first_child == cchell::parser::null_node)
+            return unexpected(ctx);
+
+        ctx.index++; /* the closing bracket */
+        return std::nullopt;
+    }
+
+
+    /* if list then list ( elif list then list )* ( else list )? fi */
+    auto
+    parse_if(context &ctx, node_index parent) -> std::optional<diagnostic>
+    {
+        node_index node { ctx.tree.add(ast_node {}
+                                           .set_type(ast_type::if_clause)
+                                           .set_source(ctx.peek().source()),
+                                       parent) };
+
+        do
+        {
+            ctx.index++; /* if or elif */
+
+            if (auto diag { parse_body(ctx, node, { "then" }) }) return diag;
+            if (auto diag { expect(ctx, "then") }) return diag;
+            if (auto diag { parse_body(ctx, node, { "elif", "else", "fi" }) })
+                return diag;
+        }
+        while (ctx.at_lone("elif"));
 
-    bool found_command { false };
+        if (ctx.at_lone("else"))
+        {
+            ctx.index++;
+            if (auto diag { parse_body(ctx, node, { "fi" }) }) return diag;
+        }
+
+        return expect(ctx, "fi");
+    }
+
+
+    /* while list do list done, and the same for until */
+    auto
+    parse_while(context &ctx, node_index parent, ast_type type)
+        -> std::optional<diagnostic>
+    {
+        node_index node { ctx.tree.add(
+            ast_node {}.set_type(type).set_source(ctx.peek().source()),
+            parent) };
+        ctx.index++;
+
+        if (auto diag { parse_body(ctx, node, { "do" }) }) return diag;
+        if (auto diag { expect(ctx, "do") }) return diag;
+        if (auto diag { parse_body(ctx, node, { "done" }) }) return diag;
+
+        return expect(ctx, "done");
+    }
+
+
+    /* for name ( in word* )? do list done */
+    auto
+    parse_for(context &ctx, node_index parent) -> std::optional<diagnostic>
+    {
+        node_index node { ctx.tree.add(ast_node {}
+                                           .set_type(ast_type::for_clause)
+                                           .set_source(ctx.peek().source()),
+                                       parent) };
+        ctx.index++;
+
+        if (!ctx.at(token_type::word)) return unexpected(ctx, "a name");
+        ctx.tree[node].set_data(impl::word(ctx).data());
+
+        ctx.skip_newlines();
+
+        if (ctx.at_lone("in"))
+        {
+            ctx.index++;
 
-    for (const lexer::token &token : tokens)
-        if (!found_command)
+            while (!ctx.done() && !impl::is_operator(ctx.peek()))
+            {
+                token word { impl::word(ctx) };
+                ctx.tree.add(ast_node {}
+                                 .set_type(ast_type::literal)
+                                 .set_source(word.source())
+                                 .set_data(word.data()),
+                             node);
+            }
+        }
+
+        ctx.skip_separators();
+
+        if (auto diag { expect(ctx, "do") }) return diag;
+        if (auto diag { parse_body(ctx, node, { "done" }) }) return diag;
+
+        return expect(ctx, "done");
+    }
+
+
+    /* case word in ( (? pattern ( | pattern )* ) list? ;; )* esac */
+    auto
+    parse_case(context &ctx, node_index parent) -> std::optional<diagnostic>
+    {
+        node_index node { ctx.tree.add(ast_node {}
+                                           .set_type(ast_type::case_clause)
+                                           .set_source(ctx.peek().source()),
+                                       parent) };
+        ctx.index++;
+
+        if (ctx.done() || impl::is_operator(ctx.peek()))
+            return unexpected(ctx, "a word");
+        ctx.tree[node].set_data(impl::word(ctx).data());
+
+        ctx.skip_newlines();
+        if (auto diag { expect(ctx, "in") }) return diag;
+
+        while (true)
         {
-            if (impl::assignment(token, *root)) continue;
-            if (impl::command(token, *root))
+            ctx.skip_separators();
+            if (ctx.at_lone("esac")) break;
+
+            node_index item { ctx.tree.add(ast_node {}
+                                               .set_type(ast_type::case_item)
+                                               .set_source(here(ctx)),
+                                           node) };
+
+            if (ctx.at(token_type::bracket, "(")) ctx.index++;
+
+            do
             {
+                if (ctx.at(token_type::pipe)) ctx.index++;
+                if (ctx.done() || impl::is_operator(ctx.peek()))
+                    return unexpected(ctx, "a pattern");
+
+                token pattern { impl::word(ctx) };
+                ctx.tree.add(ast_node {}
+                                 .set_type(ast_type::literal)
+                                 .set_source(pattern.source())
+                                 .set_data(pattern.data()),
+                             item);
+            }
+            while (ctx.at(token_type::pipe));
+
+            if (!ctx.at(token_type::bracket, ")")) return unexpected(ctx, ")");
+            ctx.index++;
+
+            /* the body may be empty */
+            node_index body { ctx.tree.add(
+                ast_node {}.set_type(ast_type::list).set_source(here(ctx)),
+                item) };
+
+            if (auto diag { parse_list(ctx, body, { ";;", "esac" }) })
+                return diag;
+
+            if (!ctx.at(token_type::separator, ";;")) break;
+            ctx.index++;
+        }
+
+        return expect(ctx, "esac");
+    }
+
+
+    /* assignment* word* */
+    auto
+    parse_simple(context &ctx, node_index parent) -> std::optional<diagnostic>
+    {
+        node_index node { ctx.tree.add(ast_node {}
+                                           .set_type(ast_type::simple_command)
+                                           .set_source(ctx.peek().source()),
+                                       parent) };
+
+        bool found_command { false };
+
+        while (!ctx.done() && !impl::is_operator(ctx.peek()))
+        {
+            /* a closing word ends the list around us */
+            if (!found_command
+                && std::ranges::any_of(CLOSING_WORDS,
+                                       [&](std::string_view word) -> bool
+                                       { return ctx.at_lone(word); }))
+                break;
+
+            token word { impl::word(ctx) };
+
+            if (found_command)
+                impl::option(ctx, word, node);
+            else if (!impl::assignment(ctx, word, node))
+            {
+                impl::command(ctx, word, node);
                 found_command = true;
-                continue;
             }
         }
-        else
+
+        if (ctx.tree[node].first_child == cchell::parser::null_node)
+            return unexpected(ctx);
+
+        return std::nullopt;
+    }
+
+
+    auto parse_command(context &ctx, node_index parent)
+        -> std::optional<diagnostic>;
+
+
+    [[nodiscard]]
+    auto
+    at_function(const context &ctx) -> bool
+    {
+        return ctx.at(token_type::word) && ctx.index + 2 < ctx.tokens.size()
+            && ctx.tokens[ctx.index + 1].type() == token_type::bracket
+            && ctx.tokens[ctx.index + 1].data() == "("
+            && ctx.tokens[ctx.index + 2].type() == token_type::bracket
+            && ctx.tokens[ctx.index + 2].data() == ")";
+    }
+
+
+    /* name ( ) compound */
+    auto
+    parse_function(context &ctx, node_index parent)
+        -> std::optional<diagnostic>
+    {
+        const token &name { ctx.peek() };
+
+        node_index node { ctx.tree.add(ast_node {}
+                                           .set_type(ast_type::function_def)
+                                           .set_source(name.source())
+                                           .set_data(name.data()),
+                                       parent) };
+        ctx.index += 3;
+        ctx.skip_newlines();
+
+        /* the body has to be a compound command */
+        if (!ctx.at(token_type::bracket, "(")
+            && !std::ranges::any_of(
+                std::array<std::string_view, 6> { "{", "if", "while", "until",
+                                                   "for", "case" },
+                [&](std::string_view word) -> bool
+                { return ctx.at_lone(word); }))
+            return unexpected(ctx, "{");
+
+        return parse_command(ctx, node);
+    }
+
+
+    auto
+    parse_command(context &ctx, node_index parent) -> std::optional<diagnostic>
+    {
+        if (ctx.at(token_type::bracket, "("))
+            return parse_compound(ctx, parent, ast_type::subshell);
+
+        if (ctx.at_lone("{"))
+            return parse_compound(ctx, parent, ast_type::group);
+
+        if (ctx.at_lone("if")) return parse_if(ctx, parent);
+        if (ctx.at_lone("while"))
+            return parse_while(ctx, parent, ast_type::while_clause);
+        if (ctx.at_lone("until"))
+            return parse_while(ctx, parent, ast_type::until_clause);
+        if (ctx.at_lone("for")) return parse_for(ctx, parent);
+        if (ctx.at_lone("case")) return parse_case(ctx, parent);
+        if (at_function(ctx)) return parse_function(ctx, parent);
+
+        if (ctx.done()) return unexpected(ctx);
+        return parse_simple(ctx, parent);
+    }
+
+
+    /* command ( | command )* */
+    auto
+    parse_pipeline(context &ctx, node_index parent, node_index &node)
+        -> std::optional<diagnostic>
+    {
+        node = static_cast<node_index>(ctx.tree.size());
+        if (auto diag { parse_command(ctx, parent) }) return diag;
+
+        if (!ctx.at(token_type::pipe)) return std::nullopt;
+
+        node = ctx.tree.wrap(node, ast_node {}
+                                       .set_type(ast_type::pipeline)
+                                       .set_source(ctx.tree[node].source));
+
+        while (ctx.at(token_type::pipe))
         {
-            if (impl::string(token, *root)) continue;
-            if (impl::option(token, *root)) continue;
+            ctx.index++;
+            ctx.skip_newlines();
+
+            if (auto diag { parse_command(ctx, node) }) return diag;
         }
 
-    return root;
+        return std::nullopt;
+    }
+
+
+    /* pipeline ( && pipeline | || pipeline )* */
+    auto
+    parse_and_or(context &ctx, node_index parent) -> std::optional<diagnostic>
+    {
+        node_index node;
+        if (auto diag { parse_pipeline(ctx, parent, node) }) return diag;
+
+        while (ctx.at(token_type::logical))
+        {
+            ast_type type { ctx.peek().data() == "&&" ? ast_type::and_if
+                                                      : ast_type::or_if };
+
+            node = ctx.tree.wrap(node, ast_node {}
+                                           .set_type(type)
+                                           .set_source(ctx.peek().source()));
+            ctx.index++;
+            ctx.skip_newlines();
+
+            node_index right;
+            if (auto diag { parse_pipeline(ctx, node, right) }) return diag;
+        }
+
+        return std::nullopt;
+    }
+
+
+    /**
+     * and_or ( separator and_or )*, until one of @param closing is found,
+     * or until the end of input if there are none.
+     */
+    auto
+    parse_list(context &ctx, node_index parent, closing_words closing)
+        -> std::optional<diagnostic>
+    {
+        while (true)
+        {
+            ctx.skip_separators();
+
+            if (ctx.done())
+            {
+                if (closing.size() == 0) return std::nullopt;
+                return unexpected(ctx, *closing.begin());
+            }
+
+            if (at_closing(ctx, closing)) return std::nullopt;
+
+            if (auto diag { parse_and_or(ctx, parent) }) return diag;
+
+            if (!ctx.done() && !ctx.at(token_type::separator)
+                && !at_closing(ctx, closing))
+                return unexpected(ctx);
+        }
+    }
 }
 
 
 auto
-cchell::parser::impl::verifier::operator()(ast_node &nodes) const
+cchell::parser::parse(const std::vector<lexer::token> &tokens, ast &tree)
     -> std::optional<diagnostic>
 {
-    for (auto &node : nodes.child)
+    tree.clear();
+    /* an assignment is the most a token can expand to */
+    tree.reserve((tokens.size() * 3) + 1);
+
+    node_index root { tree.add(ast_node {}.set_type(ast_type::statement)) };
+    context    ctx { .tokens = tokens, .tree = tree };
+
+    return parse_list(ctx, root, {});
+}
+
+
+auto
+cchell::parser::parse_line(std::span<const lexer::token> tokens,
+                           std::size_t                  &index,
+                           ast &tree) -> std::optional<diagnostic>
+{
+    tree.clear();
+
+    node_index root { tree.add(ast_node {}.set_type(ast_type::statement)) };
+    context    ctx { .tokens = tokens, .index = index, .tree = tree };
+
+    ctx.skip_separators();
+
+    while (!ctx.done() && !ctx.at(token_type::separator, "\n"))
     {
-        if (!node.child.empty())
-            if (auto diag { verify(node) }) return diag;
+        if (auto diag { parse_and_or(ctx, root) }) return diag;
 
-        if (node.type == ast_type::command)
-            if (auto diag { impl::verify_command(node) }) return diag;
+        if (!ctx.done() && !ctx.at(token_type::separator))
+            return unexpected(ctx);
+
+        while (ctx.at(token_type::separator) && ctx.peek().data() != "\n"
+               && ctx.peek().data() != ";;")
+            ctx.index++;
     }
 
+    ctx.skip_separators();
+    index = ctx.index;
+
     return std::nullopt;
 }
+
+
+auto
+cchell::parser::impl::verifier::operator()(ast &tree) const
+    -> std::optional<diagnostic>
+{
+    /* functions can be called before the line defining them is reached */
+    std::vector<std::string_view> functions;
+
+    for (node_index i { 0 }; i < tree.size(); i++)
+        if (tree[i].type == ast_type::function_def)
+            functions.emplace_back(tree[i].data);
+
+    std::vector<node_index> commands;
+
+    for (node_index i { 0 }; i < tree.size(); i++)
+    {
+        if (tree[i].type != ast_type::command) continue;
+        /* a tree verified on its own may call functions defined further
+           down the script, so a function body is only looked up once run */
+        if (env != nullptr && in_function(tree, i)) continue;
+
+        std::string_view name { tree[i].data };
+
+        if (std::ranges::find(functions, name) != functions.end()
+            || (env != nullptr && env->function(name) != nullptr))
+            continue;
+
+        commands.emplace_back(i);
+    }
+
+    if (env != nullptr) env->refresh_executables();
+
+    return impl::verify_commands(tree, commands, interactive);
+}
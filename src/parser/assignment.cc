@@ -10,39 +10,43 @@ using namespace cchell::parser;
 
 namespace
 {
+    /* NAME=value, where the value can be any word */
     auto
     is_assignment(std::string_view data) -> bool
     {
-        if (data.empty()) return false;
-        if (!is_identifier_start(data.front())) return false;
-        if (std::ranges::count(data, '=') > 1) return false;
+        std::size_t assign_index { data.find('=') };
 
-        return std::ranges::all_of(data | std::views::drop(1),
+        if (assign_index == 0 || assign_index == std::string_view::npos)
+            return false;
+        if (!is_identifier_start(data.front(), false)) return false;
+
+        return std::ranges::all_of(data.substr(1, assign_index - 1),
                                    [](char c) -> bool
-                                   { return is_identifier_char(c, false); });
+                                   {
+                                       return c != '='
+                                           && is_identifier_char(c, false);
+                                   });
     }
 }
 
 
 auto
-impl::assignment(const lexer::token &token, ast_node &parent) -> bool
+impl::assignment(context &ctx, const lexer::token &word, node_index parent)
+    -> bool
 {
-    if (!is_assignment(token.data())) return false;
-
-    std::size_t assign_index { token.data().find('=') };
-    if (assign_index == std::string_view::npos) return false;
+    if (!is_assignment(word.data())) return false;
 
-    auto &root { parent.child.emplace_back(ast_node {}
-                                               .set_type(ast_type::assignment)
-                                               .set_source(token.source())
-                                               .set_parent(&parent)) };
+    ast &tree { ctx.tree };
 
-    cchell::source_location source { token.source() };
-    source.column = assign_index + 1;
+    node_index root { tree.add(ast_node {}
+                                   .set_type(ast_type::assignment)
+                                   .set_source(word.source())
+                                   .set_data(word.data()),
+                               parent) };
 
-    split_key_value(token.data(), root,
+    split_key_value(word.data(), word.data().find('='), tree, root,
                     { ast_type::identifier, ast_type::literal },
-                    { token.source(), source });
+                    word.source());
 
     return true;
 }
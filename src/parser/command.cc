@@ -1,10 +1,23 @@
+#include <algorithm>
 #include <filesystem>
+#include <format>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <ranges>
-#include <tuple>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "interaction.hh"
+#include "interpreter.hh"
 #include "parser.hh"
 #include "shared.hh"
 
@@ -19,19 +32,20 @@ using cchell::interaction::ask;
 
 namespace
 {
+    /* a plain command name or path, known before anything is expanded */
     auto
     is_command(std::string_view data) -> bool
     {
         if (data.empty()) return false;
-        std::size_t is_local { data.starts_with("./") ? 1UZ : 0UZ };
+        bool is_path { data.starts_with("./") || data.starts_with('/') };
 
-        for (std::size_t i { is_local }; i < data.length(); i++)
+        for (std::size_t i { is_path ? 1UZ : 0UZ }; i < data.length(); i++)
         {
             char c { data[i] };
 
             if (is_identifier_char(c)) continue;
 
-            if (is_local != 0 && c == '/') continue;
+            if (is_path && (c == '/' || c == '.')) continue;
 
             if (i > 0 && RESERVED_CHAR.contains(c) && data[i - 1] == '\\')
                 continue;
@@ -45,41 +59,239 @@ namespace
 
     namespace fs = std::filesystem;
 
-    auto
-    directory_view(const fs::path &dir)
+
+    /* a directory's entries, sorted, as one block of names */
+    struct listing
     {
-        auto dir_it { fs::directory_iterator { dir } };
-        return std::views::all(dir_it)
-             | std::views::transform([](const fs::directory_entry &e)
-                                     { return e.path(); });
-    }
+        timespec                      mtime;
+        std::string                   names;
+        std::vector<std::string_view> entries;
+        std::vector<unsigned char>    types; /* d_type, DT_UNKNOWN if unsure */
+        std::size_t                   longest { 0 };
+
+
+        /**
+         * the closest entry to @param target no further than @param most.
+         *
+         * the entries being sorted, each one shares a prefix with the one
+         * before it, and the distance rows of that prefix carry over. once
+         * a row is all past @param most, no entry with that prefix can get
+         * any closer, so those are skipped altogether. nothing is allocated
+         * once the thread has seen a directory this size.
+         */
+        [[nodiscard]]
+        auto
+        closest(std::string_view target, std::size_t most) const
+            -> std::optional<std::size_t>
+        {
+            if (auto it { std::ranges::lower_bound(entries, target) };
+                it != entries.end() && *it == target)
+                return static_cast<std::size_t>(it - entries.begin());
 
+            const std::size_t width { target.size() + 1 };
 
-    template <std::ranges::input_range T_Range>
-    auto
-    find_closest_path(const T_Range &paths, const fs::path &target)
-        -> std::pair<fs::path, std::size_t>
+            thread_local std::vector<std::size_t> rows;
+            if (rows.size() < (longest + 1) * width)
+                rows.resize((longest + 1) * width);
+
+            auto row { [&](std::size_t depth)
+                       { return &rows[depth * width]; } };
+            for (std::size_t j { 0 }; j < width; j++) row(0)[j] = j;
+
+            std::optional<std::size_t> best;
+            std::string_view           previous;
+            std::size_t                valid { 0 }; /* rows kept so far */
+
+            for (std::size_t i { 0 }; i < entries.size();)
+            {
+                std::string_view entry { entries[i] };
+
+                auto common { std::ranges::mismatch(entry, previous) };
+                valid    = std::min(valid, static_cast<std::size_t>(
+                                               common.in1 - entry.begin()));
+                previous = entry;
+
+                bool pruned { false };
+
+                while (valid < entry.size() && !pruned)
+                {
+                    std::size_t  depth { ++valid };
+                    std::size_t *current { row(depth) };
+                    std::size_t *above { row(depth - 1) };
+                    char         c { entry[depth - 1] };
+
+                    current[0] = depth;
+                    std::size_t smallest { depth };
+
+                    for (std::size_t j { 1 }; j < width; j++)
+                    {
+                        std::size_t cost { c == target[j - 1] ? 0UZ : 1UZ };
+                        std::size_t cell { std::min({ above[j] + 1,
+                                                      current[j - 1] + 1,
+                                                      above[j - 1] + cost }) };
+
+                        if (depth > 1 && j > 1 && c == target[j - 2]
+                            && entry[depth - 2] == target[j - 1])
+                            cell = std::min(cell, row(depth - 2)[j - 2] + 1);
+
+                        current[j] = cell;
+                        smallest   = std::min(smallest, cell);
+                    }
+
+                    pruned = smallest > most;
+                }
+
+                if (pruned)
+                {
+                    std::string_view prefix { entry.substr(0, valid) };
+
+                    i = static_cast<std::size_t>(
+                        std::partition_point(
+                            entries.begin() + static_cast<std::ptrdiff_t>(i),
+                            entries.end(),
+                            [&](std::string_view other)
+                            { return other.starts_with(prefix); })
+                        - entries.begin());
+                    continue;
+                }
+
+                std::size_t distance { row(entry.size())[target.size()] };
+
+                /* with no exact match, one edit is as close as it gets */
+                if (distance <= most)
+                {
+                    best = i;
+                    if (distance <= 1) break;
+
+                    most = distance - 1;
+                }
+
+                i++;
+            }
+
+            return best;
+        }
+    };
+
+
+    /**
+     * the listings of the directories corrections looked into last, keyed
+     * by device and inode. a listing is read again once its directory's
+     * mtime moved, so a warm lookup costs a single stat.
+     */
+    class directory_cache
     {
-        auto     smallest { std::numeric_limits<std::size_t>::max() };
-        fs::path closest;
+    public:
+        auto
+        find(const fs::path &directory) -> std::shared_ptr<const listing>
+        {
+            struct stat st {};
+            if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+                return nullptr;
+
+            key current { st.st_dev, st.st_ino };
+
+            std::scoped_lock lock { m_mutex };
+
+            if (auto it { m_index.find(current) }; it != m_index.end())
+            {
+                const timespec &mtime { it->second->second->mtime };
+
+                if (mtime.tv_sec == st.st_mtim.tv_sec
+                    && mtime.tv_nsec == st.st_mtim.tv_nsec)
+                {
+                    m_entries.splice(m_entries.begin(), m_entries,
+                                     it->second);
+                    return it->second->second;
+                }
+
+                m_entries.erase(it->second);
+                m_index.erase(it);
+            }
+
+            auto read { mf_read(directory, st.st_mtim) };
+            if (read == nullptr) return nullptr;
+
+            m_entries.emplace_front(current, read);
+            m_index.emplace(current, m_entries.begin());
+
+            if (m_entries.size() > CAPACITY)
+            {
+                m_index.erase(m_entries.back().first);
+                m_entries.pop_back();
+            }
+
+            return read;
+        }
+
+    private:
+        static constexpr std::size_t CAPACITY { 16 };
 
-        for (const auto &candidate : paths)
+        using key   = std::pair<dev_t, ino_t>;
+        using entry = std::pair<key, std::shared_ptr<const listing>>;
+
+        struct key_hash
+        {
+            auto
+            operator()(const key &value) const noexcept -> std::size_t
+            {
+                return std::hash<ino_t> {}(value.second)
+                     ^ (std::hash<dev_t> {}(value.first) << 1);
+            }
+        };
+
+        std::mutex       m_mutex;
+        std::list<entry> m_entries;
+        std::unordered_map<key, std::list<entry>::iterator, key_hash> m_index;
+
+
+        static auto
+        mf_read(const fs::path &directory, timespec mtime)
+            -> std::shared_ptr<const listing>
         {
-            fs::path    filename { candidate.filename() };
-            std::size_t dist { cchell::shared::damerau_levenshtein_osa(
-                candidate.filename().string(), target.filename().string()) };
+            DIR *stream { opendir(directory.c_str()) };
+            if (stream == nullptr) return nullptr;
+
+            auto result { std::make_shared<listing>() };
+            result->mtime = mtime;
+
+            std::vector<std::pair<std::size_t, unsigned char>> offsets;
+
+            while (const dirent *entry { readdir(stream) })
+            {
+                std::string_view name { entry->d_name };
+                if (name == "." || name == "..") continue;
+
+                offsets.emplace_back(result->names.size(), entry->d_type);
+                result->names.append(name).push_back('\0');
+            }
 
-            if (dist < smallest)
+            closedir(stream);
+
+            /* only now, the block doesn't move anymore */
+            std::vector<std::pair<std::string_view, unsigned char>> sorted;
+            sorted.reserve(offsets.size());
+
+            for (auto [offset, type] : offsets)
+                sorted.emplace_back(result->names.c_str() + offset, type);
+            std::ranges::sort(sorted);
+
+            result->entries.reserve(sorted.size());
+            result->types.reserve(sorted.size());
+
+            for (auto [name, type] : sorted)
             {
-                closest  = filename;
-                smallest = dist;
+                result->entries.emplace_back(name);
+                result->types.emplace_back(type);
+                result->longest = std::max(result->longest, name.size());
             }
 
-            if (dist == 0) break;
+            return result;
         }
+    };
 
-        return { closest, smallest };
-    }
+
+    directory_cache directories;
 
 
     auto
@@ -87,154 +299,282 @@ namespace
     {
         std::vector<fs::path> segments;
 
-        for (const auto &part : base) segments.emplace_back(part);
+        for (const auto &part : base.relative_path())
+            segments.emplace_back(part);
         if (segments.empty()) return std::nullopt;
 
-        std::filesystem::path current_path {
-            base.is_absolute() ? base.root_path()
-                               : std::filesystem::current_path()
-        };
+        /* relative paths stay relative, so they need no making relative */
+        fs::path current_path { base.root_path() };
 
         for (std::size_t i { 0 }; i < segments.size(); i++)
         {
-            const fs::path &segment { segments[i] };
-            auto            children_view { directory_view(current_path) };
-
-            fs::path    closest;
-            std::size_t distance;
-
-            try
-            {
-                std::tie(closest, distance)
-                    = find_closest_path(children_view, segment);
-            }
-            catch (const fs::filesystem_error &)
+            if (segments[i] == "." || segments[i] == "..")
             {
-                return std::nullopt;
+                current_path /= segments[i];
+                continue;
             }
 
+            auto contents { directories.find(
+                current_path.empty() ? fs::path { "." } : current_path) };
+            if (contents == nullptr) return std::nullopt;
+
             /* skip if too different */
-            std::size_t min_distance { 2 + (segments.size() * 2) };
-            if (distance > min_distance) return std::nullopt;
+            std::size_t most { 2 + (segments.size() * 2) };
 
-            current_path /= closest;
+            auto closest { contents->closest(segments[i].native(), most) };
+            if (!closest) return std::nullopt;
+
+            current_path /= contents->entries[*closest];
 
             /* if not last segment, must be a directory */
-            if (i < segments.size() - 1 && !fs::is_directory(current_path))
+            if (i == segments.size() - 1) continue;
+
+            unsigned char type { contents->types[*closest] };
+            if (type != DT_DIR
+                && ((type != DT_LNK && type != DT_UNKNOWN)
+                    || !fs::is_directory(current_path)))
                 return std::nullopt;
         }
 
-        return fs::relative(current_path);
+        return current_path;
     }
 
 
+    /* what a path given as a command turned out to be */
+    enum class path_state : std::uint8_t
+    {
+        executable,
+        missing,
+        not_a_file,
+        not_executable,
+    };
+
+
+    /* below this, handing the checks out to the workers costs more than it
+       saves */
+    constexpr std::size_t PARALLEL_CHECKS { 4 };
+
+
+    /**
+     * checks all of @param paths at once, each with one stat and one
+     * access, the workers taking them when there are enough to be worth
+     * it. a cold NFS mount costs a round trip per call, so they overlap.
+     */
     auto
-    handle_path_verification(ast_node &node) -> std::optional<diagnostic>
+    check_paths(std::span<const std::string> paths) -> std::vector<path_state>
     {
-        fs::path path { node.data.substr(2) }; /* skip the ./ */
+        std::vector<path_state> states(paths.size());
+
+        auto check { [&](std::size_t i)
+                     {
+                         struct stat st {};
 
-        if (fs::exists(path))
+                         if (stat(paths[i].c_str(), &st) != 0)
+                             states[i] = path_state::missing;
+                         else if (!S_ISREG(st.st_mode))
+                             states[i] = path_state::not_a_file;
+                         else if (access(paths[i].c_str(), X_OK) != 0)
+                             states[i] = path_state::not_executable;
+                     } };
+
+        if (paths.size() < PARALLEL_CHECKS)
         {
-            path = fs::canonical(path);
-
-            if (!fs::is_regular_file(path))
-                return diagnostic_builder { severity::error }
-                    .domain("cchell::parser")
-                    .message("path '{}' is not a file", path.string())
-                    .annotation(
-                        "consider fixing the typo or the directory tree")
-                    .source(node.source)
-                    .length(node.data.length())
-                    .build();
-
-            if (access(path.c_str(), X_OK) != 0)
-                return diagnostic_builder { severity::error }
-                    .domain("cchell::parser")
-                    .message("path '{}' is not an executable", path.string())
-                    .annotation("consider changing the permission on '{}'",
-                                path.string())
-                    .source(node.source)
-                    .length(node.data.length())
-                    .build();
-
-            return std::nullopt;
+            for (std::size_t i { 0 }; i < paths.size(); i++) check(i);
+            return states;
         }
 
-        auto err { diagnostic_builder { severity::error }
-                       .domain("cchell::parser")
-                       .message("executable path '{}' doesn't exist", node.data)
-                       .annotation(
-                           "consider fixing the typo or the directory tree")
-                       .source(node.source)
-                       .length(node.data.length())
-                       .build() };
+        auto &pool { cchell::shared::workers() };
 
-        fs::path closest;
-        if (auto closest_buff { find_nearest_looking_path(path) };
-            !closest_buff)
-            return err;
-        else /* NOLINT: Do not use 'else' after 'return' */
-            closest = *closest_buff;
+        for (std::size_t i { 0 }; i < paths.size(); i++)
+            pool.submit([&check, i](std::size_t /* worker */) { check(i); });
+        pool.wait();
 
-        static std::string string_buffer;
+        return states;
+    }
 
-        string_buffer += "./" + closest.relative_path().string();
-        std::string_view new_data { string_buffer.begin()
-                                        + string_buffer.rfind("./"),
-                                    string_buffer.end() };
 
+    auto
+    path_diagnostic(const ast_node &node, path_state state) -> diagnostic
+    {
+        std::error_code ec;
+        std::string     path {
+            fs::weakly_canonical(fs::path { node.data }, ec).string()
+        };
 
-        char response { ask["yn"](
-            "executable path '{}' not found, do you mean '{}'?", node.data,
-            new_data) };
+        std::string message;
+        std::string annotation {
+            "consider fixing the typo or the directory tree"
+        };
 
-        if (response != 'y') return err;
+        switch (state)
+        {
+        case path_state::not_a_file:
+            message = std::format("path '{}' is not a file", path);
+            break;
+
+        case path_state::not_executable:
+            message    = std::format("path '{}' is not an executable", path);
+            annotation = std::format("consider changing the permission on '{}'",
+                                     path);
+            break;
+
+        default:
+            message = std::format("executable path '{}' doesn't exist",
+                                  node.data);
+            break;
+        }
 
-        node.set_data(new_data);
-        return std::nullopt;
+        return diagnostic_builder { severity::error }
+            .domain("cchell::parser")
+            .message("{}", message)
+            .annotation("{}", annotation)
+            .source(node.source)
+            .length(node.data.length())
+            .build();
     }
-}
 
 
-auto
-impl::command(const lexer::token &token, ast_node &parent) -> bool
-{
-    if (!is_command(token.data())) return false;
+    auto
+    command_diagnostic(const ast_node &node) -> diagnostic
+    {
+        return diagnostic_builder { severity::error }
+            .domain("cchell::parser")
+            .message("command '{}' doesn't exist", node.data)
+            .annotation("consider fixing $PATH or installing the program")
+            .source(node.source)
+            .length(node.data.length())
+            .build();
+    }
 
-    parent.child.emplace_back(ast_node {}
-                                  .set_type(ast_type::command)
-                                  .set_source(token.source())
-                                  .set_parent(&parent)
-                                  .set_data(token.data()));
 
-    return true;
+    /* a command that didn't check out, and what it might have meant */
+    struct failure
+    {
+        node_index       index;
+        diagnostic       diag;
+        std::string_view correction;
+    };
+
+
+    /**
+     * offers every correction in @param failures with a single question,
+     * applying them all when accepted. returns whether it was.
+     */
+    auto
+    offer_corrections(ast &tree, std::span<const failure> failures) -> bool
+    {
+        std::string typos;
+        std::string corrections;
+
+        for (const failure &current : failures)
+        {
+            if (current.correction.empty()) continue;
+
+            const char *separator { typos.empty() ? "" : ", " };
+            typos += std::format("{}'{}'", separator, tree[current.index].data);
+            corrections += std::format("{}'{}'", separator, current.correction);
+        }
+
+        if (typos.empty()) return false;
+
+        if (ask["yn"]("{} not found, do you mean {}?", typos, corrections)
+            != 'y')
+            return false;
+
+        for (const failure &current : failures)
+            if (!current.correction.empty())
+                tree[current.index].set_data(current.correction);
+
+        return true;
+    }
+}
+
+
+void
+impl::command(context &ctx, const lexer::token &word, node_index parent)
+{
+    ctx.tree.add(ast_node {}
+                     .set_type(ast_type::command)
+                     .set_source(word.source())
+                     .set_data(word.data()),
+                 parent);
 }
 
 
 auto
-impl::verify_command(ast_node &node) -> std::optional<diagnostic>
+impl::verify_commands(ast                        &tree,
+                      std::span<const node_index> commands,
+                      bool interactive) -> std::optional<diagnostic>
 {
-    if (node.data.starts_with("./")) return handle_path_verification(node);
+    /* every distinct path once, and which of them each command is */
+    std::vector<std::string>                       paths;
+    std::unordered_map<std::string_view, std::size_t> path_index;
+    std::vector<std::pair<node_index, std::size_t>> path_commands;
+
+    std::vector<failure> failures;
 
-    if (shared::executables.exists(node.data)) return std::nullopt;
+    for (node_index index : commands)
+    {
+        const ast_node &node { tree[index] };
+
+        /* quoted or expanded names are only known when executing */
+        if (!is_command(node.data)) continue;
+
+        if (node.data.contains('/'))
+        {
+            auto [it, inserted] { path_index.try_emplace(node.data,
+                                                         paths.size()) };
+            if (inserted) paths.emplace_back(node.data);
+
+            path_commands.emplace_back(index, it->second);
+            continue;
+        }
+
+        if (interpreter::is_builtin(node.data)
+            || shared::executables.exists(node.data))
+            continue;
+
+        const auto *closest { interactive
+                                  ? shared::executables.closest(node.data)
+                                  : nullptr };
+
+        failures.emplace_back(index, command_diagnostic(node),
+                              closest != nullptr
+                                  ? std::string_view { closest->first }
+                                  : std::string_view {});
+    }
+
+    auto states { check_paths(paths) };
+
+    for (auto [index, path] : path_commands)
+    {
+        if (states[path] == path_state::executable) continue;
+
+        const ast_node &node { tree[index] };
+        std::string_view correction;
+
+        if (interactive && states[path] == path_state::missing)
+            if (auto closest { find_nearest_looking_path(
+                    node.data.starts_with("./") ? node.data.substr(2)
+                                                : node.data) })
+                correction = tree.intern(
+                    closest->is_absolute()
+                        ? closest->string()
+                        : "./" + closest->relative_path().string());
+
+        failures.emplace_back(index, path_diagnostic(node, states[path]),
+                              correction);
+    }
 
-    const auto *closest { shared::executables.closest(node.data) };
+    if (failures.empty()) return std::nullopt;
 
-    auto diag { diagnostic_builder { severity::error }
-                    .domain("cchell::parser")
-                    .message("command '{}' doesn't exist", node.data)
-                    .annotation(
-                        "consider fixing $PATH or installing the program")
-                    .source(node.source)
-                    .length(node.data.length())
-                    .build() };
+    /* the first one to be reached when running is the one to report */
+    std::ranges::sort(failures, {}, &failure::index);
 
-    if (closest == nullptr
-        || ask["yn"]("command '{}' doesn't exist, do you mean '{}'?", node.data,
-                     closest->first)
-               != 'y')
-        return diag;
+    if (interactive && offer_corrections(tree, failures))
+        std::erase_if(failures, [](const failure &current)
+                      { return !current.correction.empty(); });
 
-    node.set_data(closest->first);
-    return std::nullopt;
+    if (failures.empty()) return std::nullopt;
+    return std::move(failures.front().diag);
 }
@@ -20,30 +20,21 @@ namespace
 }
 
 
-auto
-impl::option(const lexer::token &token, ast_node &parent) -> bool
+void
+impl::option(context &ctx, const lexer::token &word, node_index parent)
 {
-    if (!is_option(token.data())) return false;
+    ast &tree { ctx.tree };
 
-    std::size_t assign_index { token.data().find('=') };
+    node_index root { tree.add(ast_node {}
+                                   .set_type(ast_type::option)
+                                   .set_source(word.source())
+                                   .set_data(word.data()),
+                               parent) };
 
-    ast_node &root { parent.child.emplace_back(ast_node {}
-                                                   .set_type(ast_type::option)
-                                                   .set_source(token.source())
-                                                   .set_parent(&parent)
-                                                   .set_data(token.data())) };
+    std::size_t assign_index { word.data().find('=') };
 
-
-    if (assign_index != std::string_view::npos)
-    {
-        cchell::source_location source { token.source() };
-        source.column = assign_index + 1;
-
-        split_key_value(token.data(), root,
+    if (is_option(word.data()) && assign_index != std::string_view::npos)
+        split_key_value(word.data(), assign_index, tree, root,
                         { ast_type::identifier, ast_type::parameter },
-                        { token.source(), source });
-    }
-
-    return true;
+                        word.source());
 }
-
@@ -35,28 +35,29 @@ namespace
 
     [[maybe_unused]]
     auto
-    split_key_value(std::string_view               data,
-                    ast_node                      &parent,
-                    tpair<ast_type>                type,
-                    tpair<cchell::source_location> source) -> bool
+    split_key_value(std::string_view        data,
+                    std::size_t             assign_index,
+                    ast                    &tree,
+                    node_index              parent,
+                    tpair<ast_type>         type,
+                    cchell::source_location source) -> bool
     {
         auto &[key_type, value_type] { type };
-        auto &[key_source, value_source] { source };
-
-        std::string_view key { data.substr(0, value_source.column - 1) };
-        std::string_view value { data.substr(value_source.column) };
-
-        parent.child.emplace_back(ast_node {}
-                                      .set_type(key_type)
-                                      .set_source(key_source)
-                                      .set_parent(&parent)
-                                      .set_data(key));
-
-        parent.child.emplace_back(ast_node {}
-                                      .set_type(value_type)
-                                      .set_source(value_source)
-                                      .set_parent(&parent)
-                                      .set_data(value));
+
+        cchell::source_location value_source { source };
+        value_source.column += assign_index + 1;
+
+        tree.add(ast_node {}
+                     .set_type(key_type)
+                     .set_source(source)
+                     .set_data(data.substr(0, assign_index)),
+                 parent);
+
+        tree.add(ast_node {}
+                     .set_type(value_type)
+                     .set_source(value_source)
+                     .set_data(data.substr(assign_index + 1)),
+                 parent);
         return true;
     }
 }
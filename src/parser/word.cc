@@ -0,0 +1,92 @@
+#include "lexer.hh"
+#include "parser.hh"
+
+using namespace cchell::parser;
+using cchell::lexer::token;
+using cchell::lexer::token_type;
+
+
+namespace
+{
+    [[nodiscard]]
+    auto
+    is_adjacent(const token &a, const token &b) -> bool
+    {
+        return a.data().data() + a.data().length() == b.data().data();
+    }
+
+
+    [[nodiscard]]
+    auto
+    is_bracket(const token &token, char c) -> bool
+    {
+        return token.type() == token_type::bracket && token.data()[0] == c;
+    }
+}
+
+
+auto
+impl::is_operator(const token &token) -> bool
+{
+    switch (token.type())
+    {
+    case token_type::separator: [[fallthrough]];
+    case token_type::logical:   [[fallthrough]];
+    case token_type::pipe:      return true;
+
+    case token_type::bracket:
+        return is_bracket(token, '(') || is_bracket(token, ')');
+
+    default: return false;
+    }
+}
+
+
+auto
+impl::word(context &ctx) -> token
+{
+    std::span<const token> tokens { ctx.tokens };
+    std::size_t           &index { ctx.index };
+    std::size_t            start { index };
+    std::size_t depth { 0 };
+
+    while (index < tokens.size())
+    {
+        const token &current { tokens[index] };
+
+        if (depth == 0 && index > start
+            && (!is_adjacent(tokens[index - 1], current)
+                || is_operator(current)))
+            break;
+
+        /* $( and ${ run until their closing bracket, whatever is inside */
+        if (current.type() == token_type::dollar && index + 1 < tokens.size()
+            && is_adjacent(current, tokens[index + 1])
+            && (is_bracket(tokens[index + 1], '(')
+                || is_bracket(tokens[index + 1], '{')))
+        {
+            depth++;
+            index += 2;
+            continue;
+        }
+
+        if (depth > 0 && current.type() == token_type::bracket)
+        {
+            char c { current.data()[0] };
+
+            if (c == '(' || c == '{' || c == '[')
+                depth++;
+            else
+                depth--;
+        }
+
+        index++;
+    }
+
+    const token &first { tokens[start] };
+    const token &last { tokens[index - 1] };
+
+    return { token_type::word,
+             { first.data().data(), last.data().data() + last.data().length() },
+             first.source() };
+}
@@ -1,8 +1,12 @@
 #include <algorithm>
+#include <bit>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <limits>
+#include <mutex>
 #include <ranges>
+#include <thread>
 #include <stdexcept>
 #include <utility>
 #include <vector>
@@ -21,6 +25,18 @@ namespace
     {
         return access(name, X_OK) == 0;
     }
+
+
+    /* the splitmix64 finalizer, every input bit reaching every output bit */
+    constexpr auto
+    mix(std::uint64_t value) -> std::uint64_t
+    {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111eb;
+        return value ^ (value >> 31);
+    }
 }
 
 
@@ -28,47 +44,108 @@ auto
 cchell::shared::damerau_levenshtein_osa(std::string_view a, std::string_view b)
     -> std::size_t
 {
+    return damerau_levenshtein_osa(a, b, std::max(a.size(), b.size()));
+}
+
+
+auto
+cchell::shared::damerau_levenshtein_osa(std::string_view a,
+                                        std::string_view b,
+                                        std::size_t      cutoff) -> std::size_t
+{
+    /* the rows go along the shorter one */
+    if (a.size() < b.size()) std::swap(a, b);
+
     const std::size_t n { a.size() };
     const std::size_t m { b.size() };
+    const std::size_t over { cutoff + 1 }; /* stands for anything above */
 
-    if (n == 0) return m;
+    if (n - m > cutoff) return over;
     if (m == 0) return n;
 
-    std::vector<std::size_t> prev2;
-    std::vector<std::size_t> curr;
-    prev2.resize(m + 1);
-    curr.resize(m + 1);
+    thread_local std::vector<std::size_t> rows;
+    if (rows.size() < (m + 1) * 3) rows.resize((m + 1) * 3);
 
-    auto prev { std::views::iota(0UZ, m + 1) | std::ranges::to<std::vector>() };
+    std::size_t *prev2 { rows.data() };
+    std::size_t *prev { prev2 + m + 1 };
+    std::size_t *curr { prev + m + 1 };
+
+    for (std::size_t j { 0 }; j <= m; j++) prev[j] = std::min(j, over);
 
     for (std::size_t i { 1 }; i <= n; i++)
     {
-        curr[0] = i;
+        /* a cell further than cutoff off the diagonal is above it anyway,
+           so only the band around it is worked out */
+        std::size_t low { i > cutoff ? i - cutoff : 1 };
+        std::size_t high { std::min(m, i + cutoff) };
+
+        curr[0] = std::min(i, over);
+        curr[low - 1] = low > 1 ? over : curr[0];
+        std::size_t row_min { curr[low - 1] };
 
-        for (std::size_t j { 1 }; j <= m; ++j)
+        for (std::size_t j { low }; j <= high; j++)
         {
             std::size_t cost { a[i - 1] == b[j - 1] ? 0UZ : 1UZ };
-
-            curr[j] = std::min(
-                { prev[j] + 1, curr[j - 1] + 1, prev[j - 1] + cost });
+            std::size_t cell { std::min(
+                { prev[j] + 1, curr[j - 1] + 1, prev[j - 1] + cost }) };
 
             if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
-                curr[j] = std::min(curr[j], prev2[j - 2] + 1);
+                cell = std::min(cell, prev2[j - 2] + 1);
+
+            curr[j] = std::min(cell, over);
+            row_min = std::min(row_min, curr[j]);
         }
 
+        if (high < m) curr[high + 1] = over;
+        if (row_min > cutoff) return over;
+
+        std::size_t *oldest { prev2 };
         prev2 = prev;
         prev  = curr;
+        curr  = oldest;
     }
 
     return prev[m];
 }
 
 
+auto
+cchell::shared::stable_hash(std::string_view data, std::uint64_t seed)
+    -> std::uint64_t
+{
+    constexpr std::uint64_t MULTIPLIER { 0x9e3779b97f4a7c15 };
+
+    std::uint64_t hash { mix(seed ^ (data.size() * MULTIPLIER)) };
+
+    /* eight bytes a step, the tail padded with zeroes */
+    while (!data.empty())
+    {
+        std::uint64_t word { 0 };
+        const auto    taken { std::min(data.size(), sizeof word) };
+
+        std::memcpy(&word, data.data(), taken);
+        data.remove_prefix(taken);
+
+        hash = std::rotl(hash ^ (word * MULTIPLIER), 29) * MULTIPLIER;
+    }
+
+    return mix(hash);
+}
+
+
 impl::executables::executables()
 {
     const char *CPATH { std::getenv("PATH") };
     if (CPATH == nullptr) throw std::runtime_error { "$PATH is not defined." };
-    std::string_view PATH { CPATH };
+
+    load(CPATH);
+}
+
+
+void
+impl::executables::load(std::string_view PATH)
+{
+    m_paths.clear();
 
     for (auto subrange : PATH | std::views::split(':'))
     {
@@ -102,13 +179,20 @@ impl::executables::exists(std::string_view name) const -> bool
 }
 
 
+auto
+impl::executables::find(std::string_view name) const
+    -> const std::filesystem::path *
+{
+    auto it { m_paths.find(name) };
+    return it == m_paths.end() ? nullptr : &it->second;
+}
+
+
 auto
 impl::executables::closest(std::string_view name,
                            std::size_t      max_distance) const
     -> const std::pair<const std::string, std::filesystem::path> *
 {
-    if (m_paths.empty()) throw std::runtime_error { "no executables indexed" };
-
     if (auto it { m_paths.find(name) }; it != m_paths.end()) return &(*it);
 
     const std::pair<const std::string, std::filesystem::path> *closest {
@@ -123,7 +207,8 @@ impl::executables::closest(std::string_view name,
         if (std::abs(static_cast<int>(cmd.length() - name.length())) > 2)
             continue;
 
-        std::size_t dist { damerau_levenshtein_osa(name, cmd) };
+        std::size_t dist { damerau_levenshtein_osa(
+            name, cmd, std::min(max_distance, closest_distance)) };
 
         if (dist < closest_distance)
         {
@@ -174,3 +259,73 @@ impl::tty_status::operator[](unsigned int fd) const -> bool
     if (fd == 2) return stderr();
     return isatty(fd) == 1;
 }
+
+
+impl::thread_pool::thread_pool(std::size_t threads)
+    : m_count { std::max(threads, 1UZ) }, m_owner { getpid() }
+{
+    m_threads.reserve(m_count);
+
+    for (std::size_t i { 0 }; i < m_count; i++)
+        m_threads.emplace_back([this, i](const std::stop_token &stop)
+                               { mf_work(stop, i); });
+}
+
+
+auto
+impl::thread_pool::size() const -> std::size_t
+{
+    return m_count;
+}
+
+
+void
+impl::thread_pool::submit(task job)
+{
+    if (getpid() != m_owner) return job(0);
+
+    {
+        std::scoped_lock lock { m_mutex };
+        m_tasks.emplace_back(std::move(job));
+    }
+
+    m_ready.notify_one();
+}
+
+
+void
+impl::thread_pool::wait()
+{
+    if (getpid() != m_owner) return;
+
+    std::unique_lock lock { m_mutex };
+    m_idle.wait(lock, [this] { return m_tasks.empty() && m_busy == 0; });
+}
+
+
+void
+impl::thread_pool::mf_work(const std::stop_token &stop, std::size_t index)
+{
+    std::unique_lock lock { m_mutex };
+
+    while (m_ready.wait(lock, stop, [this] { return !m_tasks.empty(); }))
+    {
+        task job { std::move(m_tasks.front()) };
+        m_tasks.pop_front();
+        m_busy++;
+
+        lock.unlock();
+        job(index);
+        lock.lock();
+
+        if (--m_busy == 0 && m_tasks.empty()) m_idle.notify_all();
+    }
+}
+
+
+auto
+cchell::shared::workers() -> impl::thread_pool &
+{
+    static impl::thread_pool pool { std::thread::hardware_concurrency() };
+    return pool;
+}
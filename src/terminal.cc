@@ -1,6 +1,18 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
 #include <optional>
+#include <span>
+#include <string_view>
 #include <tuple>
+#include <utility>
 
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "ansi.hh"
 #include "terminal.hh"
 
 
@@ -9,15 +21,6 @@ namespace
     using namespace cchell::terminal;
 
 
-    struct csi_state
-    {
-        bool active { false };
-        int  p1 { 0 };
-        int  p2 { 0 };
-        bool semi { false };
-    } g_state;
-
-
     auto
     decode_plain(char c) noexcept -> std::optional<key_event>
     {
@@ -73,75 +76,93 @@ namespace
         case '~':
             switch (p1)
             {
-            case 1:  return key_event { key::home, shift, alt, ctrl };
-            case 2:  return key_event { key::insert, shift, alt, ctrl };
-            case 3:  return key_event { key::del, shift, alt, ctrl };
-            case 4:  return key_event { key::end, shift, alt, ctrl };
-            case 5:  return key_event { key::page_up, shift, alt, ctrl };
-            case 6:  return key_event { key::page_down, shift, alt, ctrl };
-            default: break;
+            case 1:   return key_event { key::home, shift, alt, ctrl };
+            case 2:   return key_event { key::insert, shift, alt, ctrl };
+            case 3:   return key_event { key::del, shift, alt, ctrl };
+            case 4:   return key_event { key::end, shift, alt, ctrl };
+            case 5:   return key_event { key::page_up, shift, alt, ctrl };
+            case 6:   return key_event { key::page_down, shift, alt, ctrl };
+            case 200: return key::paste_begin;
+            case 201: return key::paste_end;
+            default:  break;
             }
         default: return std::nullopt;
         }
     }
 
 
-    auto
-    decode_csi_char(char ch) noexcept -> std::pair<decode_status, std::optional<key_event>>
+    /* the ranges of code points taking no cell, then those taking two,
+       the common blocks rather than all of what Unicode lists */
+    constexpr std::array<std::pair<char32_t, char32_t>, 9> ZERO_WIDTH { {
+        { 0x0300, 0x036F },
+        { 0x0483, 0x0489 },
+        { 0x1AB0, 0x1AFF },
+        { 0x1DC0, 0x1DFF },
+        { 0x200B, 0x200F },
+        { 0x20D0, 0x20FF },
+        { 0xFE00, 0xFE0F },
+        { 0xFE20, 0xFE2F },
+        { 0xE0100, 0xE01EF },
+    } };
+
+    constexpr std::array<std::pair<char32_t, char32_t>, 12> DOUBLE_WIDTH { {
+        { 0x1100, 0x115F },
+        { 0x2E80, 0x303E },
+        { 0x3041, 0x33FF },
+        { 0x3400, 0x4DBF },
+        { 0x4E00, 0x9FFF },
+        { 0xA000, 0xA4CF },
+        { 0xAC00, 0xD7A3 },
+        { 0xF900, 0xFAFF },
+        { 0xFE30, 0xFE4F },
+        { 0xFF00, 0xFF60 },
+        { 0xFFE0, 0xFFE6 },
+        { 0x1F300, 0x1FAFF },
+    } };
+
+
+    constexpr auto
+    in_ranges(std::span<const std::pair<char32_t, char32_t>> ranges,
+              char32_t                                       code_point)
+        -> bool
     {
-        using enum decode_status;
-
-        if (!g_state.active)
-        {
-            if (ch == '[')
-            {
-                g_state        = {};
-                g_state.active = true;
-                return { pending, std::nullopt };
-            }
-
-            return { none, std::nullopt };
-        }
+        return std::ranges::any_of(ranges,
+                                   [code_point](const auto &range)
+                                   {
+                                       return code_point >= range.first
+                                           && code_point <= range.second;
+                                   });
+    }
 
-        if (ch >= '0' && ch <= '9')
-        {
-            int &target { g_state.semi ? g_state.p2 : g_state.p1 };
-            target = (target * 10) + (ch - '0');
 
-            return { pending, std::nullopt };
-        }
-
-        if (ch == ';')
-        {
-            g_state.semi = true;
-            return { pending, std::nullopt };
-        }
+    /* the most a frame can have and still go without synchronizing */
+    constexpr std::size_t SMALL_FRAME { 128 };
 
-        /* final byte */
-        int  mod { g_state.semi ? g_state.p2 : 1 };
-        auto event { decode_csi_final_byte(g_state.p1, ch, mod) };
 
-        g_state = {}; /* reset */
+    /* what ends a bracketed paste */
+    constexpr std::string_view PASTE_END { "\x1b[201~" };
 
-        if (!event) return { none, std::nullopt };
 
-        return { value, event };
+    /* a byte that is text, which any UTF-8 byte past ASCII is part of */
+    constexpr auto
+    is_text(char c) noexcept -> bool
+    {
+        return static_cast<unsigned char>(c) >= 0x20 && c != 0x7F;
     }
 }
 
 
 auto
-cchell::terminal::decode(char ch) noexcept -> std::pair<decode_status, std::optional<key_event>>
+cchell::terminal::decoder::decode(char ch) noexcept
+    -> std::pair<decode_status, std::optional<key_event>>
 {
     using enum decode_status;
 
-    static bool esc_seen { false };
-
-    if (!esc_seen)
+    if (!m_esc_seen)
     {
         if (ch == 0x1B) /* ESC */
         {
-            esc_seen = true;
+            m_esc_seen = true;
             return { pending, std::nullopt };
         }
 
@@ -150,17 +171,288 @@ cchell::terminal::decode(char ch) noexcept -> std::pair<decode_status, std::opti
         return { none, std::nullopt };
     }
 
-    /* ESC already seen */
-    esc_seen = false;
+    /* in the middle of a CSI sequence */
+    if (m_csi.active) return mf_decode_csi_char(ch);
 
-    /* Alt + key */
+    /* ESC already seen, Alt + key */
     if (ch != '[')
     {
+        m_esc_seen = false;
         return {
             value, key_event { key::unknown, false, true }
         };
     }
 
     /* CSI */
-    return decode_csi_char(ch);
+    return mf_decode_csi_char(ch);
+}
+
+
+auto
+cchell::terminal::decoder::decode(std::span<const char> bytes) noexcept
+    -> decoded
+{
+    if (bytes.empty()) return { decode_status::none, std::nullopt, 0 };
+    if (m_pasting) return mf_decode_paste(bytes);
+
+    if (!m_esc_seen && is_text(bytes.front()))
+    {
+        auto end { std::ranges::find_if_not(bytes, is_text) };
+        auto size { static_cast<std::size_t>(end - bytes.begin()) };
+
+        return { .status = decode_status::none,
+                 .event  = std::nullopt,
+                 .size   = size,
+                 .text   = { bytes.data(), size } };
+    }
+
+    bool escape { m_esc_seen || bytes.front() == 0x1B };
+
+    for (std::size_t i { 0 }; i < bytes.size(); i++)
+    {
+        auto [status, event] { decode(bytes[i]) };
+        if (status == decode_status::pending) continue;
+
+        if (event && event->code == key::paste_begin) m_pasting = true;
+
+        /* a sequence that isn't a key is dropped, not taken for text */
+        return { .status = status,
+                 .event  = event,
+                 .size   = i + 1,
+                 .text   = escape ? std::string_view {}
+                                  : std::string_view { bytes.data(), i + 1 } };
+    }
+
+    return { decode_status::pending, std::nullopt, bytes.size() };
+}
+
+
+void
+cchell::terminal::decoder::reset() noexcept
+{
+    m_csi      = {};
+    m_esc_seen = false;
+}
+
+
+auto
+cchell::terminal::decoder::mf_decode_csi_char(char ch) noexcept
+    -> std::pair<decode_status, std::optional<key_event>>
+{
+    using enum decode_status;
+
+    if (!m_csi.active)
+    {
+        if (ch == '[')
+        {
+            m_csi        = {};
+            m_csi.active = true;
+            return { pending, std::nullopt };
+        }
+
+        return { none, std::nullopt };
+    }
+
+    if (ch >= '0' && ch <= '9')
+    {
+        int &target { m_csi.semi ? m_csi.p2 : m_csi.p1 };
+        target = (target * 10) + (ch - '0');
+
+        return { pending, std::nullopt };
+    }
+
+    if (ch == ';')
+    {
+        m_csi.semi = true;
+        return { pending, std::nullopt };
+    }
+
+    /* final byte */
+    int  mod { m_csi.semi ? m_csi.p2 : 1 };
+    auto event { decode_csi_final_byte(m_csi.p1, ch, mod) };
+
+    reset();
+
+    if (!event) return { none, std::nullopt };
+
+    return { value, event };
+}
+
+
+/* everything up to the closing marker, which can be split across spans */
+auto
+cchell::terminal::decoder::mf_decode_paste(std::span<const char> bytes) noexcept
+    -> decoded
+{
+    using enum decode_status;
+
+    if (m_paste_matched == 0 && bytes.front() != PASTE_END.front())
+    {
+        auto end { std::ranges::find(bytes, PASTE_END.front()) };
+        auto size { static_cast<std::size_t>(end - bytes.begin()) };
+
+        return { .status = none,
+                 .event  = std::nullopt,
+                 .size   = size,
+                 .text   = { bytes.data(), size },
+                 .pasted = true };
+    }
+
+    std::size_t used { 0 };
+    while (used < bytes.size() && m_paste_matched < PASTE_END.size()
+           && bytes[used] == PASTE_END[m_paste_matched])
+        used++, m_paste_matched++;
+
+    if (m_paste_matched == PASTE_END.size())
+    {
+        m_pasting       = false;
+        m_paste_matched = 0;
+        return { value, key::paste_end, used };
+    }
+
+    if (used == bytes.size()) return { pending, std::nullopt, used };
+
+    /* only the start of the marker, which was pasted text after all */
+    auto matched { std::exchange(m_paste_matched, 0) };
+    return { .status = none,
+             .event  = std::nullopt,
+             .size   = used,
+             .text   = PASTE_END.substr(0, matched),
+             .pasted = true };
+}
+
+
+auto
+cchell::terminal::input_buffer::fill(int fd) noexcept -> int
+{
+    const std::size_t capacity { m_ring.size() };
+    const std::size_t tail { (m_head + m_size) % capacity };
+
+    if (m_size == capacity) return 0;
+
+    /* the free space is one part, or two when it wraps around the end */
+    std::array<iovec, 2> parts {};
+    int                  count { 1 };
+
+    if (tail >= m_head && m_size != 0)
+    {
+        parts[0] = { m_ring.data() + tail, capacity - tail };
+        parts[1] = { m_ring.data(), m_head };
+        count    = m_head == 0 ? 1 : 2;
+    }
+    else if (m_size == 0)
+    {
+        m_head   = 0;
+        parts[0] = { m_ring.data(), capacity };
+    }
+    else
+        parts[0] = { m_ring.data() + tail, m_head - tail };
+
+    /* EINTR is returned too, it's how a ^C gets noticed */
+    ssize_t got { readv(fd, parts.data(), count) };
+
+    if (got < 0) return errno;
+    if (got == 0) return EOF;
+
+    m_size += static_cast<std::size_t>(got);
+    return 0;
+}
+
+
+auto
+cchell::terminal::input_buffer::peek() const noexcept
+    -> std::span<const char>
+{
+    return { m_ring.data() + m_head,
+             std::min(m_size, m_ring.size() - m_head) };
+}
+
+
+void
+cchell::terminal::input_buffer::consume(std::size_t size) noexcept
+{
+    size    = std::min(size, m_size);
+    m_head  = (m_head + size) % m_ring.size();
+    m_size -= size;
+}
+
+
+auto
+cchell::terminal::cell_width(char32_t code_point) noexcept -> int
+{
+    if (code_point < 0x300) return 1;
+    if (in_ranges(ZERO_WIDTH, code_point)) return 0;
+    if (in_ranges(DOUBLE_WIDTH, code_point)) return 2;
+    if (code_point >= 0x20000 && code_point <= 0x3FFFD) return 2;
+
+    return 1;
+}
+
+
+auto
+cchell::terminal::columns(int fd) noexcept -> std::size_t
+{
+    winsize size {};
+
+    if (ioctl(fd, TIOCGWINSZ, &size) < 0 || size.ws_col == 0) return 80;
+    return size.ws_col;
+}
+
+
+auto
+cchell::terminal::rows(int fd) noexcept -> std::size_t
+{
+    winsize size {};
+
+    if (ioctl(fd, TIOCGWINSZ, &size) < 0 || size.ws_row == 0) return 24;
+    return size.ws_row;
+}
+
+
+cchell::terminal::frame::frame(int fd, bool synchronized) : m_fd(fd)
+{
+    if (synchronized)
+        m_begin = std::format("{}", ansi::command::synchronized_output(true));
+
+    m_buffer = m_begin;
+}
+
+
+auto
+cchell::terminal::frame::empty() const noexcept -> bool
+{
+    return m_buffer.size() == m_begin.size();
+}
+
+
+void
+cchell::terminal::frame::flush() noexcept
+{
+    if (empty()) return;
+
+    std::string_view data { m_buffer };
+
+    /* a frame this small gets to the terminal in one read, and is drawn
+       whole without the markers, which would be most of its bytes */
+    if (data.size() - m_begin.size() <= SMALL_FRAME)
+        data.remove_prefix(m_begin.size());
+    else if (!m_begin.empty())
+    {
+        std::format_to(std::back_inserter(m_buffer), "{}",
+                       ansi::command::synchronized_output(false));
+        data = m_buffer;
+    }
+
+    while (!data.empty())
+    {
+        ssize_t written { ::write(m_fd, data.data(), data.size()) };
+
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) break;
+
+        data.remove_prefix(static_cast<std::size_t>(written));
+    }
+
+    /* the capacity stays, so drawing stops allocating after a few frames */
+    m_buffer.resize(m_begin.size());
 }
@@ -0,0 +1,251 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <format>
+#include <iostream>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "lexer.hh"
+#include "parser.hh"
+#include "terminal.hh"
+
+
+/**
+ * parses and checks the same inputs on several threads at once, each
+ * thread having to come to what a single one did. some of the inputs
+ * stop halfway through, to see that nothing an aborted parse leaves
+ * behind reaches the next one.
+ *
+ * terminal input is decoded the same way, a decoder to each thread, fed
+ * in chunks that split escape sequences and pastes in the middle.
+ */
+namespace
+{
+    constexpr std::size_t THREADS { 8 };
+    constexpr std::size_t ROUNDS { 50 };
+
+
+    struct input
+    {
+        std::string source;
+        bool        fails;
+    };
+
+
+    /* what parsing and checking @param source came to, empty if fine */
+    auto
+    outcome(std::string_view source) -> std::string
+    {
+        auto tokens { cchell::lexer::lex(source) };
+        if (!tokens) return std::format("lexer: {}", tokens.error().message);
+
+        cchell::parser::ast ast;
+
+        if (auto diag { cchell::parser::parse(*tokens, ast) })
+            return std::format("parser: {} at {}:{}", diag->message,
+                               diag->source.line, diag->source.column);
+
+        if (auto diag { cchell::parser::check(ast) })
+            return std::format("check: {} at {}:{}", diag->message,
+                               diag->source.line, diag->source.column);
+
+        return {};
+    }
+
+
+    auto
+    inputs() -> std::vector<input>
+    {
+        std::vector<input> all {
+            { "echo hello | tr a-z A-Z && true || false", false },
+            { "if true; then echo a; elif false; then :; else echo c; fi",
+              false },
+            { "for i in 1 2 3; do echo $i; done", false },
+            { "while false; do :; done", false },
+            { "case x in a) echo a;; *) echo other;; esac", false },
+            { "f() { echo \"$1\"; }; f one", false },
+            { "x=$((1 + 2 * 3)); echo ${x:-none}", false },
+            { "echo {a,b}{1..3} *.cc", false },
+
+            /* the parse stops halfway through these */
+            { "if true; then echo a;", true },
+            { "for i in 1 2; do echo $i", true },
+            { "echo a |", true },
+            { "true &&", true },
+            { "case x in a) echo", true },
+            { "while true; do; done", true },
+            { "f() { echo", true },
+
+            /* these parse, but don't check out */
+            { "cchell-no-such-command --flag", true },
+            { "./no/such/cchell/path arg", true },
+            { "true && cchell-missing-command", true },
+        };
+
+        /* long enough that the threads are in the middle of one together */
+        std::string lines;
+        for (int i { 0 }; i < 2000; i++)
+            lines += std::format("echo {} | cat && x{}=1\n", i, i);
+
+        all.emplace_back(lines, false);
+        all.emplace_back(lines + "if true; then\n" + lines, true);
+        all.emplace_back(lines + "cchell-no-such-command\n" + lines, true);
+
+        return all;
+    }
+
+
+    /* what decoding @param bytes came to, fed @param chunk bytes at a time */
+    auto
+    decode(std::string_view bytes, std::size_t chunk) -> std::string
+    {
+        using cchell::terminal::decode_status;
+
+        cchell::terminal::decoder decoder;
+        std::string               out;
+
+        for (std::size_t at { 0 }; at < bytes.size(); at += chunk)
+        {
+            std::span<const char> rest { bytes.substr(at, chunk) };
+
+            while (!rest.empty())
+            {
+                auto [status, event, size, text, pasted] { decoder.decode(
+                    rest) };
+
+                if (status == decode_status::value)
+                    out += std::format("<{} {:d}{:d}{:d}>",
+                                       static_cast<int>(event->code),
+                                       event->shift, event->alt, event->ctrl);
+                else if (status == decode_status::none)
+                    out += std::format("{}[{}]", pasted ? 'p' : 't', text);
+
+                rest = rest.subspan(size);
+            }
+        }
+
+        return out;
+    }
+
+
+    auto
+    keystrokes() -> std::vector<std::string>
+    {
+        std::vector<std::string> all {
+            "echo hi\r",
+            "\x1b[D\x1b[C\x1b[A\x1b[B\x1b[H\x1b[F",
+            "\x1b[1;5D\x1b[1;5C\x1b[1;2A\x1b[3~\x1b[5~\x1b[6~",
+            "\x1bOP\x1bOQ\x1b[15~\x1b[24~",
+            "\x7f\x08\t\x01\x05\x0b\x15\x17\x19\x04",
+            "\x1b[200~pasted\n\x1b[D text\x1b[20\x1b[201~after",
+
+            /* escapes that aren't keys, which have to be dropped alike */
+            "\x1b[99;99z\x1bx\x1b[\x1b[1;",
+            "caf\xc3\xa9 \xe2\x86\x92 \xf0\x9f\x99\x82\r",
+        };
+
+        std::string typed;
+        for (int i { 0 }; i < 500; i++)
+            typed += std::format("ls {}\x1b[D\x1b[1;5C\x7f\x1b[200~{}\n"
+                                 "\x1b[201~\r",
+                                 i, i);
+
+        all.emplace_back(std::move(typed));
+        return all;
+    }
+}
+
+
+auto
+main() -> int
+{
+    const std::vector<input> all { inputs() };
+
+    std::vector<std::string> expected;
+    bool                     ok { true };
+
+    for (const auto &[source, fails] : all)
+    {
+        expected.emplace_back(outcome(source));
+
+        if (expected.back().empty() == fails)
+        {
+            std::println(std::cerr, "{}: expected to {}, got '{}'",
+                         source.substr(0, 40), fails ? "fail" : "pass",
+                         expected.back());
+            ok = false;
+        }
+    }
+
+    std::atomic_size_t mismatches { 0 };
+
+    {
+        std::vector<std::jthread> threads;
+
+        for (std::size_t id { 0 }; id < THREADS; id++)
+            threads.emplace_back(
+                [&, id]
+                {
+                    /* each thread starts elsewhere, so different inputs
+                       are parsed side by side */
+                    for (std::size_t round { 0 }; round < ROUNDS; round++)
+                        for (std::size_t k { 0 }; k < all.size(); k++)
+                        {
+                            std::size_t i { (k + id + round) % all.size() };
+                            if (outcome(all[i].source) != expected[i])
+                                mismatches++;
+                        }
+                });
+    }
+
+    if (mismatches > 0)
+    {
+        std::println(std::cerr, "{} parses differed across threads",
+                     mismatches.load());
+        ok = false;
+    }
+
+    /* every input split up in as many ways as there are chunk sizes */
+    const std::vector<std::string> keys { keystrokes() };
+    constexpr std::array<std::size_t, 4> CHUNKS { 1, 3, 7, 4096 };
+
+    std::vector<std::string> decoded;
+    for (const auto &bytes : keys)
+        for (std::size_t chunk : CHUNKS)
+            decoded.emplace_back(decode(bytes, chunk));
+
+    mismatches = 0;
+
+    {
+        std::vector<std::jthread> threads;
+
+        for (std::size_t id { 0 }; id < THREADS; id++)
+            threads.emplace_back(
+                [&, id]
+                {
+                    for (std::size_t round { 0 }; round < ROUNDS; round++)
+                        for (std::size_t k { 0 }; k < decoded.size(); k++)
+                        {
+                            std::size_t i { (k + id + round) % decoded.size() };
+                            if (decode(keys[i / CHUNKS.size()],
+                                       CHUNKS[i % CHUNKS.size()])
+                                != decoded[i])
+                                mismatches++;
+                        }
+                });
+    }
+
+    if (mismatches > 0)
+    {
+        std::println(std::cerr, "{} decodes differed across threads",
+                     mismatches.load());
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
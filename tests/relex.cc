@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer.hh"
+
+
+/**
+ * edits a command over and over, relexing only around each edit, and
+ * checks that the tokens come out as lexing all of it again would. the
+ * command goes through unbalanced states on the way, which the tokens
+ * have to be carried through as well.
+ */
+namespace
+{
+    constexpr std::size_t EDITS { 20000 };
+
+    /* what gets typed, and pasted, into the command */
+    constexpr std::array<std::string_view, 22> PIECES {
+        "a",    "echo", " ",       "  ",     "\n",      "\"x y\"",
+        "'q'",  "\"",   "'",       "|",      "&",       ";",
+        "$v",   "{",    "}",       "(",      ")",       "\\",
+        " && ", "\\\n", "\"a\nb\"", "case x in a) ;; esac",
+    };
+
+
+    /* all of @param text lexed again, whether it balances or not */
+    auto
+    lex_all(std::string_view text) -> std::vector<cchell::lexer::token>
+    {
+        std::vector<cchell::lexer::token> tokens;
+        cchell::lexer::line_lexer         lexer { text };
+
+        while (lexer.step(tokens));
+        return tokens;
+    }
+
+
+    auto
+    describe(const cchell::lexer::token &token, const char *base)
+        -> std::string
+    {
+        return std::format("{}@{} '{}' {}:{}",
+                           static_cast<int>(token.type()),
+                           token.data().data() - base, token.data(),
+                           token.source().line, token.source().column);
+    }
+
+
+    /* the first difference between @param got and @param expected */
+    auto
+    compare(const std::vector<cchell::lexer::token> &got,
+            const std::vector<cchell::lexer::token> &expected,
+            const char                              *base) -> std::string
+    {
+        for (std::size_t i { 0 }; i < got.size() && i < expected.size(); i++)
+            if (auto a { describe(got[i], base) },
+                b { describe(expected[i], base) };
+                a != b)
+                return std::format("token {}: got {}, expected {}", i, a, b);
+
+        if (got.size() != expected.size())
+            return std::format("got {} tokens, expected {}", got.size(),
+                               expected.size());
+
+        return {};
+    }
+}
+
+
+auto
+main() -> int
+{
+    constexpr std::string_view START { "echo \"a b\" | cat && { ls; }" };
+
+    std::mt19937 random { 26 };
+
+    /* each edit goes to a copy, so the tokens have to be moved over to
+       a new buffer as well */
+    auto                              text { std::make_unique<std::string>(
+        START) };
+    std::vector<cchell::lexer::token> tokens { *cchell::lexer::lex(*text) };
+
+    std::size_t checked { 0 };
+
+    for (std::size_t n { 0 }; n < EDITS; n++)
+    {
+        auto        after { std::make_unique<std::string>(*text) };
+        std::size_t offset { random() % (after->size() + 1) };
+
+        cchell::lexer::edit change { .offset = offset };
+
+        if (random() % 3 == 0 && offset < after->size())
+        {
+            change.removed = 1 + random() % std::min<std::size_t>(
+                                 4, after->size() - offset);
+            after->erase(offset, change.removed);
+        }
+        else
+        {
+            auto piece { PIECES[random() % PIECES.size()] };
+            change.inserted = piece.size();
+            after->insert(offset, piece);
+        }
+
+        cchell::lexer::relex(*after, tokens, text->data(), change);
+        text = std::move(after);
+
+        auto expected { cchell::lexer::lex(*text) };
+        if (expected) checked++;
+
+        if (auto diff { compare(tokens,
+                                expected ? *expected : lex_all(*text),
+                                text->data()) };
+            !diff.empty())
+        {
+            std::println(std::cerr, "after edit {} of '{}': {}", n, *text,
+                         diff);
+            return 1;
+        }
+
+        /* keep the command from growing without end */
+        if (text->size() > 120)
+        {
+            text   = std::make_unique<std::string>(START);
+            tokens = *cchell::lexer::lex(*text);
+        }
+    }
+
+    /* enough edits should leave something that lexes */
+    if (checked < EDITS / 20)
+    {
+        std::println(std::cerr, "only {} of {} edits could be checked",
+                     checked, EDITS);
+        return 1;
+    }
+
+    return 0;
+}